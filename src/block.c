@@ -5,19 +5,34 @@
 #include "block.h"
 #include "utils.h"
 #include "security.h"
+#include "merkle.h"
+#include "bloom.h"
+#include "pool.h"
 
 Block* create_block(uint32_t id, const char* previous_hash) {
-    Block* block = (Block*)malloc(sizeof(Block));
+    Block* block = (Block*)pool_alloc(sizeof(Block));
     if (!block) {
         return NULL;
     }
 
     block->id = id;
     block->timestamp = time(NULL);
+    block->transactions = NULL;
     block->transaction_count = 0;
+    block->transaction_capacity = 0;
+    block->max_transactions = DEFAULT_MAX_BLOCK_TRANSACTIONS;
+    block->max_bytes = DEFAULT_MAX_BLOCK_BYTES;
+    block->payload_bytes = 0;
     block->nonce = 0;
     block->next = NULL;
 
+    block->bloom = (unsigned char*)pool_calloc(BLOOM_MIN_BYTES);
+    if (!block->bloom) {
+        pool_free(block);
+        return NULL;
+    }
+    block->bloom_bytes = BLOOM_MIN_BYTES;
+
     if (previous_hash) {
         strncpy(block->previous_hash, previous_hash, HASH_SIZE);
         block->previous_hash[HASH_SIZE] = '\0';
@@ -27,80 +42,247 @@ Block* create_block(uint32_t id, const char* previous_hash) {
     }
 
     memset(block->hash, 0, HASH_SIZE + 1);
+    memset(block->merkle_root, 0, HASH_BYTES);
     return block;
 }
 
+static void put_le32(unsigned char* p, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static void put_le64(unsigned char* p, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+void serialize_block_header(const Block* block, const unsigned char merkle_root[HASH_BYTES],
+                            unsigned char header[BLOCK_HEADER_SIZE]) {
+    put_le32(header, block->id);
+    put_le64(header + 4, (uint64_t)block->timestamp);
+
+    // The genesis block (or a malformed link) hashes as an all-zero previous hash
+    if (strlen(block->previous_hash) == HASH_SIZE) {
+        hex_to_str(block->previous_hash, header + 12, HASH_BYTES);
+    } else {
+        memset(header + 12, 0, HASH_BYTES);
+    }
+
+    memcpy(header + 44, merkle_root, HASH_BYTES);
+    put_le32(header + BLOCK_NONCE_OFFSET, block->nonce);
+}
+
+// Hash the header using the stored Merkle root
+int compute_block_hash(const Block* block, char hash[HASH_SIZE + 1]) {
+    unsigned char header[BLOCK_HEADER_SIZE];
+    unsigned char digest[HASH_BYTES];
+
+    serialize_block_header(block, block->merkle_root, header);
+
+    // Calculate SHA-256 hash of the fixed-layout header
+    if (!sha256_bytes(header, sizeof(header), digest)) {
+        return 0;
+    }
+    str_to_hex(digest, hash, HASH_BYTES);
+    return 1;
+}
+
 void calculate_block_hash(Block* block) {
-    char data[1024];
-    int offset = 0;
+    compute_block_hash(block, block->hash);
+}
 
-    // Combine block data into a single string
-    offset += snprintf(data + offset, sizeof(data) - offset, "%u", block->id);
-    offset += snprintf(data + offset, sizeof(data) - offset, "%ld", block->timestamp);
-    offset += snprintf(data + offset, sizeof(data) - offset, "%u", block->nonce);
-    offset += snprintf(data + offset, sizeof(data) - offset, "%s", block->previous_hash);
+// Bytes a transaction takes in a saved block: both string ids, timestamp,
+// cipher id, key scheme, key id, IV, tag, ciphertext length and ciphertext
+uint32_t transaction_size(const Transaction* transaction) {
+    uint32_t size = sizeof(transaction->patient_id) + sizeof(transaction->record_type) + sizeof(time_t) +
+                    2 + sizeof(uint32_t) + AES_IV_SIZE + AES_GCM_TAG_SIZE + sizeof(uint32_t);
+    if (transaction->encrypted_data) {
+        size += (uint32_t)transaction->encrypted_data->data_len;
+    }
+    return size;
+}
 
-    // Add transaction data (only non-sensitive data)
-    for (int i = 0; i < block->transaction_count; i++) {
-        offset += snprintf(data + offset, sizeof(data) - offset, "%s%s%ld",
-            block->transactions[i].patient_id,
-            block->transactions[i].record_type,
-            block->transactions[i].timestamp);
+// Size of the largest record validate_record_data() accepts. GCM adds no
+// padding, so its ciphertext is as long as its text.
+uint32_t max_transaction_size(void) {
+    Transaction empty = {0};
+    return transaction_size(&empty) + MAX_RECORD_DATA_BYTES;
+}
+
+// Smallest power-of-two filter giving BLOOM_BITS_PER_KEY bits to each of
+// the two keys of `capacity` transactions
+static uint32_t bloom_bytes_for(int capacity) {
+    uint64_t wanted = ((uint64_t)capacity * 2 * BLOOM_BITS_PER_KEY + 7) / 8;
+    uint32_t bytes = BLOOM_MIN_BYTES;
+    while (bytes < wanted && bytes < BLOOM_MAX_BYTES) {
+        bytes *= 2;
     }
+    return bytes;
+}
 
-    // Calculate SHA-256 hash
-    sha256(data, block->hash);
+// Grow the transaction list to hold at least `capacity` transactions. The
+// Bloom filter grows with it so its false-positive rate stays flat.
+int reserve_transactions(Block* block, int capacity) {
+    if (!block || capacity < 0) {
+        return 0;
+    }
+    if (capacity <= block->transaction_capacity) {
+        return 1;
+    }
+
+    int new_capacity = block->transaction_capacity ? block->transaction_capacity : INITIAL_TRANSACTION_CAPACITY;
+    while (new_capacity < capacity) {
+        new_capacity *= 2;
+    }
+
+    Transaction* transactions = (Transaction*)pool_realloc(block->transactions, sizeof(Transaction) * new_capacity);
+    if (!transactions) {
+        return 0;
+    }
+    block->transactions = transactions;
+    block->transaction_capacity = new_capacity;
+
+    uint32_t bloom_bytes = bloom_bytes_for(new_capacity);
+    if (bloom_bytes > block->bloom_bytes && resize_block_bloom(block, bloom_bytes)) {
+        rebuild_block_bloom(block);
+    }
+    return 1;
 }
 
-int add_transaction(Block* block, const Transaction* transaction, const unsigned char* key) {
-    if (!block || !transaction || !key || block->transaction_count >= MAX_TRANSACTIONS) {
+// Whether the block's count and byte limits leave room for the transaction
+int block_has_room(const Block* block, const Transaction* transaction) {
+    if (!block || !transaction) {
         return 0;
     }
+    return (uint32_t)block->transaction_count < block->max_transactions &&
+           (uint64_t)block->payload_bytes + transaction_size(transaction) <= block->max_bytes;
+}
 
-    // Validate transaction data
-    if (!validate_patient_id(transaction->patient_id) ||
-        !validate_record_type(transaction->record_type)) {
+// Append an already encrypted transaction, taking ownership of its
+// encrypted data, without updating the Merkle root or hash. Callers
+// appending a batch call refresh_block_hash() once at the end.
+int append_transaction(Block* block, const Transaction* transaction) {
+    if (!block || !transaction || !transaction->encrypted_data || !block_has_room(block, transaction)) {
         return 0;
     }
 
-    // Create new transaction
-    Transaction* new_transaction = &block->transactions[block->transaction_count];
-    strncpy(new_transaction->patient_id, transaction->patient_id, sizeof(new_transaction->patient_id) - 1);
-    strncpy(new_transaction->record_type, transaction->record_type, sizeof(new_transaction->record_type) - 1);
-    new_transaction->timestamp = transaction->timestamp;
+    // Validate transaction data
+    if (!validate_patient_id(string_for_id(transaction->patient_id)) ||
+        !validate_record_type(string_for_id(transaction->record_type))) {
+        return 0;
+    }
 
-    // If the input transaction already has encrypted data, copy it
-    if (transaction->encrypted_data) {
-        new_transaction->encrypted_data = (EncryptedData*)malloc(sizeof(EncryptedData));
-        if (!new_transaction->encrypted_data) {
-            return 0;
-        }
-        memcpy(new_transaction->encrypted_data, transaction->encrypted_data, sizeof(EncryptedData));
-    } else {
-        // Encrypt the data
-        new_transaction->encrypted_data = encrypt_data((const char*)transaction->encrypted_data, key);
-        if (!new_transaction->encrypted_data) {
-            return 0;
-        }
+    if (!reserve_transactions(block, block->transaction_count + 1)) {
+        return 0;
     }
 
-    block->transaction_count++;
+    Transaction* new_transaction = &block->transactions[block->transaction_count];
+    *new_transaction = *transaction;
 
-    // Recalculate block hash
-    calculate_block_hash(block);
+    // Filters hash the text, so they stay valid in files read by other processes
+    block->transaction_count++;
+    block->payload_bytes += transaction_size(new_transaction);
+    bloom_add(block->bloom, block->bloom_bytes, BLOOM_KEY_PATIENT, string_for_id(new_transaction->patient_id));
+    bloom_add(block->bloom, block->bloom_bytes, BLOOM_KEY_RECORD_TYPE, string_for_id(new_transaction->record_type));
     return 1;
 }
 
+// Recalculate Merkle root and block hash after the transactions changed.
+// Returns 0 if either could not be computed.
+int refresh_block_hash(Block* block) {
+    int ok = calculate_merkle_root(block, block->merkle_root);
+    return compute_block_hash(block, block->hash) && ok;
+}
+
+// Append one transaction and rehash; the block takes ownership of its encrypted data
+int add_transaction(Block* block, const Transaction* transaction, const unsigned char* key) {
+    if (!key || !append_transaction(block, transaction)) {
+        return 0;
+    }
+
+    return refresh_block_hash(block);
+}
+
 void free_block(Block* block) {
-    if (block) {
-        // Free encrypted data in transactions
+    free_blocks(&block, 1);
+}
+
+// Free a run of blocks with everything they own. Pointers are gathered
+// and handed to the pool in batches, so a whole chain is released with a
+// few lock acquisitions per size class instead of one free per record.
+void free_blocks(Block** blocks, size_t count) {
+    void* batch[POOL_FREE_BATCH];
+    size_t pending = 0;
+
+    for (size_t b = 0; b < count; b++) {
+        Block* block = blocks[b];
+        if (!block) {
+            continue;
+        }
+
         for (int i = 0; i < block->transaction_count; i++) {
-            if (block->transactions[i].encrypted_data) {
-                free_encrypted_data(block->transactions[i].encrypted_data);
+            if (pending == POOL_FREE_BATCH) {
+                pool_free_batch(batch, pending);
+                pending = 0;
             }
+            batch[pending++] = block->transactions[i].encrypted_data;
         }
-        free(block);
+        if (pending + 3 > POOL_FREE_BATCH) {
+            pool_free_batch(batch, pending);
+            pending = 0;
+        }
+        batch[pending++] = block->transactions;
+        batch[pending++] = block->bloom;
+        batch[pending++] = block;
+    }
+    pool_free_batch(batch, pending);
+}
+
+// Replace the Bloom filter with an empty one of `bytes` bytes
+int resize_block_bloom(Block* block, uint32_t bytes) {
+    if (!block || bytes == 0 || bytes > BLOOM_MAX_BYTES) {
+        return 0;
+    }
+
+    unsigned char* bloom = (unsigned char*)pool_calloc(bytes);
+    if (!bloom) {
+        return 0;
+    }
+    pool_free(block->bloom);
+    block->bloom = bloom;
+    block->bloom_bytes = bytes;
+    return 1;
+}
+
+// Recompute the Bloom filter from the block's transactions
+void rebuild_block_bloom(Block* block) {
+    if (!block) {
+        return;
+    }
+
+    memset(block->bloom, 0, block->bloom_bytes);
+    for (int i = 0; i < block->transaction_count; i++) {
+        const Transaction* transaction = &block->transactions[i];
+        bloom_add(block->bloom, block->bloom_bytes, BLOOM_KEY_PATIENT, string_for_id(transaction->patient_id));
+        bloom_add(block->bloom, block->bloom_bytes, BLOOM_KEY_RECORD_TYPE, string_for_id(transaction->record_type));
+    }
+}
+
+// 0 if the block certainly has no transaction matching every given key
+// (NULL keys match anything); 1 if it may have one
+int block_may_contain(const Block* block, const char* patient_id, const char* record_type) {
+    if (!block) {
+        return 0;
+    }
+    if (patient_id && !bloom_may_contain(block->bloom, block->bloom_bytes, BLOOM_KEY_PATIENT, patient_id)) {
+        return 0;
+    }
+    if (record_type && !bloom_may_contain(block->bloom, block->bloom_bytes, BLOOM_KEY_RECORD_TYPE, record_type)) {
+        return 0;
     }
+    return 1;
 }
 
 int verify_block(const Block* block) {
@@ -108,16 +290,20 @@ int verify_block(const Block* block) {
         return 0;
     }
 
-    // Create a temporary copy of the block
-    Block temp = *block;
-    char original_hash[HASH_SIZE + 1];
-    strcpy(original_hash, block->hash);
+    // The stored Merkle root must match the transactions
+    unsigned char root[HASH_BYTES];
+    if (!calculate_merkle_root(block, root) || memcmp(root, block->merkle_root, HASH_BYTES) != 0) {
+        return 0;
+    }
 
-    // Recalculate hash
-    calculate_block_hash(&temp);
+    // Recalculate hash without touching the block
+    char hash[HASH_SIZE + 1];
+    if (!compute_block_hash(block, hash)) {
+        return 0;
+    }
 
     // Compare hashes
-    return strcmp(original_hash, temp.hash) == 0;
+    return strcmp(block->hash, hash) == 0;
 }
 
 void print_block(const Block* block, const unsigned char* key) {
@@ -130,27 +316,73 @@ void print_block(const Block* block, const unsigned char* key) {
     printf("Previous Hash: %s\n", block->previous_hash);
     printf("Hash: %s\n", block->hash);
     printf("Nonce: %u\n", block->nonce);
+
+    char root[HASH_SIZE + 1];
+    str_to_hex(block->merkle_root, root, HASH_BYTES);
+    printf("Merkle Root: %s\n", root);
     printf("Transactions: %d\n", block->transaction_count);
 
-    for (int i = 0; i < block->transaction_count; i++) {
-        printf("\nTransaction #%d:\n", i + 1);
-        printf("  Patient ID: %s\n", block->transactions[i].patient_id);
-        printf("  Type: %s\n", block->transactions[i].record_type);
-        
-        if (key && block->transactions[i].encrypted_data) {
-            // Decrypt and print the data
-            char* decrypted_data = decrypt_data(block->transactions[i].encrypted_data, key);
-            if (decrypted_data) {
-                printf("  Data: %s\n", decrypted_data);
-                free(decrypted_data);
-            } else {
-                printf("  Data: [Encrypted]\n");
+    // Decrypt the whole block up front, across threads for large blocks
+    const EncryptedData** records = NULL;
+    char** texts = NULL;
+    char* plaintexts = NULL;
+    if (key && block->transaction_count > 0) {
+        records = (const EncryptedData**)malloc(sizeof(EncryptedData*) * block->transaction_count);
+        const unsigned char** keys = (const unsigned char**)malloc(sizeof(unsigned char*) *
+                                                                   block->transaction_count);
+        texts = (char**)malloc(sizeof(char*) * block->transaction_count);
+        if (records && keys && texts) {
+            for (int i = 0; i < block->transaction_count; i++) {
+                records[i] = block->transactions[i].encrypted_data;
+                keys[i] = key;
             }
-        } else {
-            printf("  Data: [Encrypted]\n");
+            plaintexts = decrypt_batch_parallel(records, keys, block->transaction_count, 0, texts);
         }
-        
+        free(keys);
+    }
+
+    for (int i = 0; i < block->transaction_count; i++) {
+        printf("\nTransaction #%d:\n", i + 1);
+        printf("  Patient ID: %s\n", string_for_id(block->transactions[i].patient_id));
+        printf("  Type: %s\n", string_for_id(block->transactions[i].record_type));
+        printf("  Data: %s\n", plaintexts && texts[i] ? texts[i] : "[Encrypted]");
         printf("  Timestamp: %s", get_timestamp_str(block->transactions[i].timestamp));
     }
+    free_decrypted(plaintexts, records, (size_t)block->transaction_count);
+    free(records);
+    free(texts);
     printf("\n");
-} 
\ No newline at end of file
+} 
+
+// Decode a hex hash the way serialize_block_header() does: anything but
+// 64 digits (such as the unset hash of an unmined block) decodes as zeros
+static void decode_hash(const char* hex, unsigned char out[HASH_BYTES]) {
+    memset(out, 0, HASH_BYTES);
+    if (strlen(hex) == HASH_SIZE) {
+        hex_to_str(hex, out, HASH_BYTES);
+    }
+}
+
+void fill_block_header(const Block* block, uint64_t payload_offset, BlockHeader* header) {
+    memset(header, 0, sizeof(BlockHeader));
+    header->id = block->id;
+    header->nonce = block->nonce;
+    header->timestamp = (int64_t)block->timestamp;
+    header->payload_offset = payload_offset;
+    header->transaction_count = (uint32_t)block->transaction_count;
+    header->payload_bytes = block->payload_bytes;
+    decode_hash(block->previous_hash, header->previous_hash);
+    decode_hash(block->hash, header->hash);
+    memcpy(header->merkle_root, block->merkle_root, HASH_BYTES);
+}
+
+// Whether a header still describes the block it was filled from
+int block_header_matches(const BlockHeader* header, const Block* block) {
+    if (!header || !block) {
+        return 0;
+    }
+
+    BlockHeader current;
+    fill_block_header(block, header->payload_offset, &current);
+    return memcmp(&current, header, sizeof(BlockHeader)) == 0;
+}
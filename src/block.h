@@ -2,16 +2,37 @@
 #define BLOCK_H
 
 #include <time.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "security.h"
+#include "dictionary.h"
 
-#define MAX_TRANSACTIONS 10
 #define HASH_SIZE 64  // SHA-256 produces 64 hex characters
+#define HASH_BYTES 32 // Raw SHA-256 digest size
 
-// Transaction structure for medical records
+// Default size limits of a block; a chain can configure its own
+#define DEFAULT_MAX_BLOCK_TRANSACTIONS 1000
+#define DEFAULT_MAX_BLOCK_BYTES (1024 * 1024)  // Serialized transaction bytes
+#define INITIAL_TRANSACTION_CAPACITY 8
+
+// Per-block Bloom filter over patient ids and record types, sized to
+// about BLOOM_BITS_PER_KEY bits per key (roughly 1% false positives)
+#define BLOOM_MIN_BYTES 128
+#define BLOOM_MAX_BYTES (1024 * 1024)
+#define BLOOM_BITS_PER_KEY 10
+
+// Serialized block header: id (4), timestamp (8), previous hash (32),
+// Merkle root of the transactions (32), nonce (4). Integers are
+// little-endian and the nonce comes last so mining only rehashes the
+// final 64-byte chunk.
+#define BLOCK_HEADER_SIZE 80
+#define BLOCK_NONCE_OFFSET 76
+
+// Transaction structure for medical records. Ids are interned; see
+// string_for_id() for their text.
 typedef struct {
-    char patient_id[32];
-    char record_type[32];  // e.g., "diagnosis", "prescription", "visit"
+    StringId patient_id;
+    StringId record_type;  // e.g., "diagnosis", "prescription", "visit"
     EncryptedData* encrypted_data;  // Encrypted medical record data
     time_t timestamp;
 } Transaction;
@@ -20,20 +41,56 @@ typedef struct {
 typedef struct Block {
     uint32_t id;                    // Block identifier
     time_t timestamp;               // Block creation time
-    Transaction transactions[MAX_TRANSACTIONS];  // Array of transactions
+    Transaction* transactions;      // Array of transactions
     int transaction_count;          // Number of transactions in this block
+    int transaction_capacity;       // Allocated slots in transactions
+    uint32_t max_transactions;      // Count limit enforced by add_transaction
+    uint32_t max_bytes;             // Limit on payload_bytes
+    uint32_t payload_bytes;         // Serialized size of the transactions
+    unsigned char merkle_root[HASH_BYTES];  // Merkle root of the transactions
+    unsigned char* bloom;           // Patient ids and record types present (not hashed)
+    uint32_t bloom_bytes;
     char previous_hash[HASH_SIZE + 1];  // Hash of the previous block
     char hash[HASH_SIZE + 1];       // Hash of this block
     uint32_t nonce;                 // Proof of work nonce
     struct Block* next;             // Pointer to the next block
 } Block;
 
+// Hot part of a block: what header walks (linkage checks, listings,
+// lookups by id) read, kept apart from the transactions in two cache lines
+typedef struct {
+    uint32_t id;
+    uint32_t nonce;
+    int64_t timestamp;
+    uint64_t payload_offset;        // Chain-wide position of the block's first transaction
+    uint32_t transaction_count;
+    uint32_t payload_bytes;         // Serialized size of the transactions
+    unsigned char previous_hash[HASH_BYTES];
+    unsigned char hash[HASH_BYTES];
+    unsigned char merkle_root[HASH_BYTES];
+} BlockHeader;
+
 // Function declarations
 Block* create_block(uint32_t id, const char* previous_hash);
 void calculate_block_hash(Block* block);
+int compute_block_hash(const Block* block, char hash[HASH_SIZE + 1]);
+void serialize_block_header(const Block* block, const unsigned char merkle_root[HASH_BYTES],
+                            unsigned char header[BLOCK_HEADER_SIZE]);
+uint32_t transaction_size(const Transaction* transaction);
+uint32_t max_transaction_size(void);
+int reserve_transactions(Block* block, int capacity);
+int block_has_room(const Block* block, const Transaction* transaction);
+int append_transaction(Block* block, const Transaction* transaction);
+int refresh_block_hash(Block* block);
 int add_transaction(Block* block, const Transaction* transaction, const unsigned char* key);
 void free_block(Block* block);
+void free_blocks(Block** blocks, size_t count);
+int resize_block_bloom(Block* block, uint32_t bytes);
+void rebuild_block_bloom(Block* block);
+int block_may_contain(const Block* block, const char* patient_id, const char* record_type);
 int verify_block(const Block* block);
 void print_block(const Block* block, const unsigned char* key);
+void fill_block_header(const Block* block, uint64_t payload_offset, BlockHeader* header);
+int block_header_matches(const BlockHeader* header, const Block* block);
 
 #endif // BLOCK_H 
\ No newline at end of file
@@ -2,9 +2,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "block.h"
 #include "blockchain.h"
 #include "utils.h"
+#include "mining.h"
+#include "pool.h"
 
 Blockchain* create_blockchain(void) {
     Blockchain* chain = (Blockchain*)malloc(sizeof(Blockchain));
@@ -19,11 +23,53 @@ Blockchain* create_blockchain(void) {
         return NULL;
     }
 
+    chain->blocks = (Block**)malloc(sizeof(Block*) * INITIAL_BLOCK_CAPACITY);
+    chain->headers = (BlockHeader*)malloc(sizeof(BlockHeader) * INITIAL_BLOCK_CAPACITY);
+    if (!chain->blocks || !chain->headers) {
+        free(chain->blocks);
+        free(chain->headers);
+        free_block(chain->genesis);
+        free(chain);
+        return NULL;
+    }
+    chain->blocks[0] = chain->genesis;
+    chain->block_capacity = INITIAL_BLOCK_CAPACITY;
+
+    if (!patient_index_init(&chain->patient_index)) {
+        free(chain->blocks);
+        free(chain->headers);
+        free_block(chain->genesis);
+        free(chain);
+        return NULL;
+    }
+    record_type_index_init(&chain->record_type_index);
+    chain_stats_init(&chain->stats);
+    chain->ingest = ingest_queue_create(INGEST_QUEUE_CAPACITY);
+    chain->overlay = create_overlay();
+    if (!chain->ingest || !chain->overlay || !mempool_init(&chain->mempool)) {
+        ingest_queue_free(chain->ingest);
+        free_overlay(chain->overlay);
+        patient_index_free(&chain->patient_index);
+        free(chain->blocks);
+        free(chain->headers);
+        free_block(chain->genesis);
+        free(chain);
+        return NULL;
+    }
+
     chain->latest = chain->genesis;
     chain->block_count = 1;
     chain->difficulty = DIFFICULTY;
+    chain->mining_threads = 0;
+    chain->retarget_interval = RETARGET_INTERVAL;
+    chain->target_block_time = TARGET_BLOCK_TIME;
+    chain->verified_height = 0;
+    chain->verified_hash[0] = '\0';
+    chain->max_block_transactions = DEFAULT_MAX_BLOCK_TRANSACTIONS;
+    chain->max_block_bytes = DEFAULT_MAX_BLOCK_BYTES;
+    chain->record_cache = NULL;
 
-    // Mine genesis block
+    // Mine genesis block (which also fills in its header)
     mine_block(chain, chain->genesis);
     return chain;
 }
@@ -33,14 +79,82 @@ void free_blockchain(Blockchain* chain) {
         return;
     }
 
-    Block* current = chain->genesis;
-    while (current) {
-        Block* next = current->next;
-        free_block(current);
-        current = next;
+    free_blocks(chain->blocks, chain->block_count);
+    free(chain->blocks);
+    free(chain->headers);
+    patient_index_free(&chain->patient_index);
+    record_type_index_free(&chain->record_type_index);
+    chain_stats_free(&chain->stats);
+    ingest_queue_free(chain->ingest);
+    mempool_free(&chain->mempool);
+    free_record_cache(chain->record_cache);
+    free_overlay(chain->overlay);
+    free(chain);
+
+    // Hand the slabs the chain emptied back to the system
+    pool_trim();
+}
+
+// Add one transaction of a block to the secondary indexes
+static int index_transaction(PatientIndex* patients, RecordTypeIndex* record_types, const Block* block, int slot) {
+    const Transaction* transaction = &block->transactions[slot];
+    return patient_index_add(patients, transaction->patient_id, block->id, slot) &&
+           record_type_index_add(record_types, transaction->record_type, transaction->timestamp, block->id, slot);
+}
+
+static int index_block(PatientIndex* patients, RecordTypeIndex* record_types, const Block* block) {
+    for (int i = 0; i < block->transaction_count; i++) {
+        if (!index_transaction(patients, record_types, block, i)) {
+            return 0;
+        }
     }
+    return 1;
+}
 
-    free(chain);
+// Take a block's transactions, all or some of which were indexed last,
+// back out of the secondary indexes
+static void unindex_block(PatientIndex* patients, RecordTypeIndex* record_types, const Block* block) {
+    for (int i = block->transaction_count - 1; i >= 0; i--) {
+        const Transaction* transaction = &block->transactions[i];
+        patient_index_remove_latest(patients, transaction->patient_id, block->id, i);
+        record_type_index_remove(record_types, transaction->record_type, transaction->timestamp, block->id, i);
+    }
+}
+
+// Header of the block at `height`, whose predecessors' headers are current
+static void sync_header(Blockchain* chain, uint32_t height) {
+    uint64_t payload_offset = 0;
+    if (height > 0) {
+        const BlockHeader* previous = &chain->headers[height - 1];
+        payload_offset = previous->payload_offset + previous->transaction_count;
+    }
+    fill_block_header(chain->blocks[height], payload_offset, &chain->headers[height]);
+}
+
+// Grow the block index so it can hold at least `needed` blocks
+static int reserve_blocks(Blockchain* chain, uint32_t needed) {
+    if (needed <= chain->block_capacity) {
+        return 1;
+    }
+
+    uint32_t capacity = chain->block_capacity ? chain->block_capacity : INITIAL_BLOCK_CAPACITY;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+
+    Block** blocks = (Block**)realloc(chain->blocks, sizeof(Block*) * capacity);
+    if (!blocks) {
+        return 0;
+    }
+    chain->blocks = blocks;
+
+    BlockHeader* headers = (BlockHeader*)realloc(chain->headers, sizeof(BlockHeader) * capacity);
+    if (!headers) {
+        return 0;  // The larger block array is kept; capacity still describes both
+    }
+    chain->headers = headers;
+    chain->block_capacity = capacity;
+    return 1;
 }
 
 int add_block(Blockchain* chain, Block* block) {
@@ -53,55 +167,373 @@ int add_block(Blockchain* chain, Block* block) {
         return 0;
     }
 
+    if (!reserve_blocks(chain, chain->block_count + 1)) {
+        return 0;
+    }
+
+    // Index and count first, so a block that cannot be is not added at all
+    if (!index_block(&chain->patient_index, &chain->record_type_index, block) ||
+        !chain_stats_add_block(&chain->stats, block)) {
+        unindex_block(&chain->patient_index, &chain->record_type_index, block);
+        return 0;
+    }
+
     // Add block to chain
     chain->latest->next = block;
     chain->latest = block;
-    chain->block_count++;
+    chain->blocks[chain->block_count] = block;
+    sync_header(chain, chain->block_count++);
+
+    retarget_difficulty(chain);
+    return 1;
+}
+
+// Queue an encrypted transaction for the next mined block. Safe to call
+// from any thread; returns 0 if the ingest queue is full or the record is
+// too large for any block. Sealed blocks are never modified; the
+// transaction is indexed once its block is added.
+int submit_transaction(Blockchain* chain, const Transaction* transaction) {
+    if (!chain || !transaction || transaction_size(transaction) > max_transaction_size()) {
+        return 0;
+    }
+    return ingest_submit(chain->ingest, transaction);
+}
+
+// Move submitted transactions into the mempool; call from the thread that owns the chain
+size_t drain_ingest_queue(Blockchain* chain) {
+    if (!chain) {
+        return 0;
+    }
+    return ingest_drain(chain->ingest, &chain->mempool);
+}
+
+// Next block, filled from the mempool and ready to mine
+Block* build_block_template(Blockchain* chain) {
+    drain_ingest_queue(chain);
+    Block* block = create_next_block(chain);
+    if (block && mempool_fill_block(&chain->mempool, block) < 0) {
+        free_block(block);
+        return NULL;
+    }
+    return block;
+}
+
+// Drop a template that will not be added, returning its transactions to the mempool
+void discard_block_template(Blockchain* chain, Block* block) {
+    if (chain && block) {
+        mempool_return_block(&chain->mempool, block);
+    }
+    free_block(block);
+}
+
+// Replace every block of the chain with an already linked list (used when
+// loading or restoring). On failure the chain is unchanged and the caller
+// still owns the list.
+int replace_blocks(Blockchain* chain, Block* genesis) {
+    if (!chain || !genesis) {
+        return 0;
+    }
+
+    uint32_t count = 0;
+    for (Block* current = genesis; current; current = current->next) {
+        count++;
+    }
+
+    uint32_t capacity = INITIAL_BLOCK_CAPACITY;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    Block** blocks = (Block**)malloc(sizeof(Block*) * capacity);
+    BlockHeader* headers = (BlockHeader*)malloc(sizeof(BlockHeader) * capacity);
+    if (!blocks || !headers) {
+        free(blocks);
+        free(headers);
+        return 0;
+    }
+
+    PatientIndex patient_index;
+    RecordTypeIndex record_type_index;
+    ChainStats stats;
+    if (!patient_index_init(&patient_index)) {
+        free(blocks);
+        free(headers);
+        return 0;
+    }
+    record_type_index_init(&record_type_index);
+    chain_stats_init(&stats);
+
+    uint32_t index = 0;
+    uint64_t payload_offset = 0;
+    Block* latest = genesis;
+    for (Block* current = genesis; current; current = current->next) {
+        fill_block_header(current, payload_offset, &headers[index]);
+        payload_offset += (uint64_t)current->transaction_count;
+        blocks[index++] = current;
+        latest = current;
+        if (!index_block(&patient_index, &record_type_index, current) ||
+            !chain_stats_add_block(&stats, current)) {
+            patient_index_free(&patient_index);
+            record_type_index_free(&record_type_index);
+            chain_stats_free(&stats);
+            free(blocks);
+            free(headers);
+            return 0;
+        }
+    }
+
+    // Clear existing blocks
+    free_blocks(chain->blocks, chain->block_count);
+    free(chain->blocks);
+    free(chain->headers);
+    patient_index_free(&chain->patient_index);
+    record_type_index_free(&chain->record_type_index);
+    chain_stats_free(&chain->stats);
+
+    // Cached plaintexts are keyed by position, which now means other records
+    record_cache_clear(chain->record_cache);
+    overlay_clear(chain->overlay);
+
+    chain->genesis = genesis;
+    chain->latest = latest;
+    chain->blocks = blocks;
+    chain->headers = headers;
+    chain->block_capacity = capacity;
+    chain->block_count = count;
+    chain->patient_index = patient_index;
+    chain->record_type_index = record_type_index;
+    chain->stats = stats;
+    return 1;
+}
+
+// Empty block to follow the latest one, sized by the chain's limits
+Block* create_next_block(const Blockchain* chain) {
+    if (!chain) {
+        return NULL;
+    }
+
+    Block* block = create_block(chain->block_count, chain->latest->hash);
+    if (block) {
+        block->max_transactions = chain->max_block_transactions;
+        block->max_bytes = chain->max_block_bytes;
+    }
+    return block;
+}
+
+int set_block_limits(Blockchain* chain, uint32_t max_transactions, uint32_t max_bytes) {
+    if (!chain || max_transactions == 0 || max_transactions > MAX_BLOCK_TRANSACTIONS_LIMIT ||
+        max_bytes < MIN_BLOCK_BYTES || max_bytes < max_transaction_size()) {
+        return 0;
+    }
 
+    chain->max_block_transactions = max_transactions;
+    chain->max_block_bytes = max_bytes;
     return 1;
 }
 
+// Every retarget_interval blocks, move the difficulty toward the target
+// block time by the nearest power of two of observed/expected time.
+// Returns the change in bits.
+int retarget_difficulty(Blockchain* chain) {
+    if (!chain || chain->retarget_interval == 0 || chain->block_count <= chain->retarget_interval ||
+        (chain->block_count - 1) % chain->retarget_interval != 0) {
+        return 0;
+    }
+
+    const BlockHeader* first = get_block_header(chain, chain->block_count - 1 - chain->retarget_interval);
+    const BlockHeader* last = get_block_header(chain, chain->block_count - 1);
+    if (!first || !last) {
+        return 0;
+    }
+
+    double actual = difftime((time_t)last->timestamp, (time_t)first->timestamp);
+    double expected = (double)chain->retarget_interval * chain->target_block_time;
+    if (actual < 1) {
+        actual = 1;
+    }
+
+    // Round log2(expected / actual) to the nearest integer, bounded per step
+    double ratio = expected / actual;
+    int step = 0;
+    while (step < MAX_RETARGET_STEP && ratio >= 1.41421356) {
+        ratio /= 2;
+        step++;
+    }
+    while (step > -MAX_RETARGET_STEP && ratio <= 0.70710678) {
+        ratio *= 2;
+        step--;
+    }
+
+    int difficulty = chain->difficulty + step;
+    if (difficulty < MIN_DIFFICULTY) {
+        difficulty = MIN_DIFFICULTY;
+    } else if (difficulty > MAX_DIFFICULTY) {
+        difficulty = MAX_DIFFICULTY;
+    }
+
+    step = difficulty - chain->difficulty;
+    chain->difficulty = difficulty;
+    return step;
+}
+
 int mine_block(Blockchain* chain, Block* block) {
     if (!chain || !block) {
         return 0;
     }
 
-    // Set previous hash
-    strncpy(block->previous_hash, chain->latest->hash, HASH_SIZE);
-    block->previous_hash[HASH_SIZE] = '\0';
+    // Set previous hash (a block re-mined in place keeps its own link)
+    if (block != chain->latest) {
+        strncpy(block->previous_hash, chain->latest->hash, HASH_SIZE);
+        block->previous_hash[HASH_SIZE] = '\0';
+    }
 
-    // Mine block
-    do {
-        block->nonce++;
-        calculate_block_hash(block);
-    } while (!is_valid_hash(block->hash, chain->difficulty));
+    // Mine block across all worker threads
+    int mined = mine_block_parallel(block, chain->difficulty, chain->mining_threads, NULL);
 
-    return 1;
+    // A block re-mined in place has a new hash and nonce for its header
+    if (block == chain->latest) {
+        sync_header(chain, chain->block_count - 1);
+    }
+    return mined;
+}
+
+// Per-thread slice of the chain for hash recomputation
+typedef struct {
+    Block** blocks;
+    const BlockHeader* headers;
+    uint32_t start;
+    uint32_t end;             // One past the last block of the slice
+    atomic_int* invalid;      // Shared: set once any block fails
+} VerifyWorker;
+
+static void* verify_worker(void* arg) {
+    VerifyWorker* worker = (VerifyWorker*)arg;
+    for (uint32_t i = worker->start; i < worker->end; i++) {
+        if (atomic_load_explicit(worker->invalid, memory_order_relaxed)) {
+            return NULL;
+        }
+        // The block must hash correctly and its cached header must still
+        // describe it, since linkage is checked on headers alone
+        if (!verify_block(worker->blocks[i]) || !block_header_matches(&worker->headers[i], worker->blocks[i])) {
+            atomic_store(worker->invalid, 1);
+            return NULL;
+        }
+    }
+    return NULL;
 }
 
 int verify_chain(const Blockchain* chain) {
+    return verify_chain_parallel(chain, 0, 0, NULL);
+}
+
+// Verify only blocks above the verified watermark. A watermark whose
+// block is missing or has changed since it was recorded is ignored.
+int verify_chain_incremental(const Blockchain* chain, int thread_count, VerifyStats* stats) {
+    if (!chain) {
+        return 0;
+    }
+
+    uint32_t from = 0;
+    if (chain->verified_hash[0] != '\0') {
+        const Block* verified = get_block_by_id(chain, chain->verified_height);
+        if (verified && strcmp(verified->hash, chain->verified_hash) == 0) {
+            from = chain->verified_height + 1;
+        }
+    }
+    return verify_chain_parallel(chain, from, thread_count, stats);
+}
+
+// Record the latest block as verified; call only after a successful pass
+void update_verified_watermark(Blockchain* chain) {
+    if (!chain || !chain->latest) {
+        return;
+    }
+    chain->verified_height = chain->latest->id;
+    memcpy(chain->verified_hash, chain->latest->hash, HASH_SIZE + 1);
+}
+
+// Recompute the hashes of blocks from height `from` onwards across
+// thread_count workers (0 = online CPUs), then check their previous-hash
+// links, which is cheap, on the calling thread
+int verify_chain_parallel(const Blockchain* chain, uint32_t from, int thread_count, VerifyStats* stats) {
     if (!chain || !chain->genesis) {
         return 0;
     }
 
-    Block* current = chain->genesis;
-    while (current) {
-        // Verify block hash
-        if (!verify_block(current)) {
-            return 0;
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    Block** blocks = chain->blocks;
+    uint32_t count = chain->block_count;
+    if (from > count) {
+        from = count;
+    }
+    uint32_t pending = count - from;
+
+    if (thread_count <= 0) {
+        thread_count = get_online_cpus();
+    }
+    uint32_t max_threads = pending / MIN_VERIFY_BLOCKS_PER_THREAD;
+    if ((uint32_t)thread_count > max_threads) {
+        thread_count = max_threads > 0 ? (int)max_threads : 1;
+    }
+
+    atomic_int invalid;
+    atomic_init(&invalid, 0);
+    VerifyWorker* workers = (VerifyWorker*)malloc(sizeof(VerifyWorker) * thread_count);
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * thread_count);
+    if (!workers || !threads) {
+        free(workers);
+        free(threads);
+        return 0;
+    }
+
+    uint32_t slice = pending / thread_count;
+    for (int i = 0; i < thread_count; i++) {
+        workers[i].blocks = blocks;
+        workers[i].headers = chain->headers;
+        workers[i].start = from + slice * i;
+        workers[i].end = (i == thread_count - 1) ? count : from + slice * (i + 1);
+        workers[i].invalid = &invalid;
+    }
+
+    // Worker 0 runs on the calling thread; slices whose thread fails to start run here too
+    int started_threads = 1;
+    for (int i = 1; i < thread_count; i++) {
+        if (pthread_create(&threads[i], NULL, verify_worker, &workers[i]) != 0) {
+            break;
         }
+        started_threads++;
+    }
+    verify_worker(&workers[0]);
+    for (int i = started_threads; i < thread_count; i++) {
+        verify_worker(&workers[i]);
+    }
+    for (int i = 1; i < started_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
 
-        // Verify previous hash (except for genesis block)
-        if (current != chain->genesis) {
-            if (strcmp(current->previous_hash, current->next->hash) != 0) {
-                return 0;
-            }
+    int valid = !atomic_load(&invalid);
+
+    // Verify previous hashes (except for genesis block)
+    const BlockHeader* headers = chain->headers;
+    for (uint32_t i = from > 0 ? from : 1; valid && i < count; i++) {
+        if (memcmp(headers[i].previous_hash, headers[i - 1].hash, HASH_BYTES) != 0) {
+            valid = 0;
         }
+    }
 
-        current = current->next;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    if (stats) {
+        stats->start_height = from;
+        stats->blocks_checked = pending;
+        stats->threads = thread_count;
+        stats->seconds = (double)(finished.tv_sec - started.tv_sec) +
+                         (double)(finished.tv_nsec - started.tv_nsec) / 1e9;
     }
 
-    return 1;
+    free(workers);
+    free(threads);
+    return valid;
 }
 
 void print_blockchain(const Blockchain* chain) {
@@ -111,21 +543,28 @@ void print_blockchain(const Blockchain* chain) {
 
     printf("\nBlockchain Status:\n");
     printf("Total Blocks: %u\n", chain->block_count);
-    printf("Current Difficulty: %d\n", chain->difficulty);
-    printf("Chain Valid: %s\n\n", verify_chain(chain) ? "Yes" : "No");
+    printf("Current Difficulty: %d bits\n", chain->difficulty);
+    printf("Retarget: every %u blocks toward %u s/block\n",
+           chain->retarget_interval, chain->target_block_time);
+    printf("Total Transactions: %llu\n", (unsigned long long)chain->stats.transactions);
+    printf("Pending Transactions: %zu\n", mempool_count(&chain->mempool));
+    printf("Chain Valid: %s\n\n", verify_chain_incremental(chain, 0, NULL) ? "Yes" : "No");
 
     printf("\nBlocks:\n");
 
-    Block* current = chain->genesis;
-    while (current) {
-        // For now, we'll print blocks without decryption
+    // Only headers are listed, so no transaction is touched
+    char previous_hash[HASH_SIZE + 1];
+    char hash[HASH_SIZE + 1];
+    for (uint32_t i = 0; i < chain->block_count; i++) {
+        const BlockHeader* current = &chain->headers[i];
+        str_to_hex(current->previous_hash, previous_hash, HASH_BYTES);
+        str_to_hex(current->hash, hash, HASH_BYTES);
         printf("\nBlock #%u\n", current->id);
-        printf("Timestamp: %s", get_timestamp_str(current->timestamp));
-        printf("Previous Hash: %s\n", current->previous_hash);
-        printf("Hash: %s\n", current->hash);
+        printf("Timestamp: %s", get_timestamp_str((time_t)current->timestamp));
+        printf("Previous Hash: %s\n", previous_hash);
+        printf("Hash: %s\n", hash);
         printf("Nonce: %u\n", current->nonce);
-        printf("Transactions: %d\n", current->transaction_count);
-        current = current->next;
+        printf("Transactions: %u\n", current->transaction_count);
     }
 }
 
@@ -134,28 +573,80 @@ Block* get_block_by_id(const Blockchain* chain, uint32_t id) {
         return NULL;
     }
 
-    Block* current = chain->genesis;
-    while (current) {
-        if (current->id == id) {
-            return current;
-        }
-        current = current->next;
+    // Block ids are heights, so the index answers directly
+    if (id >= chain->block_count || chain->headers[id].id != id) {
+        return NULL;
     }
+    return chain->blocks[id];
+}
 
-    return NULL;
+const BlockHeader* get_block_header(const Blockchain* chain, uint32_t id) {
+    if (!chain || id >= chain->block_count || chain->headers[id].id != id) {
+        return NULL;
+    }
+    return &chain->headers[id];
 }
 
-int get_transaction_count(const Blockchain* chain) {
+const ChainStats* get_chain_stats(const Blockchain* chain) {
+    return chain ? &chain->stats : NULL;
+}
+
+// Start caching decrypted records, replacing (and wiping) any current cache
+int enable_record_cache(Blockchain* chain, size_t max_bytes, uint32_t ttl) {
+    if (!chain) {
+        return 0;
+    }
+
+    RecordCache* cache = create_record_cache(max_bytes, ttl);
+    if (!cache) {
+        return 0;
+    }
+    free_record_cache(chain->record_cache);
+    chain->record_cache = cache;
+    return 1;
+}
+
+// Stop caching and wipe every cached plaintext
+void disable_record_cache(Blockchain* chain) {
     if (!chain) {
+        return;
+    }
+    free_record_cache(chain->record_cache);
+    chain->record_cache = NULL;
+}
+
+// Every header records how many transactions precede its block
+int get_transaction_count(const Blockchain* chain) {
+    if (!chain || chain->block_count == 0) {
         return 0;
     }
 
-    int count = 0;
-    Block* current = chain->genesis;
-    while (current) {
-        count += current->transaction_count;
-        current = current->next;
+    const BlockHeader* latest = &chain->headers[chain->block_count - 1];
+    return (int)(latest->payload_offset + latest->transaction_count);
+}
+
+// Whether any mined or pending record is encrypted under a master key,
+// in which case losing the master key file loses those records
+int chain_has_patient_records(const Blockchain* chain) {
+    if (!chain) {
+        return 0;
     }
 
-    return count;
+    for (const Block* block = chain->genesis; block; block = block->next) {
+        for (int i = 0; i < block->transaction_count; i++) {
+            const EncryptedData* encrypted = block->transactions[i].encrypted_data;
+            if (encrypted && encrypted->key_scheme == KEY_SCHEME_PATIENT) {
+                return 1;
+            }
+        }
+    }
+    for (int p = 0; p < MEMPOOL_PRIORITIES; p++) {
+        const Transaction* pending;
+        for (size_t i = 0; (pending = mempool_at(&chain->mempool, p, i)); i++) {
+            if (pending->encrypted_data && pending->encrypted_data->key_scheme == KEY_SCHEME_PATIENT) {
+                return 1;
+            }
+        }
+    }
+    return 0;
 } 
\ No newline at end of file
@@ -2,24 +2,80 @@
 #define BLOCKCHAIN_H
 
 #include "block.h"
+#include "index.h"
+#include "mempool.h"
+#include "ingest.h"
+#include "stats.h"
+#include "record_cache.h"
+#include "overlay.h"
 
-#define DIFFICULTY 4  // Number of leading zeros required in hash
+#define DIFFICULTY 16  // Number of leading zero bits required in hash (4 hex digits)
+#define MIN_DIFFICULTY 1
+#define MAX_DIFFICULTY 64
+#define RETARGET_INTERVAL 10     // Blocks between difficulty adjustments
+#define TARGET_BLOCK_TIME 60     // Desired seconds between blocks
+#define MAX_RETARGET_STEP 2      // Largest adjustment per retarget, in bits
+#define MIN_VERIFY_BLOCKS_PER_THREAD 64  // Smaller chains are verified on fewer threads
+#define INITIAL_BLOCK_CAPACITY 16        // Initial size of the block index
+#define MAX_BLOCK_TRANSACTIONS_LIMIT (1u << 20)  // Largest configurable transaction count
+#define MIN_BLOCK_BYTES 1024             // Smallest configurable byte limit; holds the largest record
 
 typedef struct {
     Block* genesis;           // Pointer to the first block
     Block* latest;           // Pointer to the most recent block
+    Block** blocks;          // Block index: blocks[i] is the block at height i
+    BlockHeader* headers;    // headers[i] is the header of blocks[i], stored contiguously
+    uint32_t block_capacity; // Allocated slots in the block and header arrays
     uint32_t block_count;    // Total number of blocks
-    int difficulty;          // Current mining difficulty
+    int difficulty;          // Current mining difficulty in leading zero bits
+    int mining_threads;      // Worker threads used for mining (0 = online CPUs)
+    uint32_t retarget_interval;  // Blocks between difficulty adjustments
+    uint32_t target_block_time;  // Desired seconds between blocks
+    uint32_t verified_height;    // Highest block already verified
+    char verified_hash[HASH_SIZE + 1];  // Its hash when verified ("" = nothing verified)
+    uint32_t max_block_transactions;    // Count limit for new blocks
+    uint32_t max_block_bytes;           // Serialized transaction bytes limit for new blocks
+    PatientIndex patient_index;  // Patient id -> transaction locations
+    RecordTypeIndex record_type_index;  // (record type, timestamp) -> transaction locations
+    ChainStats stats;            // Totals over mined transactions
+    Mempool mempool;             // Transactions waiting to be mined
+    IngestQueue* ingest;         // Lock-free submissions in front of the mempool
+    RecordCache* record_cache;   // Decrypted records (NULL = caching off)
+    CiphertextOverlay* overlay;  // Re-encrypted records, written in place of the blocks' on save
 } Blockchain;
 
+// Result of a chain verification pass
+typedef struct {
+    uint32_t start_height;    // First block whose hash was recomputed
+    uint32_t blocks_checked;  // Blocks whose hashes were recomputed
+    int threads;              // Worker threads used
+    double seconds;           // Wall-clock time of the pass
+} VerifyStats;
+
 // Function declarations
 Blockchain* create_blockchain(void);
 void free_blockchain(Blockchain* chain);
 int add_block(Blockchain* chain, Block* block);
+int replace_blocks(Blockchain* chain, Block* genesis);
+Block* create_next_block(const Blockchain* chain);
+int set_block_limits(Blockchain* chain, uint32_t max_transactions, uint32_t max_bytes);
+int submit_transaction(Blockchain* chain, const Transaction* transaction);
+size_t drain_ingest_queue(Blockchain* chain);
+Block* build_block_template(Blockchain* chain);
+void discard_block_template(Blockchain* chain, Block* block);
 int mine_block(Blockchain* chain, Block* block);
+int retarget_difficulty(Blockchain* chain);
 int verify_chain(const Blockchain* chain);
+int verify_chain_parallel(const Blockchain* chain, uint32_t from, int thread_count, VerifyStats* stats);
+int verify_chain_incremental(const Blockchain* chain, int thread_count, VerifyStats* stats);
+void update_verified_watermark(Blockchain* chain);
 void print_blockchain(const Blockchain* chain);
 Block* get_block_by_id(const Blockchain* chain, uint32_t id);
+const BlockHeader* get_block_header(const Blockchain* chain, uint32_t id);
 int get_transaction_count(const Blockchain* chain);
+int chain_has_patient_records(const Blockchain* chain);
+const ChainStats* get_chain_stats(const Blockchain* chain);
+int enable_record_cache(Blockchain* chain, size_t max_bytes, uint32_t ttl);
+void disable_record_cache(Blockchain* chain);
 
 #endif // BLOCKCHAIN_H 
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include "bloom.h"
+
+// Two independent 64-bit hashes of (kind, key); probe i uses h1 + i * h2
+static void hash_key(char kind, const char* key, uint64_t* h1, uint64_t* h2) {
+    uint64_t hash = 14695981039346656037ULL;
+    hash ^= (unsigned char)kind;
+    hash *= 1099511628211ULL;
+    for (const unsigned char* p = (const unsigned char*)key; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    *h1 = hash;
+
+    // splitmix64 finalizer; forced odd so the probes cover every bit
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    *h2 = hash | 1;
+}
+
+void bloom_add(unsigned char* bits, size_t size, char kind, const char* key) {
+    if (!bits || size == 0 || !key) {
+        return;
+    }
+
+    uint64_t h1, h2;
+    hash_key(kind, key, &h1, &h2);
+    uint64_t bit_count = (uint64_t)size * 8;
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        uint64_t bit = (h1 + (uint64_t)i * h2) % bit_count;
+        bits[bit / 8] |= (unsigned char)(1u << (bit % 8));
+    }
+}
+
+// 0 means the key was definitely never added; 1 means it may have been
+int bloom_may_contain(const unsigned char* bits, size_t size, char kind, const char* key) {
+    if (!bits || size == 0 || !key) {
+        return 1;
+    }
+
+    uint64_t h1, h2;
+    hash_key(kind, key, &h1, &h2);
+    uint64_t bit_count = (uint64_t)size * 8;
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        uint64_t bit = (h1 + (uint64_t)i * h2) % bit_count;
+        if (!(bits[bit / 8] & (1u << (bit % 8)))) {
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,16 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stddef.h>
+
+#define BLOOM_HASHES 4           // Bits set per key
+
+// Key namespaces, so a patient id never matches a record type of the same text
+#define BLOOM_KEY_PATIENT 'p'
+#define BLOOM_KEY_RECORD_TYPE 't'
+
+// Function declarations
+void bloom_add(unsigned char* bits, size_t size, char kind, const char* key);
+int bloom_may_contain(const unsigned char* bits, size_t size, char kind, const char* key);
+
+#endif // BLOOM_H
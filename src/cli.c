@@ -2,19 +2,67 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
 #include "cli.h"
 #include "security.h"
 #include "persistence.h"
+#include "mining.h"
+#include "merkle.h"
+#include "utils.h"
+#include "keys.h"
+#include "rekey.h"
 
-// Static key for demonstration (in a real system, load securely)
-static unsigned char CLI_KEY[AES_KEY_SIZE] = {0};
+// Key of records saved before per-patient keys, which all shared one
+// built-in demonstration key
+static const unsigned char SHARED_KEY[AES_KEY_SIZE] = {0};
+
+// Master key and derived patient keys, opened on first use
+static KeyStore* key_store = NULL;
+
+// Block being mined in the background, if any
+static MiningJob* background_job = NULL;
+
+// Re-encryption of mined records under the newest master key, if running
+static RekeyJob* rekey_job = NULL;
+
+// The CLI's key store, opening MASTER_KEY_FILE on first use. A missing
+// file is only created while no record depends on it; otherwise a new key
+// would silently leave those records unreadable.
+static KeyStore* get_key_store(const Blockchain* chain) {
+    if (!key_store) {
+        int create = !chain_has_patient_records(chain);
+        key_store = open_key_store(MASTER_KEY_FILE, SHARED_KEY, create);
+        if (!key_store && !create && access(MASTER_KEY_FILE, F_OK) != 0) {
+            print_error("Master key file " MASTER_KEY_FILE " is missing; restore it to read or add records");
+        } else if (!key_store) {
+            print_error("Failed to load the master key from " MASTER_KEY_FILE);
+        }
+    }
+    return key_store;
+}
+
+// Wipe the master key and derived keys; call on exit
+void close_key_store(void) {
+    free_key_store(key_store);
+    key_store = NULL;
+}
 
 // Command definitions
 Command commands[] = {
     {"add", "Add a new medical record", cmd_add},
-    {"mine", "Mine a new block", cmd_mine},
+    {"mine", "Mine a new block (--async, status, cancel)", cmd_mine},
     {"view", "View the entire blockchain", cmd_view},
     {"verify", "Verify chain integrity", cmd_verify},
+    {"prove", "Prove a transaction is included in a block", cmd_prove},
+    {"history", "Show a patient's medical history", cmd_history},
+    {"query", "List records of a type in a time range", cmd_query},
+    {"limits", "Show or set block size limits", cmd_limits},
+    {"mempool", "Show pending transactions (urgent <type>)", cmd_mempool},
+    {"ingest", "Show ingest queue counters", cmd_ingest},
+    {"stats", "Show chain statistics", cmd_stats},
+    {"cache", "Show or configure the decrypted record cache", cmd_cache},
+    {"keys", "Show or rotate master keys (rotate, migrate, cancel)", cmd_keys},
     {"backup", "Create a backup of the blockchain", cmd_backup},
     {"restore", "Restore blockchain from latest backup", cmd_restore},
     {"help", "Show this help message", cmd_help},
@@ -93,53 +141,168 @@ int cmd_add(Blockchain* chain, int argc, char** argv) {
         return 1;
     }
 
+    // Only valid ids are interned, so bad input never grows the dictionary
+    if (!validate_patient_id(argv[0]) || !validate_record_type(argv[1])) {
+        print_error("Failed to add transaction");
+        return 1;
+    }
+    if (!validate_record_data(argv[2])) {
+        printf("Error: Record data must be 1-%d characters\n", MAX_RECORD_DATA_BYTES);
+        return 1;
+    }
+
     Transaction transaction;
     memset(&transaction, 0, sizeof(Transaction));
-    strncpy(transaction.patient_id, argv[0], sizeof(transaction.patient_id) - 1);
-    strncpy(transaction.record_type, argv[1], sizeof(transaction.record_type) - 1);
+    transaction.patient_id = intern_string(argv[0]);
+    transaction.record_type = intern_string(argv[1]);
     transaction.timestamp = time(NULL);
-    transaction.encrypted_data = encrypt_data(argv[2], CLI_KEY);
+    KeyStore* keys = get_key_store(chain);
+    if (!keys) {
+        return 1;
+    }
+    transaction.encrypted_data = encrypt_record(keys, argv[2], transaction.patient_id);
     if (!transaction.encrypted_data) {
         print_error("Failed to encrypt data");
         return 1;
     }
 
-    if (add_transaction(chain->latest, &transaction, CLI_KEY)) {
-        print_success("Transaction added successfully");
+    if (submit_transaction(chain, &transaction)) {
+        drain_ingest_queue(chain);
+        printf("Success: Transaction added to the mempool (%zu pending)\n", mempool_count(&chain->mempool));
     } else {
-        print_error("Failed to add transaction");
+        print_error(transaction.patient_id != STRING_ID_NONE && transaction.record_type != STRING_ID_NONE
+                        ? "Ingest queue is full; mine, then try again" : "Failed to add transaction");
         free_encrypted_data(transaction.encrypted_data);
     }
 
     return 1;
 }
 
+// Attach a freshly mined block, or discard it if mining failed or the chain
+// moved on; a discarded block's transactions go back to the mempool
+static void finish_mined_block(Blockchain* chain, Block* block, int mined) {
+    if (!mined) {
+        print_error("Failed to mine new block");
+        discard_block_template(chain, block);
+    } else if (add_block(chain, block)) {
+        printf("Success: Block #%u mined with %d transaction(s)\n", block->id, block->transaction_count);
+    } else {
+        print_error("Failed to add new block to chain (chain changed while mining)");
+        discard_block_template(chain, block);
+    }
+}
+
+static void print_mining_status(void) {
+    if (!background_job) {
+        printf("No background mining in progress\n");
+        return;
+    }
+
+    MiningProgress progress;
+    mining_job_progress(background_job, &progress);
+    printf("Mining block #%u: %llu attempts in %.1f s (%.0f H/s)",
+           background_job->block->id, progress.attempts, progress.elapsed, progress.hash_rate);
+    if (progress.eta >= 0) {
+        printf(", expected %.1f s per block", progress.eta);
+    }
+    printf("\n");
+}
+
+void poll_background_mining(Blockchain* chain) {
+    if (!mining_job_finished(background_job)) {
+        return;
+    }
+
+    int cancelled = atomic_load(&background_job->control.cancel);
+    int mined;
+    Block* block = mining_job_finish(background_job, &mined);
+    background_job = NULL;
+
+    if (cancelled) {
+        print_success("Background mining cancelled");
+        discard_block_template(chain, block);
+        return;
+    }
+    finish_mined_block(chain, block, mined);
+}
+
+void cancel_background_mining(Blockchain* chain) {
+    if (background_job) {
+        mining_job_cancel(background_job);
+        discard_block_template(chain, mining_job_finish(background_job, NULL));
+        background_job = NULL;
+    }
+}
+
 int cmd_mine(Blockchain* chain, int argc, char** argv) {
-    (void)argc;
-    (void)argv;
-    if (chain->latest->transaction_count == 0) {
+    int async = 0;
+
+    if (argc == 1 && strcmp(argv[0], "status") == 0) {
+        print_mining_status();
+        return 1;
+    }
+    if (argc == 1 && strcmp(argv[0], "cancel") == 0) {
+        if (!background_job) {
+            print_error("No background mining in progress");
+        } else {
+            mining_job_cancel(background_job);
+            printf("Cancelling background mining...\n");
+        }
+        return 1;
+    }
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            if (!parse_thread_count(argv[++i], &chain->mining_threads)) {
+                printf("Error: --threads takes 0 (one per CPU) up to %d\n", get_online_cpus() * MAX_THREADS_PER_CPU);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--async") == 0) {
+            async = 1;
+        } else {
+            print_error("Usage: mine [--async] [--threads <count>] | mine status | mine cancel");
+            return 1;
+        }
+    }
+
+    if (background_job) {
+        print_error("Background mining already in progress (see 'mine status')");
+        return 1;
+    }
+
+    if (mempool_count(&chain->mempool) == 0) {
         print_error("No transactions to mine");
         return 1;
     }
 
-    Block* new_block = create_block(chain->block_count, chain->latest->hash);
+    size_t dropped = chain->mempool.dropped;
+    Block* new_block = build_block_template(chain);
     if (!new_block) {
         print_error("Failed to create new block");
         return 1;
     }
+    if (chain->mempool.dropped > dropped) {
+        printf("Error: Discarded %zu pending record(s) that no block can hold\n",
+               chain->mempool.dropped - dropped);
+    }
+    if (new_block->transaction_count == 0) {
+        print_error("No transactions to mine");
+        discard_block_template(chain, new_block);
+        return 1;
+    }
 
-    if (mine_block(chain, new_block)) {
-        if (add_block(chain, new_block)) {
-            print_success("New block mined successfully");
-        } else {
-            print_error("Failed to add new block to chain");
-            free_block(new_block);
+    if (async) {
+        background_job = mining_job_start(new_block, chain->difficulty, chain->mining_threads);
+        if (!background_job) {
+            print_error("Failed to start background mining");
+            discard_block_template(chain, new_block);
+            return 1;
         }
-    } else {
-        print_error("Failed to mine new block");
-        free_block(new_block);
+        print_success("Mining started in the background (see 'mine status')");
+        return 1;
     }
 
+    finish_mined_block(chain, new_block, mine_block(chain, new_block));
     return 1;
 }
 
@@ -151,13 +314,551 @@ int cmd_view(Blockchain* chain, int argc, char** argv) {
 }
 
 int cmd_verify(Blockchain* chain, int argc, char** argv) {
-    (void)argc;
-    (void)argv;
-    if (verify_chain(chain)) {
+    int threads = 0;
+    int full = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            if (!parse_thread_count(argv[++i], &threads)) {
+                printf("Error: --threads takes 0 (one per CPU) up to %d\n", get_online_cpus() * MAX_THREADS_PER_CPU);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--full") == 0) {
+            full = 1;
+        } else {
+            print_error("Usage: verify [--full] [--threads <count>]");
+            return 1;
+        }
+    }
+
+    VerifyStats stats = {0, 0, 0, 0};
+    int valid = full ? verify_chain_parallel(chain, 0, threads, &stats)
+                     : verify_chain_incremental(chain, threads, &stats);
+    if (valid) {
+        update_verified_watermark(chain);
         print_success("Blockchain is valid");
     } else {
         print_error("Blockchain is invalid");
     }
+
+    printf("Checked %u blocks from #%u on %d thread(s) in %.3f ms", stats.blocks_checked,
+           stats.start_height, stats.threads, stats.seconds * 1000);
+    if (stats.seconds > 0) {
+        printf(" (%.0f blocks/s)", stats.blocks_checked / stats.seconds);
+    }
+    printf("\n");
+    return 1;
+}
+
+int cmd_prove(Blockchain* chain, int argc, char** argv) {
+    uint32_t block_id, tx_number;
+    if (argc != 2 || !parse_uint32(argv[0], 0, UINT32_MAX, &block_id) ||
+        !parse_uint32(argv[1], 1, INT_MAX, &tx_number)) {
+        print_error("Usage: prove <block_id> <transaction_number>");
+        return 1;
+    }
+
+    const Block* block = get_block_by_id(chain, block_id);
+    if (!block) {
+        print_error("Block not found");
+        return 1;
+    }
+
+    if (tx_number > (uint32_t)block->transaction_count) {
+        print_error("Transaction not found in block");
+        return 1;
+    }
+    MerkleProof proof;
+    if (!build_merkle_proof(block, (int)tx_number - 1, &proof)) {
+        print_error("Failed to build the proof");
+        return 1;
+    }
+
+    char hex[HASH_SIZE + 1];
+    printf("\nInclusion proof for transaction #%u of block #%u\n", tx_number, block->id);
+    printf("  Patient ID: %s\n", string_for_id(block->transactions[proof.index].patient_id));
+    str_to_hex(proof.leaf, hex, HASH_BYTES);
+    printf("  Leaf: %s\n", hex);
+    for (int i = 0; i < proof.depth; i++) {
+        str_to_hex(proof.steps[i].sibling, hex, HASH_BYTES);
+        printf("  Step %d: %s (%s)\n", i + 1, hex, proof.steps[i].sibling_on_left ? "left" : "right");
+    }
+    str_to_hex(block->merkle_root, hex, HASH_BYTES);
+    printf("  Merkle root: %s\n", hex);
+
+    if (verify_merkle_proof(&proof, block->merkle_root)) {
+        print_success("Proof verifies against the block's Merkle root");
+    } else {
+        print_error("Proof does not verify against the block's Merkle root");
+    }
+    return 1;
+}
+
+static void print_history_record(uint32_t block_id, int slot, const Transaction* transaction, const char* data) {
+    printf("\nBlock #%u, transaction #%d\n", block_id, slot + 1);
+    printf("  Type: %s\n", string_for_id(transaction->record_type));
+    printf("  Data: %s\n", data ? data : "[Encrypted]");
+    printf("  Timestamp: %s", get_timestamp_str(transaction->timestamp));
+}
+
+// A record to show, decrypted together with the rest of its listing
+typedef struct {
+    TxRef ref;
+    Transaction transaction;
+    EncryptedData* replaced;  // Re-encrypted ciphertext used instead of the block's, owned
+} HistoryRecord;
+
+// Look up each record's data key. Consecutive records with the same
+// patient, key scheme and master key share one key, which for a patient
+// history means a lookup per key. A record whose key is unavailable gets
+// NULL.
+static void find_record_keys(KeyStore* store, const HistoryRecord* records, size_t count,
+                             unsigned char (*material)[AES_KEY_SIZE], const unsigned char** keys) {
+    for (size_t i = 0; i < count; i++) {
+        const Transaction* transaction = &records[i].transaction;
+        const Transaction* previous = i > 0 ? &records[i - 1].transaction : NULL;
+        keys[i] = NULL;
+        if (!transaction->encrypted_data) {
+            continue;
+        }
+        uint8_t scheme = transaction->encrypted_data->key_scheme;
+        uint32_t key_id = transaction->encrypted_data->key_id;
+        if (previous && previous->encrypted_data && previous->encrypted_data->key_scheme == scheme &&
+            previous->encrypted_data->key_id == key_id && previous->patient_id == transaction->patient_id) {
+            keys[i] = keys[i - 1];
+        } else if (record_key(store, scheme, key_id, transaction->patient_id, material[i])) {
+            keys[i] = material[i];
+        }
+    }
+}
+
+// Decrypt all records at once across worker threads, through the record
+// cache if one is given, then print them in order
+static void print_history_records(const Blockchain* chain, RecordCache* cache, const HistoryRecord* records,
+                                  size_t count) {
+    size_t slots = count ? count : 1;
+    KeyStore* store = get_key_store(chain);
+    TxRef* refs = (TxRef*)malloc(sizeof(TxRef) * slots);
+    const EncryptedData** encrypted = (const EncryptedData**)malloc(sizeof(EncryptedData*) * slots);
+    unsigned char (*material)[AES_KEY_SIZE] = malloc(AES_KEY_SIZE * slots);
+    const unsigned char** keys = (const unsigned char**)malloc(sizeof(unsigned char*) * slots);
+    char** texts = (char**)malloc(sizeof(char*) * slots);
+    char* plaintexts = NULL;
+    if (store && refs && encrypted && material && keys && texts) {
+        for (size_t i = 0; i < count; i++) {
+            refs[i] = records[i].ref;
+            encrypted[i] = records[i].transaction.encrypted_data;
+        }
+        find_record_keys(store, records, count, material, keys);
+        plaintexts = record_cache_decrypt(cache, refs, encrypted, keys, count, texts);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        print_history_record(records[i].ref.block_id, records[i].ref.slot, &records[i].transaction,
+                             plaintexts ? texts[i] : NULL);
+    }
+    if (material) {
+        OPENSSL_cleanse(material, AES_KEY_SIZE * slots);
+    }
+    free_decrypted(plaintexts, encrypted, count);
+    free(texts);
+    free(keys);
+    free(material);
+    free(encrypted);
+    free(refs);
+}
+
+// Matches of a saved-chain scan, with their ciphertexts copied since the
+// scan frees each transaction after the visit
+typedef struct {
+    HistoryRecord* records;
+    size_t count;
+    size_t capacity;
+} SavedHistory;
+
+static int collect_saved_record(uint32_t block_id, int slot, const Transaction* transaction, void* context) {
+    SavedHistory* history = (SavedHistory*)context;
+    if (history->count == history->capacity) {
+        size_t capacity = history->capacity ? history->capacity * 2 : 64;
+        HistoryRecord* records = (HistoryRecord*)realloc(history->records, sizeof(HistoryRecord) * capacity);
+        if (!records) {
+            return 0;
+        }
+        history->records = records;
+        history->capacity = capacity;
+    }
+
+    HistoryRecord* record = &history->records[history->count++];
+    record->ref.block_id = block_id;
+    record->ref.slot = slot;
+    record->transaction = *transaction;
+    record->transaction.encrypted_data = copy_encrypted_data(transaction->encrypted_data);
+    record->replaced = NULL;
+    return 1;
+}
+
+// History from the saved chain file, for when the in-memory index is not
+// wanted. The file is written on exit, so it reflects the last save.
+static void print_saved_history(const Blockchain* chain, const char* patient_id) {
+    printf("\nSaved medical history for patient %s (as of the last save, %s)\n", patient_id, BLOCKCHAIN_FILE);
+    SavedHistory history = {NULL, 0, 0};
+    ScanStats stats;
+    if (!scan_saved_blockchain(patient_id, NULL, collect_saved_record, &history, &stats)) {
+        print_error("Failed to scan the saved blockchain");
+    } else {
+        // Saved blocks may differ from the loaded ones, so the cache is not used
+        print_history_records(chain, NULL, history.records, history.count);
+        printf("\n%u record(s); read %u block(s), skipped %u by Bloom filter\n",
+               stats.matches, stats.blocks_read, stats.blocks_skipped);
+        uint32_t saved_blocks = stats.blocks_read + stats.blocks_skipped;
+        if (saved_blocks != chain->block_count) {
+            printf("Note: the saved chain has %u block(s) and the loaded one %u; blocks mined since the last "
+                   "save are not included (they are saved on exit)\n", saved_blocks, chain->block_count);
+        }
+    }
+
+    for (size_t i = 0; i < history.count; i++) {
+        free_encrypted_data(history.records[i].transaction.encrypted_data);
+    }
+    free(history.records);
+}
+
+int cmd_history(Blockchain* chain, int argc, char** argv) {
+    if (argc < 1 || (argc > 1 && strcmp(argv[1], "--saved") != 0)) {
+        print_error("Usage: history <patient_id> [--saved]");
+        return 1;
+    }
+    if (argc > 1) {
+        print_saved_history(chain, argv[0]);
+        return 1;
+    }
+
+    const PatientEntry* entry = patient_index_lookup(&chain->patient_index, find_string(argv[0]));
+    if (!entry || entry->ref_count == 0) {
+        printf("No records found for patient %s\n", argv[0]);
+        return 1;
+    }
+
+    HistoryRecord* records = (HistoryRecord*)malloc(sizeof(HistoryRecord) * entry->ref_count);
+    if (!records) {
+        print_error("Failed to read patient history");
+        return 1;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < entry->ref_count; i++) {
+        const Block* block = get_block_by_id(chain, entry->refs[i].block_id);
+        if (!block || entry->refs[i].slot >= block->transaction_count) {
+            continue;
+        }
+        records[count].ref = entry->refs[i];
+        records[count].transaction = block->transactions[entry->refs[i].slot];
+        records[count].replaced = overlay_copy(chain->overlay, entry->refs[i]);
+        if (records[count].replaced) {
+            records[count].transaction.encrypted_data = records[count].replaced;
+        }
+        count++;
+    }
+
+    printf("\nMedical history for patient %s (%zu records)\n", string_for_id(entry->patient_id), entry->ref_count);
+    print_history_records(chain, chain->record_cache, records, count);
+    printf("\n");
+    for (size_t i = 0; i < count; i++) {
+        free_encrypted_data(records[i].replaced);
+    }
+    free(records);
+    return 1;
+}
+
+// Print one match of a range query as it is found
+static int print_query_match(const TxRef* ref, time_t timestamp, void* context) {
+    const Blockchain* chain = (const Blockchain*)context;
+    const Block* block = get_block_by_id(chain, ref->block_id);
+    if (block && ref->slot < block->transaction_count) {
+        printf("  Block #%u, transaction #%d  %-12s  %s", block->id, ref->slot + 1,
+               string_for_id(block->transactions[ref->slot].patient_id), get_timestamp_str(timestamp));
+    }
+    return 1;
+}
+
+int cmd_query(Blockchain* chain, int argc, char** argv) {
+    const char* record_type = NULL;
+    time_t from = 0;
+    time_t to = (time_t)INT64_MAX;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--type") == 0 && i + 1 < argc) {
+            record_type = argv[++i];
+        } else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            if (!parse_timestamp(argv[++i], 0, &from)) {
+                print_error("Invalid --from time (use YYYY-MM-DD, YYYY-MM-DDTHH:MM:SS or Unix seconds)");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            if (!parse_timestamp(argv[++i], 1, &to)) {
+                print_error("Invalid --to time (use YYYY-MM-DD, YYYY-MM-DDTHH:MM:SS or Unix seconds)");
+                return 1;
+            }
+        } else {
+            record_type = NULL;
+            break;
+        }
+    }
+
+    if (!record_type) {
+        print_error("Usage: query --type <record_type> [--from <time>] [--to <time>]");
+        return 1;
+    }
+
+    printf("\nRecords of type %s:\n", record_type);
+    size_t matches = record_type_index_query(&chain->record_type_index, find_string(record_type), from, to,
+                                             print_query_match, chain);
+    printf("%zu matching record(s)\n", matches);
+    return 1;
+}
+
+int cmd_limits(Blockchain* chain, int argc, char** argv) {
+    uint32_t max_transactions = chain->max_block_transactions;
+    uint32_t max_bytes = chain->max_block_bytes;
+    uint32_t min_bytes = max_transaction_size() > MIN_BLOCK_BYTES ? max_transaction_size() : MIN_BLOCK_BYTES;
+    int valid = 1;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--transactions") == 0 && i + 1 < argc) {
+            valid &= parse_uint32(argv[++i], 1, MAX_BLOCK_TRANSACTIONS_LIMIT, &max_transactions);
+        } else if (strcmp(argv[i], "--bytes") == 0 && i + 1 < argc) {
+            valid &= parse_uint32(argv[++i], min_bytes, UINT32_MAX, &max_bytes);
+        } else {
+            print_error("Usage: limits [--transactions <count>] [--bytes <size>]");
+            return 1;
+        }
+    }
+
+    if (argc > 0 && (!valid || !set_block_limits(chain, max_transactions, max_bytes))) {
+        printf("Error: Invalid limits (1-%u transactions, at least %u bytes)\n",
+               MAX_BLOCK_TRANSACTIONS_LIMIT, min_bytes);
+        return 1;
+    }
+
+    printf("Block limits: %u transactions, %u bytes\n", chain->max_block_transactions, chain->max_block_bytes);
+    return 1;
+}
+
+int cmd_mempool(Blockchain* chain, int argc, char** argv) {
+    Mempool* mempool = &chain->mempool;
+    drain_ingest_queue(chain);
+    if (argc == 2 && strcmp(argv[0], "urgent") == 0) {
+        if (mempool_add_urgent_type(mempool, argv[1])) {
+            printf("Success: '%s' records will be mined first\n", argv[1]);
+        } else {
+            print_error("Failed to add urgent record type");
+        }
+        return 1;
+    }
+    if (argc > 0) {
+        print_error("Usage: mempool | mempool urgent <record_type>");
+        return 1;
+    }
+
+    printf("\nPending transactions: %zu (%zu urgent)\n", mempool_count(mempool),
+           mempool->queues[MEMPOOL_URGENT].count);
+    printf("Urgent record types:");
+    for (int i = 0; i < mempool->urgent_type_count; i++) {
+        printf(" %s", string_for_id(mempool->urgent_types[i]));
+    }
+    printf("\n");
+
+    // Listed in the order they will be mined
+    int position = 1;
+    for (int p = 0; p < MEMPOOL_PRIORITIES; p++) {
+        const Transaction* transaction;
+        for (size_t i = 0; (transaction = mempool_at(mempool, p, i)) != NULL; i++) {
+            printf("  %d. %-12s %-14s %s", position++, string_for_id(transaction->patient_id),
+                   string_for_id(transaction->record_type), get_timestamp_str(transaction->timestamp));
+        }
+    }
+    return 1;
+}
+
+int cmd_ingest(Blockchain* chain, int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    IngestStats stats;
+    ingest_stats(chain->ingest, &stats);
+    printf("\nIngest queue: %zu queued of %zu slots\n", stats.queued, chain->ingest->mask + 1);
+    printf("Submitted: %llu, dropped (queue full): %llu\n", stats.submitted, stats.dropped);
+    printf("Enqueue latency: %.2f us average, %.2f us max\n", stats.average_latency_us, stats.max_latency_us);
+    return 1;
+}
+
+// Reads only the totals kept as blocks are added, so it is cheap to poll
+int cmd_stats(Blockchain* chain, int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    drain_ingest_queue(chain);
+    const ChainStats* stats = get_chain_stats(chain);
+
+    printf("\nBlocks: %u\n", chain->block_count);
+    printf("Transactions: %llu mined, %zu pending\n", (unsigned long long)stats->transactions,
+           mempool_count(&chain->mempool));
+    printf("Ciphertext: %llu bytes\n", (unsigned long long)stats->ciphertext_bytes);
+    if (stats->transactions > 0) {
+        printf("First record: %s", get_timestamp_str(stats->first_timestamp));
+        printf("Last record: %s", get_timestamp_str(stats->last_timestamp));
+    }
+    printf("Records by type:\n");
+    for (size_t i = 0; i < stats->record_type_count; i++) {
+        printf("  %-14s %llu\n", string_for_id(stats->record_types[i].record_type),
+               (unsigned long long)stats->record_types[i].count);
+    }
+    return 1;
+}
+
+int cmd_cache(Blockchain* chain, int argc, char** argv) {
+    if (argc >= 1 && strcmp(argv[0], "on") == 0) {
+        uint64_t max_bytes = RECORD_CACHE_DEFAULT_BYTES;
+        uint32_t ttl = RECORD_CACHE_DEFAULT_TTL;
+        int valid = 1;
+        for (int i = 1; valid && i < argc; i++) {
+            if (strcmp(argv[i], "--bytes") == 0 && i + 1 < argc) {
+                valid = parse_uint64(argv[++i], 1, RECORD_CACHE_MAX_BYTES, &max_bytes);
+            } else if (strcmp(argv[i], "--ttl") == 0 && i + 1 < argc) {
+                valid = parse_uint32(argv[++i], 0, RECORD_CACHE_MAX_TTL, &ttl);  // 0 = no expiry
+            } else {
+                valid = 0;
+            }
+        }
+        if (!valid) {
+            printf("Error: Usage: cache on [--bytes <1-%d>] [--ttl <0-%d seconds>]\n", RECORD_CACHE_MAX_BYTES,
+                   RECORD_CACHE_MAX_TTL);
+            return 1;
+        }
+        if (!enable_record_cache(chain, (size_t)max_bytes, ttl)) {
+            print_error("Failed to create record cache");
+            return 1;
+        }
+        print_success("Decrypted records will be cached");
+    } else if (argc == 1 && strcmp(argv[0], "off") == 0) {
+        disable_record_cache(chain);
+        print_success("Record cache disabled and wiped");
+        return 1;
+    } else if (argc > 0) {
+        print_error("Usage: cache | cache on [--bytes <size>] [--ttl <seconds>] | cache off");
+        return 1;
+    }
+
+    if (!chain->record_cache) {
+        printf("Record cache: off\n");
+        return 1;
+    }
+    RecordCacheStats stats;
+    record_cache_stats(chain->record_cache, &stats);
+    uint64_t lookups = stats.hits + stats.misses;
+    printf("Record cache: %zu records, %zu of %zu bytes, TTL %u s\n", stats.entries, stats.bytes,
+           stats.max_bytes, stats.ttl);
+    printf("Hits: %llu, misses: %llu (%.1f%% hit rate)\n", (unsigned long long)stats.hits,
+           (unsigned long long)stats.misses, lookups ? 100.0 * (double)stats.hits / (double)lookups : 0.0);
+    printf("Evictions: %llu, expirations: %llu\n", (unsigned long long)stats.evictions,
+           (unsigned long long)stats.expirations);
+    return 1;
+}
+
+static void print_rekey_progress(const RekeyProgress* progress) {
+    printf("Re-encryption to key %u: %llu of %llu records scanned, %llu re-encrypted, %llu failed "
+           "(%.0f records/s)\n", progress->key_id, progress->scanned, progress->total, progress->migrated,
+           progress->failed, progress->rate);
+}
+
+// Report a re-encryption job that has stopped and release it
+void poll_key_rotation(void) {
+    if (!rekey_job_finished(rekey_job)) {
+        return;
+    }
+
+    int cancelled = atomic_load(&rekey_job->cancel);
+    RekeyProgress progress;
+    rekey_job_finish(rekey_job, &progress);
+    rekey_job = NULL;
+    printf("%s ", cancelled ? "Cancelled:" : "Finished:");
+    print_rekey_progress(&progress);
+}
+
+// Stop re-encryption before the chain's blocks are replaced or freed.
+// Records re-encrypted so far are kept.
+void cancel_key_rotation(void) {
+    if (rekey_job) {
+        rekey_job_cancel(rekey_job);
+        rekey_job_finish(rekey_job, NULL);
+        rekey_job = NULL;
+    }
+}
+
+// Re-encrypt every mined record not yet under the current master key, in
+// the background at `rate` records per second
+static void start_key_migration(Blockchain* chain, KeyStore* store, uint32_t rate) {
+    cancel_key_rotation();
+    uint32_t key_id = current_key_id(store);
+    rekey_job = rekey_job_start(chain->blocks, chain->block_count, store, chain->overlay, key_id, rate);
+    if (!rekey_job) {
+        print_error("Failed to start re-encryption");
+        return;
+    }
+    printf("Re-encrypting %llu record(s) to key %u in the background (see 'keys')\n", rekey_job->total, key_id);
+}
+
+int cmd_keys(Blockchain* chain, int argc, char** argv) {
+    const char* action = argc > 0 ? argv[0] : NULL;
+    uint32_t rate = REKEY_DEFAULT_RATE;
+    int valid = !action || (argc == 1 && strcmp(action, "cancel") == 0) ||
+                ((strcmp(action, "rotate") == 0 || strcmp(action, "migrate") == 0) &&
+                 (argc == 1 || (argc == 3 && strcmp(argv[1], "--rate") == 0)));
+    if (valid && argc == 3 && !parse_rate(argv[2], &rate)) {  // 0 = as fast as possible
+        print_error("--rate takes a number of records per second (0 = unthrottled)");
+        return 1;
+    }
+    if (!valid) {
+        print_error("Usage: keys | keys rotate [--rate <records/s>] | keys migrate [--rate <records/s>] | keys cancel");
+        return 1;
+    }
+
+    KeyStore* store = get_key_store(chain);
+    if (!store) {
+        return 1;
+    }
+
+    if (action && strcmp(action, "cancel") == 0) {
+        if (!rekey_job) {
+            print_error("No re-encryption in progress");
+        } else {
+            rekey_job_cancel(rekey_job);
+            printf("Cancelling re-encryption...\n");
+        }
+        return 1;
+    }
+    if (action && strcmp(action, "rotate") == 0) {
+        uint32_t key_id = rotate_master_key(store);
+        if (key_id == 0) {
+            print_error("Failed to create a new master key");
+            return 1;
+        }
+        printf("Success: New records use master key %u; keep the older key files until re-encryption is saved\n",
+               key_id);
+    }
+    if (action) {
+        start_key_migration(chain, store, rate);
+        return 1;
+    }
+
+    KeyStoreStats stats;
+    key_store_stats(store, &stats);
+    uint64_t lookups = stats.derivations + stats.hits;
+    printf("Master keys: %u in %s and the numbered files after it (current: key %u)\n", stats.current_key_id,
+           MASTER_KEY_FILE, stats.current_key_id);
+    printf("Patient keys cached: %zu of %d\n", stats.cached_keys, KEY_CACHE_SLOTS);
+    printf("Derivations: %llu, cache hits: %llu (%.1f%% hit rate)\n", (unsigned long long)stats.derivations,
+           (unsigned long long)stats.hits, lookups ? 100.0 * (double)stats.hits / (double)lookups : 0.0);
+    if (rekey_job) {
+        RekeyProgress progress;
+        rekey_job_progress(rekey_job, &progress);
+        print_rekey_progress(&progress);
+    }
+    printf("Re-encrypted records not yet saved: %zu\n", overlay_count(chain->overlay));
     return 1;
 }
 
@@ -191,6 +892,8 @@ int cmd_backup(Blockchain* chain, int argc, char** argv) {
 int cmd_restore(Blockchain* chain, int argc, char** argv) {
     (void)argc;
     (void)argv;
+    // The job reads the blocks a restore frees; 'keys migrate' resumes it
+    cancel_key_rotation();
     if (restore_blockchain(chain)) {
         print_success("Blockchain restored from backup successfully");
     } else {
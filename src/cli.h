@@ -22,12 +22,26 @@ int handle_command(Blockchain* chain, const char* input);
 void print_prompt(void);
 void print_error(const char* message);
 void print_success(const char* message);
+void poll_background_mining(Blockchain* chain);
+void cancel_background_mining(Blockchain* chain);
+void poll_key_rotation(void);
+void cancel_key_rotation(void);
+void close_key_store(void);
 
 // Command handlers
 int cmd_add(Blockchain* chain, int argc, char** argv);
 int cmd_mine(Blockchain* chain, int argc, char** argv);
 int cmd_view(Blockchain* chain, int argc, char** argv);
 int cmd_verify(Blockchain* chain, int argc, char** argv);
+int cmd_prove(Blockchain* chain, int argc, char** argv);
+int cmd_history(Blockchain* chain, int argc, char** argv);
+int cmd_query(Blockchain* chain, int argc, char** argv);
+int cmd_limits(Blockchain* chain, int argc, char** argv);
+int cmd_mempool(Blockchain* chain, int argc, char** argv);
+int cmd_ingest(Blockchain* chain, int argc, char** argv);
+int cmd_stats(Blockchain* chain, int argc, char** argv);
+int cmd_cache(Blockchain* chain, int argc, char** argv);
+int cmd_keys(Blockchain* chain, int argc, char** argv);
 int cmd_backup(Blockchain* chain, int argc, char** argv);
 int cmd_restore(Blockchain* chain, int argc, char** argv);
 int cmd_help(Blockchain* chain, int argc, char** argv);
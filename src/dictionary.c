@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "dictionary.h"
+
+// Strings live in fixed-size chunks that never move, so a reader can
+// resolve any id below the published size without locking. Id 0 is the
+// empty string.
+static char (*chunks[DICTIONARY_MAX_CHUNKS])[DICTIONARY_STRING_SIZE];
+static atomic_uint_least32_t size;
+
+// Open-addressing table from string to id, guarded by `lock`
+static StringId* slots;
+static size_t slot_count;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+// FNV-1a over the NUL-terminated string
+static size_t hash_string(const char* str) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char* p = (const unsigned char*)str; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return (size_t)hash;
+}
+
+static char* slot_string(StringId id) {
+    return chunks[id / DICTIONARY_CHUNK_STRINGS][id % DICTIONARY_CHUNK_STRINGS];
+}
+
+// Slot holding `str`, or the empty slot where it would go; the lock is held
+static size_t find_slot(const char* str) {
+    size_t slot = hash_string(str) & (slot_count - 1);
+    while (slots[slot] != STRING_ID_NONE && strcmp(slot_string(slots[slot]), str) != 0) {
+        slot = (slot + 1) & (slot_count - 1);
+    }
+    return slot;
+}
+
+// Double the hash table; the lock is held
+static int grow_slots(void) {
+    size_t count = slot_count ? slot_count * 2 : DICTIONARY_INITIAL_SLOTS;
+    StringId* grown = (StringId*)calloc(count, sizeof(StringId));
+    if (!grown) {
+        return 0;
+    }
+
+    StringId* old = slots;
+    size_t old_count = slot_count;
+    slots = grown;
+    slot_count = count;
+    for (size_t i = 0; i < old_count; i++) {
+        if (old[i] != STRING_ID_NONE) {
+            slots[find_slot(slot_string(old[i]))] = old[i];
+        }
+    }
+    free(old);
+    return 1;
+}
+
+// Truncate to the storable length, as the fixed-size fields used to
+static void copy_key(char key[DICTIONARY_STRING_SIZE], const char* str) {
+    strncpy(key, str, DICTIONARY_STRING_SIZE - 1);
+    key[DICTIONARY_STRING_SIZE - 1] = '\0';
+}
+
+// Store a new string and return its handle; the lock is held
+static StringId add_string(const char* key) {
+    uint32_t count = atomic_load_explicit(&size, memory_order_relaxed);
+    if (count == 0) {
+        count = 1;  // Id 0 is reserved for the empty string
+    }
+    if (count >= (uint32_t)DICTIONARY_MAX_CHUNKS * DICTIONARY_CHUNK_STRINGS) {
+        return STRING_ID_NONE;
+    }
+
+    size_t chunk = count / DICTIONARY_CHUNK_STRINGS;
+    if (!chunks[chunk]) {
+        chunks[chunk] = calloc(DICTIONARY_CHUNK_STRINGS, DICTIONARY_STRING_SIZE);
+        if (!chunks[chunk]) {
+            return STRING_ID_NONE;
+        }
+    }
+    if ((size_t)(count + 1) * 2 > slot_count && !grow_slots()) {
+        return STRING_ID_NONE;
+    }
+
+    StringId id = count;
+    memcpy(slot_string(id), key, DICTIONARY_STRING_SIZE);
+    slots[find_slot(key)] = id;
+
+    // Publish the string before readers can see its id
+    atomic_store_explicit(&size, count + 1, memory_order_release);
+    return id;
+}
+
+// Handle of `str`, adding it if new. STRING_ID_NONE for NULL or empty
+// strings, or if the table cannot grow.
+StringId intern_string(const char* str) {
+    if (!str || !*str) {
+        return STRING_ID_NONE;
+    }
+
+    char key[DICTIONARY_STRING_SIZE];
+    copy_key(key, str);
+
+    pthread_mutex_lock(&lock);
+    StringId id = STRING_ID_NONE;
+    if (slots || grow_slots()) {
+        id = slots[find_slot(key)];
+        if (id == STRING_ID_NONE) {
+            id = add_string(key);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return id;
+}
+
+// Handle of `str` if it was ever interned, else STRING_ID_NONE. Use this
+// for lookups so unknown query strings do not grow the table.
+StringId find_string(const char* str) {
+    if (!str || !*str) {
+        return STRING_ID_NONE;
+    }
+
+    char key[DICTIONARY_STRING_SIZE];
+    copy_key(key, str);
+
+    pthread_mutex_lock(&lock);
+    StringId id = slots ? slots[find_slot(key)] : STRING_ID_NONE;
+    pthread_mutex_unlock(&lock);
+    return id;
+}
+
+// Text of a handle; "" for STRING_ID_NONE or an unknown handle
+const char* string_for_id(StringId id) {
+    if (id == STRING_ID_NONE || id >= atomic_load_explicit(&size, memory_order_acquire)) {
+        return "";
+    }
+    return slot_string(id);
+}
+
+// One past the largest handle handed out
+uint32_t dictionary_size(void) {
+    uint32_t count = atomic_load_explicit(&size, memory_order_acquire);
+    return count ? count : 1;
+}
@@ -0,0 +1,24 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <stdint.h>
+
+// Process-wide table of interned strings. Patient ids and record types
+// repeat constantly, so transactions store a StringId handle instead of
+// the text and compare handles instead of strings.
+#define DICTIONARY_STRING_SIZE 32        // Longest string plus NUL; longer ones are truncated
+#define DICTIONARY_CHUNK_STRINGS 1024    // Strings per storage chunk
+#define DICTIONARY_MAX_CHUNKS 4096       // Up to 4M distinct strings
+#define DICTIONARY_INITIAL_SLOTS 256     // Hash slots of an empty table; doubles at half full
+
+typedef uint32_t StringId;
+
+#define STRING_ID_NONE 0                 // Handle of the empty string
+
+// Function declarations. All are thread-safe; string_for_id() takes no lock.
+StringId intern_string(const char* str);
+StringId find_string(const char* str);
+const char* string_for_id(StringId id);
+uint32_t dictionary_size(void);
+
+#endif // DICTIONARY_H
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include "index.h"
+
+// Interned ids are dense, so a multiplicative hash spreads them evenly
+static size_t hash_patient_id(StringId patient_id) {
+    return (size_t)(((uint64_t)patient_id * 11400714819323198485ULL) >> 32);
+}
+
+int patient_index_init(PatientIndex* index) {
+    if (!index) {
+        return 0;
+    }
+
+    index->buckets = (PatientEntry**)calloc(PATIENT_INDEX_INITIAL_BUCKETS, sizeof(PatientEntry*));
+    if (!index->buckets) {
+        return 0;
+    }
+    index->bucket_count = PATIENT_INDEX_INITIAL_BUCKETS;
+    index->entry_count = 0;
+    return 1;
+}
+
+void patient_index_free(PatientIndex* index) {
+    if (!index || !index->buckets) {
+        return;
+    }
+
+    for (size_t i = 0; i < index->bucket_count; i++) {
+        PatientEntry* entry = index->buckets[i];
+        while (entry) {
+            PatientEntry* next = entry->next;
+            free(entry->refs);
+            free(entry);
+            entry = next;
+        }
+    }
+    free(index->buckets);
+    index->buckets = NULL;
+    index->bucket_count = 0;
+    index->entry_count = 0;
+}
+
+// Double the bucket array once there are more patients than buckets
+static void grow_buckets(PatientIndex* index) {
+    size_t bucket_count = index->bucket_count * 2;
+    PatientEntry** buckets = (PatientEntry**)calloc(bucket_count, sizeof(PatientEntry*));
+    if (!buckets) {
+        return;  // Keep the current, slower table
+    }
+
+    for (size_t i = 0; i < index->bucket_count; i++) {
+        PatientEntry* entry = index->buckets[i];
+        while (entry) {
+            PatientEntry* next = entry->next;
+            size_t bucket = hash_patient_id(entry->patient_id) & (bucket_count - 1);
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    free(index->buckets);
+    index->buckets = buckets;
+    index->bucket_count = bucket_count;
+}
+
+static PatientEntry* find_entry(const PatientIndex* index, StringId patient_id) {
+    size_t bucket = hash_patient_id(patient_id) & (index->bucket_count - 1);
+    for (PatientEntry* entry = index->buckets[bucket]; entry; entry = entry->next) {
+        if (entry->patient_id == patient_id) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+int patient_index_add(PatientIndex* index, StringId patient_id, uint32_t block_id, int slot) {
+    if (!index || !index->buckets || patient_id == STRING_ID_NONE) {
+        return 0;
+    }
+
+    PatientEntry* entry = find_entry(index, patient_id);
+    if (!entry) {
+        entry = (PatientEntry*)calloc(1, sizeof(PatientEntry));
+        if (!entry) {
+            return 0;
+        }
+        entry->patient_id = patient_id;
+
+        size_t bucket = hash_patient_id(entry->patient_id) & (index->bucket_count - 1);
+        entry->next = index->buckets[bucket];
+        index->buckets[bucket] = entry;
+        if (++index->entry_count > index->bucket_count) {
+            grow_buckets(index);
+        }
+    }
+
+    if (entry->ref_count == entry->ref_capacity) {
+        size_t capacity = entry->ref_capacity ? entry->ref_capacity * 2 : 4;
+        TxRef* refs = (TxRef*)realloc(entry->refs, sizeof(TxRef) * capacity);
+        if (!refs) {
+            return 0;
+        }
+        entry->refs = refs;
+        entry->ref_capacity = capacity;
+    }
+
+    entry->refs[entry->ref_count].block_id = block_id;
+    entry->refs[entry->ref_count].slot = slot;
+    entry->ref_count++;
+    return 1;
+}
+
+// Undo patient_index_add() of a ref that is still the patient's latest.
+// Does nothing if it is not.
+void patient_index_remove_latest(PatientIndex* index, StringId patient_id, uint32_t block_id, int slot) {
+    PatientEntry* entry = index && index->buckets ? find_entry(index, patient_id) : NULL;
+    if (entry && entry->ref_count > 0 && entry->refs[entry->ref_count - 1].block_id == block_id &&
+        entry->refs[entry->ref_count - 1].slot == slot) {
+        entry->ref_count--;
+    }
+}
+
+const PatientEntry* patient_index_lookup(const PatientIndex* index, StringId patient_id) {
+    if (!index || !index->buckets || patient_id == STRING_ID_NONE) {
+        return NULL;
+    }
+    return find_entry(index, patient_id);
+}
+
+void record_type_index_init(RecordTypeIndex* index) {
+    if (index) {
+        index->entries = NULL;
+        index->entry_count = 0;
+        index->entry_capacity = 0;
+    }
+}
+
+void record_type_index_free(RecordTypeIndex* index) {
+    if (!index) {
+        return;
+    }
+
+    for (size_t i = 0; i < index->entry_count; i++) {
+        free(index->entries[i].refs);
+    }
+    free(index->entries);
+    record_type_index_init(index);
+}
+
+static RecordTypeEntry* find_record_type(const RecordTypeIndex* index, StringId record_type) {
+    for (size_t i = 0; i < index->entry_count; i++) {
+        if (index->entries[i].record_type == record_type) {
+            return &index->entries[i];
+        }
+    }
+    return NULL;
+}
+
+// First position whose timestamp is greater than `timestamp` (or, with
+// `inclusive`, greater than or equal to it)
+static size_t timestamp_bound(const RecordTypeEntry* entry, time_t timestamp, int inclusive) {
+    size_t low = 0;
+    size_t high = entry->ref_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        time_t current = entry->refs[mid].timestamp;
+        if (current < timestamp || (!inclusive && current == timestamp)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+int record_type_index_add(RecordTypeIndex* index, StringId record_type, time_t timestamp,
+                          uint32_t block_id, int slot) {
+    if (!index || record_type == STRING_ID_NONE) {
+        return 0;
+    }
+
+    RecordTypeEntry* entry = find_record_type(index, record_type);
+    if (!entry) {
+        if (index->entry_count == index->entry_capacity) {
+            size_t capacity = index->entry_capacity ? index->entry_capacity * 2 : 8;
+            RecordTypeEntry* entries = (RecordTypeEntry*)realloc(index->entries, sizeof(RecordTypeEntry) * capacity);
+            if (!entries) {
+                return 0;
+            }
+            index->entries = entries;
+            index->entry_capacity = capacity;
+        }
+        entry = &index->entries[index->entry_count++];
+        memset(entry, 0, sizeof(RecordTypeEntry));
+        entry->record_type = record_type;
+    }
+
+    if (entry->ref_count == entry->ref_capacity) {
+        size_t capacity = entry->ref_capacity ? entry->ref_capacity * 2 : 16;
+        TimedTxRef* refs = (TimedTxRef*)realloc(entry->refs, sizeof(TimedTxRef) * capacity);
+        if (!refs) {
+            return 0;
+        }
+        entry->refs = refs;
+        entry->ref_capacity = capacity;
+    }
+
+    // Records almost always arrive in time order, so this is normally an
+    // append; equal timestamps keep their arrival order
+    size_t position = entry->ref_count;
+    if (position > 0 && entry->refs[position - 1].timestamp > timestamp) {
+        position = timestamp_bound(entry, timestamp, 0);
+        memmove(&entry->refs[position + 1], &entry->refs[position],
+                sizeof(TimedTxRef) * (entry->ref_count - position));
+    }
+
+    entry->refs[position].ref.block_id = block_id;
+    entry->refs[position].ref.slot = slot;
+    entry->refs[position].timestamp = timestamp;
+    entry->ref_count++;
+    return 1;
+}
+
+// Visit every transaction of `record_type` with from <= timestamp <= to, in
+// timestamp order. Returns the number of transactions visited.
+size_t record_type_index_query(const RecordTypeIndex* index, StringId record_type, time_t from, time_t to,
+                               TxRefVisitor visit, void* context) {
+    if (!index || record_type == STRING_ID_NONE || from > to) {
+        return 0;
+    }
+
+    const RecordTypeEntry* entry = find_record_type(index, record_type);
+    if (!entry) {
+        return 0;
+    }
+
+    size_t visited = 0;
+    for (size_t i = timestamp_bound(entry, from, 1); i < entry->ref_count && entry->refs[i].timestamp <= to; i++) {
+        visited++;
+        if (visit && !visit(&entry->refs[i].ref, entry->refs[i].timestamp, context)) {
+            break;
+        }
+    }
+    return visited;
+}
+
+// Undo record_type_index_add(); does nothing if the ref is not indexed
+void record_type_index_remove(RecordTypeIndex* index, StringId record_type, time_t timestamp,
+                              uint32_t block_id, int slot) {
+    RecordTypeEntry* entry = index ? find_record_type(index, record_type) : NULL;
+    if (!entry) {
+        return;
+    }
+
+    for (size_t i = timestamp_bound(entry, timestamp, 1);
+         i < entry->ref_count && entry->refs[i].timestamp == timestamp; i++) {
+        if (entry->refs[i].ref.block_id == block_id && entry->refs[i].ref.slot == slot) {
+            memmove(&entry->refs[i], &entry->refs[i + 1], sizeof(TimedTxRef) * (entry->ref_count - i - 1));
+            entry->ref_count--;
+            return;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "dictionary.h"
+
+#define PATIENT_INDEX_INITIAL_BUCKETS 64  // Bucket count of an empty index; doubles as it fills
+
+// Location of one transaction in the chain
+typedef struct {
+    uint32_t block_id;
+    int slot;                 // Transaction slot within the block
+} TxRef;
+
+// All transactions of one patient, in the order they were indexed
+typedef struct PatientEntry {
+    StringId patient_id;
+    TxRef* refs;
+    size_t ref_count;
+    size_t ref_capacity;
+    struct PatientEntry* next;  // Next entry in the same bucket
+} PatientEntry;
+
+// Hash index from patient id to transaction locations
+typedef struct {
+    PatientEntry** buckets;
+    size_t bucket_count;
+    size_t entry_count;       // Distinct patients
+} PatientIndex;
+
+// Transaction location with the timestamp it is ordered by
+typedef struct {
+    TxRef ref;
+    time_t timestamp;
+} TimedTxRef;
+
+// All transactions of one record type, sorted by timestamp
+typedef struct {
+    StringId record_type;
+    TimedTxRef* refs;
+    size_t ref_count;
+    size_t ref_capacity;
+} RecordTypeEntry;
+
+// Ordered index on (record_type, timestamp). There are few record types,
+// so they are kept in a small array and each holds one sorted run.
+typedef struct {
+    RecordTypeEntry* entries;
+    size_t entry_count;
+    size_t entry_capacity;
+} RecordTypeIndex;
+
+// Called for each match of a range query; return 0 to stop early
+typedef int (*TxRefVisitor)(const TxRef* ref, time_t timestamp, void* context);
+
+// Function declarations
+int patient_index_init(PatientIndex* index);
+void patient_index_free(PatientIndex* index);
+int patient_index_add(PatientIndex* index, StringId patient_id, uint32_t block_id, int slot);
+void patient_index_remove_latest(PatientIndex* index, StringId patient_id, uint32_t block_id, int slot);
+const PatientEntry* patient_index_lookup(const PatientIndex* index, StringId patient_id);
+
+void record_type_index_init(RecordTypeIndex* index);
+void record_type_index_free(RecordTypeIndex* index);
+int record_type_index_add(RecordTypeIndex* index, StringId record_type, time_t timestamp,
+                          uint32_t block_id, int slot);
+void record_type_index_remove(RecordTypeIndex* index, StringId record_type, time_t timestamp,
+                              uint32_t block_id, int slot);
+size_t record_type_index_query(const RecordTypeIndex* index, StringId record_type, time_t from, time_t to,
+                               TxRefVisitor visit, void* context);
+
+#endif // INDEX_H
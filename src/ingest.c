@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "ingest.h"
+#include "security.h"
+#include "utils.h"
+
+static unsigned long long monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+// capacity is rounded up to a power of two
+IngestQueue* ingest_queue_create(size_t capacity) {
+    size_t slots = 2;
+    while (slots < capacity) {
+        slots *= 2;
+    }
+
+    IngestQueue* queue = (IngestQueue*)aligned_alloc(INGEST_CACHE_LINE,
+        (sizeof(IngestQueue) + INGEST_CACHE_LINE - 1) / INGEST_CACHE_LINE * INGEST_CACHE_LINE);
+    if (!queue) {
+        return NULL;
+    }
+
+    queue->cells = (IngestCell*)malloc(sizeof(IngestCell) * slots);
+    if (!queue->cells) {
+        free(queue);
+        return NULL;
+    }
+    for (size_t i = 0; i < slots; i++) {
+        atomic_init(&queue->cells[i].sequence, i);
+    }
+    queue->mask = slots - 1;
+    queue->head = 0;
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->submitted, 0);
+    atomic_init(&queue->dropped, 0);
+    atomic_init(&queue->latency_ns, 0);
+    atomic_init(&queue->max_latency_ns, 0);
+    return queue;
+}
+
+// Frees the queue and any transactions still in it; no submitter may be running
+void ingest_queue_free(IngestQueue* queue) {
+    if (!queue) {
+        return;
+    }
+
+    for (size_t position = queue->head;; position++) {
+        IngestCell* cell = &queue->cells[position & queue->mask];
+        if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != position + 1) {
+            break;
+        }
+        free_encrypted_data(cell->transaction.encrypted_data);
+    }
+    free(queue->cells);
+    free(queue);
+}
+
+static void record_latency(IngestQueue* queue, unsigned long long started) {
+    unsigned long long elapsed = monotonic_ns() - started;
+    atomic_fetch_add_explicit(&queue->latency_ns, elapsed, memory_order_relaxed);
+
+    unsigned long long max = atomic_load_explicit(&queue->max_latency_ns, memory_order_relaxed);
+    while (elapsed > max &&
+           !atomic_compare_exchange_weak_explicit(&queue->max_latency_ns, &max, elapsed,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// Publish an encrypted transaction; the queue takes ownership of its
+// encrypted data on success. Returns 0 without blocking when the queue is
+// full, so callers apply backpressure (retry later or refuse the record).
+int ingest_submit(IngestQueue* queue, const Transaction* transaction) {
+    if (!queue || !transaction || !transaction->encrypted_data ||
+        !validate_patient_id(string_for_id(transaction->patient_id)) ||
+        !validate_record_type(string_for_id(transaction->record_type))) {
+        return 0;
+    }
+
+    unsigned long long started = monotonic_ns();
+    size_t position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    IngestCell* cell;
+    for (;;) {
+        cell = &queue->cells[position & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0) {
+            // Slot is free for this position; claim it
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // Slot still holds an undrained transaction from one lap ago
+            atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+            return 0;
+        } else {
+            position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+
+    cell->transaction = *transaction;
+    atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+
+    atomic_fetch_add_explicit(&queue->submitted, 1, memory_order_relaxed);
+    record_latency(queue, started);
+    return 1;
+}
+
+// Move published transactions into the mempool in submission order. Stops
+// early if the mempool refuses one (it is full); that transaction stays
+// queued. Returns the number moved. Single consumer only.
+size_t ingest_drain(IngestQueue* queue, Mempool* mempool) {
+    if (!queue || !mempool) {
+        return 0;
+    }
+
+    size_t moved = 0;
+    for (;;) {
+        IngestCell* cell = &queue->cells[queue->head & queue->mask];
+        if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != queue->head + 1) {
+            break;  // Empty, or the next producer has not published yet
+        }
+        if (!mempool_add(mempool, &cell->transaction)) {
+            break;
+        }
+
+        // Free the slot for the producer one lap ahead
+        atomic_store_explicit(&cell->sequence, queue->head + queue->mask + 1, memory_order_release);
+        queue->head++;
+        moved++;
+    }
+    return moved;
+}
+
+void ingest_stats(const IngestQueue* queue, IngestStats* stats) {
+    if (!queue || !stats) {
+        return;
+    }
+
+    stats->submitted = atomic_load(&queue->submitted);
+    stats->dropped = atomic_load(&queue->dropped);
+    size_t tail = atomic_load(&queue->tail);
+    stats->queued = tail > queue->head ? tail - queue->head : 0;
+    unsigned long long latency = atomic_load(&queue->latency_ns);
+    stats->average_latency_us = stats->submitted ? latency / 1000.0 / stats->submitted : 0;
+    stats->max_latency_us = atomic_load(&queue->max_latency_ns) / 1000.0;
+}
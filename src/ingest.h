@@ -0,0 +1,48 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include "block.h"
+#include "mempool.h"
+
+#define INGEST_QUEUE_CAPACITY 4096  // Slots; must be a power of two
+#define INGEST_CACHE_LINE 64
+
+// One slot; `sequence` says whether it is free for the producer claiming
+// position p (== p) or holds the transaction published at p (== p + 1)
+typedef struct {
+    atomic_size_t sequence;
+    Transaction transaction;
+} IngestCell;
+
+// Bounded lock-free queue in front of the mempool. Any number of threads
+// may submit; one thread (the one that owns the chain) drains it.
+typedef struct {
+    IngestCell* cells;
+    size_t mask;                                      // capacity - 1
+    _Alignas(INGEST_CACHE_LINE) atomic_size_t tail;   // Next position producers claim
+    _Alignas(INGEST_CACHE_LINE) size_t head;          // Next position to drain (consumer only)
+    _Alignas(INGEST_CACHE_LINE) atomic_ullong submitted;  // Accepted submissions
+    atomic_ullong dropped;                            // Submissions refused because the queue was full
+    atomic_ullong latency_ns;                         // Total time spent in accepted submissions
+    atomic_ullong max_latency_ns;
+} IngestQueue;
+
+// Snapshot of the queue counters
+typedef struct {
+    unsigned long long submitted;
+    unsigned long long dropped;
+    size_t queued;               // Submitted but not yet drained
+    double average_latency_us;   // Per accepted submission
+    double max_latency_us;
+} IngestStats;
+
+// Function declarations
+IngestQueue* ingest_queue_create(size_t capacity);
+void ingest_queue_free(IngestQueue* queue);
+int ingest_submit(IngestQueue* queue, const Transaction* transaction);
+size_t ingest_drain(IngestQueue* queue, Mempool* mempool);
+void ingest_stats(const IngestQueue* queue, IngestStats* stats);
+
+#endif // INGEST_H
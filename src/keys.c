@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/crypto.h>
+#include "keys.h"
+
+// Fixed HKDF salt and info prefix; changing either changes every patient key
+static const unsigned char KEY_SALT[] = "ALU medical blockchain data keys v1";
+static const char PATIENT_INFO_PREFIX[] = "patient:";
+
+// Key store holding a single master key (id 1) that is not stored in a file
+KeyStore* create_key_store(const unsigned char* master, const unsigned char* shared) {
+    if (!master || !shared) {
+        return NULL;
+    }
+
+    KeyStore* store = (KeyStore*)calloc(1, sizeof(KeyStore));
+    if (!store) {
+        return NULL;
+    }
+    memcpy(store->masters[0], master, AES_KEY_SIZE);
+    store->key_count = 1;
+    memcpy(store->shared, shared, AES_KEY_SIZE);
+    pthread_mutex_init(&store->lock, NULL);
+    return store;
+}
+
+// File holding key id `key_id` of a ring whose first key is in `filename`
+static void key_file_name(const char* filename, uint32_t key_id, char* out, size_t size) {
+    if (key_id == 1) {
+        snprintf(out, size, "%s", filename);
+    } else {
+        snprintf(out, size, "%s.%u", filename, key_id);
+    }
+}
+
+// Key ring whose master keys are read with load_key() from `filename` and
+// the numbered files after it. A missing first file gets a new random
+// master key if `create` is set and is an error otherwise; an unreadable
+// one is always an error rather than being replaced, since that would
+// orphan every record.
+KeyStore* open_key_store(const char* filename, const unsigned char* shared, int create) {
+    if (!filename || strlen(filename) + 12 > KEY_FILE_NAME_SIZE) {
+        return NULL;
+    }
+
+    unsigned char master[AES_KEY_SIZE];
+    if (!load_key(master, filename)) {
+        if (!create || access(filename, F_OK) == 0 || !generate_key(master) || !store_key(master, filename)) {
+            OPENSSL_cleanse(master, AES_KEY_SIZE);
+            return NULL;
+        }
+    }
+
+    KeyStore* store = create_key_store(master, shared);
+    OPENSSL_cleanse(master, AES_KEY_SIZE);
+    if (!store) {
+        return NULL;
+    }
+    snprintf(store->filename, sizeof(store->filename), "%s", filename);
+
+    // Later keys, up to the first missing file
+    char key_file[KEY_FILE_NAME_SIZE];
+    while (store->key_count < KEY_RING_MAX) {
+        key_file_name(filename, store->key_count + 1, key_file, sizeof(key_file));
+        if (!load_key(store->masters[store->key_count], key_file)) {
+            if (access(key_file, F_OK) == 0) {
+                free_key_store(store);
+                return NULL;
+            }
+            break;
+        }
+        store->key_count++;
+    }
+    return store;
+}
+
+// Add a new random master key to the ring, storing it next to the others,
+// and make it the key of new records. Returns its key id, or 0 if the
+// ring is full or the key cannot be stored.
+uint32_t rotate_master_key(KeyStore* store) {
+    if (!store) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&store->lock);
+    uint32_t key_id = 0;
+    unsigned char master[AES_KEY_SIZE];
+    if (store->key_count < KEY_RING_MAX && generate_key(master)) {
+        char key_file[KEY_FILE_NAME_SIZE];
+        key_file_name(store->filename, store->key_count + 1, key_file, sizeof(key_file));
+        if (store->filename[0] == '\0' || store_key(master, key_file)) {
+            memcpy(store->masters[store->key_count], master, AES_KEY_SIZE);
+            key_id = ++store->key_count;
+        }
+    }
+    OPENSSL_cleanse(master, AES_KEY_SIZE);
+    pthread_mutex_unlock(&store->lock);
+    return key_id;
+}
+
+// Key id new records are encrypted under
+uint32_t current_key_id(KeyStore* store) {
+    if (!store) {
+        return 0;
+    }
+    pthread_mutex_lock(&store->lock);
+    uint32_t key_id = store->key_count;
+    pthread_mutex_unlock(&store->lock);
+    return key_id;
+}
+
+void free_key_store(KeyStore* store) {
+    if (!store) {
+        return;
+    }
+    pthread_mutex_destroy(&store->lock);
+    OPENSSL_cleanse(store, sizeof(KeyStore));
+    free(store);
+}
+
+// HKDF-SHA256(master, KEY_SALT, "patient:" + patient_id). The id is hashed
+// as text, so keys do not depend on this process's dictionary.
+int derive_patient_key(const unsigned char* master, const char* patient_id, unsigned char* key) {
+    if (!master || !patient_id || !key) {
+        return 0;
+    }
+
+    unsigned char info[sizeof(PATIENT_INFO_PREFIX) + DICTIONARY_STRING_SIZE];
+    size_t prefix_len = sizeof(PATIENT_INFO_PREFIX) - 1;
+    size_t id_len = strnlen(patient_id, DICTIONARY_STRING_SIZE - 1);
+    memcpy(info, PATIENT_INFO_PREFIX, prefix_len);
+    memcpy(info + prefix_len, patient_id, id_len);
+
+    size_t key_len = AES_KEY_SIZE;
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
+    int ok = ctx && EVP_PKEY_derive_init(ctx) > 0 &&
+             EVP_PKEY_CTX_set_hkdf_md(ctx, EVP_sha256()) > 0 &&
+             EVP_PKEY_CTX_set1_hkdf_salt(ctx, KEY_SALT, sizeof(KEY_SALT) - 1) > 0 &&
+             EVP_PKEY_CTX_set1_hkdf_key(ctx, master, AES_KEY_SIZE) > 0 &&
+             EVP_PKEY_CTX_add1_hkdf_info(ctx, info, (int)(prefix_len + id_len)) > 0 &&
+             EVP_PKEY_derive(ctx, key, &key_len) > 0 && key_len == AES_KEY_SIZE;
+    EVP_PKEY_CTX_free(ctx);
+    return ok;
+}
+
+// Interned ids are dense, so a multiplicative hash spreads them evenly
+static size_t key_slot(StringId patient_id, uint32_t key_id) {
+    uint64_t key = ((uint64_t)key_id << 32) | patient_id;
+    return (size_t)((key * 11400714819323198485ULL) >> 32) % KEY_CACHE_SLOTS;
+}
+
+// Data key of a record with the given scheme, master key id and patient.
+// Patient keys come from the cache, or are derived and replace whatever
+// key held their slot.
+int record_key(KeyStore* store, uint8_t key_scheme, uint32_t key_id, StringId patient_id, unsigned char* key) {
+    if (!store || !key) {
+        return 0;
+    }
+    if (key_scheme == KEY_SCHEME_SHARED) {
+        memcpy(key, store->shared, AES_KEY_SIZE);
+        return 1;
+    }
+    if (key_scheme != KEY_SCHEME_PATIENT || patient_id == STRING_ID_NONE) {
+        return 0;
+    }
+
+    CachedKey* slot = &store->cache[key_slot(patient_id, key_id)];
+    unsigned char master[AES_KEY_SIZE];
+    pthread_mutex_lock(&store->lock);
+    if (key_id == 0 || key_id > store->key_count) {
+        pthread_mutex_unlock(&store->lock);
+        return 0;
+    }
+    if (slot->patient_id == patient_id && slot->key_id == key_id) {
+        memcpy(key, slot->key, AES_KEY_SIZE);
+        store->hits++;
+        pthread_mutex_unlock(&store->lock);
+        return 1;
+    }
+    memcpy(master, store->masters[key_id - 1], AES_KEY_SIZE);
+    pthread_mutex_unlock(&store->lock);
+
+    // Derive outside the lock; another thread may derive the same key meanwhile
+    int derived = derive_patient_key(master, string_for_id(patient_id), key);
+    OPENSSL_cleanse(master, AES_KEY_SIZE);
+    if (!derived) {
+        return 0;
+    }
+    pthread_mutex_lock(&store->lock);
+    OPENSSL_cleanse(slot->key, AES_KEY_SIZE);
+    slot->patient_id = patient_id;
+    slot->key_id = key_id;
+    memcpy(slot->key, key, AES_KEY_SIZE);
+    store->derivations++;
+    pthread_mutex_unlock(&store->lock);
+    return 1;
+}
+
+// Whether a record is already encrypted under master key `key_id`
+int record_uses_key(const EncryptedData* encrypted, uint32_t key_id) {
+    return encrypted && encrypted->cipher == CIPHER_AES_256_GCM &&
+           encrypted->key_scheme == KEY_SCHEME_PATIENT && encrypted->key_id == key_id;
+}
+
+// Encrypt `data` under the patient's key for master key `key_id`
+static EncryptedData* encrypt_under(KeyStore* store, const char* data, StringId patient_id, uint32_t key_id) {
+    unsigned char key[AES_KEY_SIZE];
+    if (!record_key(store, KEY_SCHEME_PATIENT, key_id, patient_id, key)) {
+        return NULL;
+    }
+
+    EncryptedData* encrypted = encrypt_data(data, key);
+    OPENSSL_cleanse(key, AES_KEY_SIZE);
+    if (encrypted) {
+        encrypted->key_scheme = KEY_SCHEME_PATIENT;
+        encrypted->key_id = key_id;
+    }
+    return encrypted;
+}
+
+// Encrypt a new record under its patient's key for the current master key
+EncryptedData* encrypt_record(KeyStore* store, const char* data, StringId patient_id) {
+    return encrypt_under(store, data, patient_id, current_key_id(store));
+}
+
+// Decrypt a record with whatever key it was written under and encrypt it
+// again under the patient's key for master key `key_id`
+EncryptedData* reencrypt_record(KeyStore* store, const EncryptedData* encrypted, StringId patient_id,
+                                uint32_t key_id) {
+    unsigned char key[AES_KEY_SIZE];
+    if (!encrypted || !record_key(store, encrypted->key_scheme, encrypted->key_id, patient_id, key)) {
+        return NULL;
+    }
+
+    char* data = decrypt_data(encrypted, key);
+    OPENSSL_cleanse(key, AES_KEY_SIZE);
+    if (!data) {
+        return NULL;
+    }
+    EncryptedData* reencrypted = encrypt_under(store, data, patient_id, key_id);
+    OPENSSL_cleanse(data, strlen(data));
+    free(data);
+    return reencrypted;
+}
+
+void key_store_stats(KeyStore* store, KeyStoreStats* stats) {
+    if (!stats) {
+        return;
+    }
+
+    memset(stats, 0, sizeof(KeyStoreStats));
+    if (!store) {
+        return;
+    }
+    pthread_mutex_lock(&store->lock);
+    stats->current_key_id = store->key_count;
+    for (size_t i = 0; i < KEY_CACHE_SLOTS; i++) {
+        if (store->cache[i].patient_id != STRING_ID_NONE) {
+            stats->cached_keys++;
+        }
+    }
+    stats->derivations = store->derivations;
+    stats->hits = store->hits;
+    pthread_mutex_unlock(&store->lock);
+}
@@ -0,0 +1,64 @@
+#ifndef KEYS_H
+#define KEYS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "security.h"
+#include "dictionary.h"
+
+// Record data keys. Each patient's records are encrypted under their own
+// key, derived with HKDF-SHA256 from a master key and the patient id, so
+// a leaked data key exposes one patient rather than the whole chain.
+// Derived keys are cached so a busy patient costs one derivation.
+//
+// Master keys form a ring: key id 1 is stored in MASTER_KEY_FILE and key
+// id n > 1 in "<MASTER_KEY_FILE>.<n>". Rotating adds a key, which new
+// records use at once; older keys stay so records not yet re-encrypted
+// (and backups) can still be read.
+#define MASTER_KEY_FILE "master.key"
+#define KEY_RING_MAX 64                // Master keys a ring can hold
+#define KEY_FILE_NAME_SIZE 256
+#define KEY_CACHE_SLOTS 256            // Derived keys kept; a (patient, key id) pair maps to one slot
+
+// One cached derived key
+typedef struct {
+    StringId patient_id;               // STRING_ID_NONE = empty slot
+    uint32_t key_id;
+    unsigned char key[AES_KEY_SIZE];
+} CachedKey;
+
+typedef struct {
+    unsigned char masters[KEY_RING_MAX][AES_KEY_SIZE];  // masters[i] has key id i + 1
+    uint32_t key_count;                // The newest key, id key_count, encrypts new records
+    char filename[KEY_FILE_NAME_SIZE]; // File of key id 1 ("" = ring is not stored)
+    unsigned char shared[AES_KEY_SIZE];  // Key of KEY_SCHEME_SHARED records
+    pthread_mutex_t lock;
+    CachedKey cache[KEY_CACHE_SLOTS];
+    uint64_t derivations;
+    uint64_t hits;
+} KeyStore;
+
+// Snapshot of a key store's counters
+typedef struct {
+    uint32_t current_key_id;
+    size_t cached_keys;
+    uint64_t derivations;
+    uint64_t hits;
+} KeyStoreStats;
+
+// Function declarations. All are thread-safe.
+KeyStore* create_key_store(const unsigned char* master, const unsigned char* shared);
+KeyStore* open_key_store(const char* filename, const unsigned char* shared, int create);
+void free_key_store(KeyStore* store);
+uint32_t rotate_master_key(KeyStore* store);
+uint32_t current_key_id(KeyStore* store);
+int derive_patient_key(const unsigned char* master, const char* patient_id, unsigned char* key);
+int record_key(KeyStore* store, uint8_t key_scheme, uint32_t key_id, StringId patient_id, unsigned char* key);
+int record_uses_key(const EncryptedData* encrypted, uint32_t key_id);
+EncryptedData* encrypt_record(KeyStore* store, const char* data, StringId patient_id);
+EncryptedData* reencrypt_record(KeyStore* store, const EncryptedData* encrypted, StringId patient_id,
+                                uint32_t key_id);
+void key_store_stats(KeyStore* store, KeyStoreStats* stats);
+
+#endif // KEYS_H
@@ -4,6 +4,7 @@
 #include "blockchain.h"
 #include "cli.h"
 #include "persistence.h"
+#include "security.h"
 
 #define MAX_INPUT 1024
 
@@ -26,6 +27,8 @@ int main(void) {
     int running = 1;
 
     while (running) {
+        poll_background_mining(chain);
+        poll_key_rotation();
         print_prompt();
         if (fgets(input, sizeof(input), stdin) == NULL) {
             break;
@@ -34,16 +37,29 @@ int main(void) {
         // Remove newline
         input[strcspn(input, "\n")] = 0;
 
+        // Attach a block the background miner finished while we were waiting,
+        // and take in records submitted by other threads
+        poll_background_mining(chain);
+        drain_ingest_queue(chain);
+
         // Handle command
         running = handle_command(chain, input);
     }
 
+    // Stop any background mining before saving; its transactions stay pending.
+    // Re-encryption stops too, and what it finished is saved.
+    cancel_background_mining(chain);
+    cancel_key_rotation();
+    drain_ingest_queue(chain);
+
     // Save blockchain before cleanup
     if (!save_blockchain(chain)) {
         fprintf(stderr, "Warning: Failed to save blockchain\n");
     }
 
     // Cleanup
+    close_key_store();
+    shutdown_decrypt_pool();
     free_blockchain(chain);
     return 0;
 } 
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <string.h>
+#include "mempool.h"
+#include "security.h"
+#include "utils.h"
+
+#define PENDING_QUEUE_INITIAL_CAPACITY 16
+
+static Transaction* queue_slot(const PendingQueue* queue, size_t index) {
+    return &queue->items[(queue->head + index) % queue->capacity];
+}
+
+// Double the ring, unwrapping it so the oldest transaction is at slot 0
+static int grow_queue(PendingQueue* queue) {
+    size_t capacity = queue->capacity ? queue->capacity * 2 : PENDING_QUEUE_INITIAL_CAPACITY;
+    Transaction* items = (Transaction*)malloc(sizeof(Transaction) * capacity);
+    if (!items) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < queue->count; i++) {
+        items[i] = *queue_slot(queue, i);
+    }
+    free(queue->items);
+    queue->items = items;
+    queue->head = 0;
+    queue->capacity = capacity;
+    return 1;
+}
+
+static int queue_push_back(PendingQueue* queue, const Transaction* transaction) {
+    if (queue->count == queue->capacity && !grow_queue(queue)) {
+        return 0;
+    }
+    *queue_slot(queue, queue->count) = *transaction;
+    queue->count++;
+    return 1;
+}
+
+static int queue_push_front(PendingQueue* queue, const Transaction* transaction) {
+    if (queue->count == queue->capacity && !grow_queue(queue)) {
+        return 0;
+    }
+    queue->head = (queue->head + queue->capacity - 1) % queue->capacity;
+    queue->items[queue->head] = *transaction;
+    queue->count++;
+    return 1;
+}
+
+static void queue_pop_front(PendingQueue* queue) {
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+}
+
+int mempool_init(Mempool* mempool) {
+    if (!mempool) {
+        return 0;
+    }
+
+    memset(mempool, 0, sizeof(Mempool));
+    mempool->max_pending = MEMPOOL_MAX_PENDING;
+    return mempool_add_urgent_type(mempool, MEMPOOL_DEFAULT_URGENT_TYPE);
+}
+
+void mempool_free(Mempool* mempool) {
+    if (!mempool) {
+        return;
+    }
+
+    for (int p = 0; p < MEMPOOL_PRIORITIES; p++) {
+        PendingQueue* queue = &mempool->queues[p];
+        for (size_t i = 0; i < queue->count; i++) {
+            free_encrypted_data(queue_slot(queue, i)->encrypted_data);
+        }
+        free(queue->items);
+    }
+    memset(mempool->queues, 0, sizeof(mempool->queues));
+}
+
+int mempool_priority(const Mempool* mempool, StringId record_type) {
+    for (int i = 0; i < mempool->urgent_type_count; i++) {
+        if (mempool->urgent_types[i] == record_type) {
+            return MEMPOOL_URGENT;
+        }
+    }
+    return MEMPOOL_NORMAL;
+}
+
+// Mine transactions of this record type ahead of all others. Only affects
+// transactions submitted afterwards.
+int mempool_add_urgent_type(Mempool* mempool, const char* record_type) {
+    if (!mempool || !validate_record_type(record_type)) {
+        return 0;
+    }
+
+    StringId id = intern_string(record_type);
+    if (id == STRING_ID_NONE) {
+        return 0;
+    }
+    if (mempool_priority(mempool, id) == MEMPOOL_URGENT) {
+        return 1;
+    }
+    if (mempool->urgent_type_count >= MEMPOOL_MAX_URGENT_TYPES) {
+        return 0;
+    }
+
+    mempool->urgent_types[mempool->urgent_type_count++] = id;
+    return 1;
+}
+
+// Queue an encrypted transaction; the mempool takes ownership of its
+// encrypted data on success
+int mempool_add(Mempool* mempool, const Transaction* transaction) {
+    if (!mempool || !transaction || !transaction->encrypted_data ||
+        mempool_count(mempool) >= mempool->max_pending ||
+        !validate_patient_id(string_for_id(transaction->patient_id)) ||
+        !validate_record_type(string_for_id(transaction->record_type))) {
+        return 0;
+    }
+
+    return queue_push_back(&mempool->queues[mempool_priority(mempool, transaction->record_type)], transaction);
+}
+
+size_t mempool_count(const Mempool* mempool) {
+    size_t count = 0;
+    for (int p = 0; mempool && p < MEMPOOL_PRIORITIES; p++) {
+        count += mempool->queues[p].count;
+    }
+    return count;
+}
+
+// index-th oldest pending transaction of a priority, or NULL
+const Transaction* mempool_at(const Mempool* mempool, int priority, size_t index) {
+    if (!mempool || priority < 0 || priority >= MEMPOOL_PRIORITIES || index >= mempool->queues[priority].count) {
+        return NULL;
+    }
+    return queue_slot(&mempool->queues[priority], index);
+}
+
+// Move pending transactions into a block template, urgent ones first, until
+// the block's limits are reached, then rehash it once. Returns the number
+// of transactions moved, or -1 if the block cannot be rehashed, in which
+// case they are back in the mempool. Filling stops only when the block has
+// no room. A head record that cannot be added for any other reason (larger
+// than the byte limit, ids an older mempool file allows but blocks do not,
+// or no memory) would hold up its queue for good, so it is discarded and
+// counted in `dropped`.
+int mempool_fill_block(Mempool* mempool, Block* block) {
+    if (!mempool || !block) {
+        return 0;
+    }
+
+    int moved = 0;
+    int full = 0;
+    for (int p = 0; p < MEMPOOL_PRIORITIES && !full; p++) {
+        PendingQueue* queue = &mempool->queues[p];
+        while (queue->count > 0) {
+            Transaction* head = queue_slot(queue, 0);
+            int fits_any_block = transaction_size(head) <= block->max_bytes;
+            if (fits_any_block && !block_has_room(block, head)) {
+                full = 1;
+                break;
+            }
+            if (!fits_any_block || !append_transaction(block, head)) {
+                free_encrypted_data(head->encrypted_data);
+                mempool->dropped++;
+            } else {
+                moved++;
+            }
+            queue_pop_front(queue);
+        }
+    }
+
+    if (moved > 0 && !refresh_block_hash(block)) {
+        mempool_return_block(mempool, block);
+        return -1;
+    }
+    return moved;
+}
+
+// Give the transactions of a block that will not be added to the chain
+// back to the mempool, ahead of anything submitted since. The block no
+// longer owns them afterwards.
+void mempool_return_block(Mempool* mempool, Block* block) {
+    if (!mempool || !block) {
+        return;
+    }
+
+    // Walking backwards and pushing to the front restores arrival order
+    for (int i = block->transaction_count - 1; i >= 0; i--) {
+        Transaction* transaction = &block->transactions[i];
+        PendingQueue* queue = &mempool->queues[mempool_priority(mempool, transaction->record_type)];
+        if (!queue_push_front(queue, transaction)) {
+            free_encrypted_data(transaction->encrypted_data);
+        }
+        transaction->encrypted_data = NULL;
+    }
+    block->transaction_count = 0;
+    block->payload_bytes = 0;
+    refresh_block_hash(block);
+}
@@ -0,0 +1,44 @@
+#ifndef MEMPOOL_H
+#define MEMPOOL_H
+
+#include <stddef.h>
+#include "block.h"
+#include "index.h"
+
+#define MEMPOOL_URGENT 0            // Priority of urgent record types
+#define MEMPOOL_NORMAL 1            // Priority of everything else
+#define MEMPOOL_PRIORITIES 2
+#define MEMPOOL_MAX_PENDING 100000  // Submissions beyond this are refused
+#define MEMPOOL_MAX_URGENT_TYPES 8
+#define MEMPOOL_DEFAULT_URGENT_TYPE "emergency"
+
+// FIFO of pending transactions, as a growable ring buffer
+typedef struct {
+    Transaction* items;
+    size_t head;              // Slot of the oldest transaction
+    size_t count;
+    size_t capacity;
+} PendingQueue;
+
+// Transactions waiting to be mined. Urgent record types are mined first;
+// within a priority, transactions are mined in arrival order.
+typedef struct {
+    PendingQueue queues[MEMPOOL_PRIORITIES];
+    size_t max_pending;
+    StringId urgent_types[MEMPOOL_MAX_URGENT_TYPES];
+    int urgent_type_count;
+    size_t dropped;           // Records too large for any block, discarded while filling
+} Mempool;
+
+// Function declarations
+int mempool_init(Mempool* mempool);
+void mempool_free(Mempool* mempool);
+int mempool_add(Mempool* mempool, const Transaction* transaction);
+size_t mempool_count(const Mempool* mempool);
+const Transaction* mempool_at(const Mempool* mempool, int priority, size_t index);
+int mempool_priority(const Mempool* mempool, StringId record_type);
+int mempool_add_urgent_type(Mempool* mempool, const char* record_type);
+int mempool_fill_block(Mempool* mempool, Block* block);
+void mempool_return_block(Mempool* mempool, Block* block);
+
+#endif // MEMPOOL_H
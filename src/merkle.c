@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/evp.h>
+#include "merkle.h"
+#include "utils.h"
+
+// Domain separation prefixes so a leaf can never be mistaken for a node
+#define MERKLE_LEAF_PREFIX 0x00
+#define MERKLE_NODE_PREFIX 0x01
+
+// Append a length-prefixed string so field boundaries are unambiguous
+static int digest_update_string(EVP_MD_CTX* ctx, const char* str, size_t max_len) {
+    unsigned char len = (unsigned char)strnlen(str, max_len);
+    return EVP_DigestUpdate(ctx, &len, 1) == 1 &&
+           EVP_DigestUpdate(ctx, str, len) == 1;
+}
+
+// Leaves cover only non-sensitive transaction fields. Ids are hashed as
+// text, so roots do not depend on the dictionary. Returns 0 if hashing
+// failed, leaving the leaf all zeros.
+int merkle_leaf_hash(const Transaction* transaction, unsigned char leaf[HASH_BYTES]) {
+    memset(leaf, 0, HASH_BYTES);
+
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    if (!ctx) {
+        return 0;
+    }
+
+    unsigned char prefix = MERKLE_LEAF_PREFIX;
+    unsigned char timestamp[8];
+    for (int i = 0; i < 8; i++) {
+        timestamp[i] = (unsigned char)((uint64_t)transaction->timestamp >> (8 * i));
+    }
+
+    unsigned int md_len;
+    int ok = EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) == 1 &&
+             EVP_DigestUpdate(ctx, &prefix, 1) == 1 &&
+             digest_update_string(ctx, string_for_id(transaction->patient_id), DICTIONARY_STRING_SIZE) &&
+             digest_update_string(ctx, string_for_id(transaction->record_type), DICTIONARY_STRING_SIZE) &&
+             EVP_DigestUpdate(ctx, timestamp, sizeof(timestamp)) == 1 &&
+             EVP_DigestFinal_ex(ctx, leaf, &md_len) == 1;
+    EVP_MD_CTX_free(ctx);
+    if (!ok) {
+        memset(leaf, 0, HASH_BYTES);
+    }
+    return ok;
+}
+
+static int hash_node(const unsigned char left[HASH_BYTES], const unsigned char right[HASH_BYTES],
+                     unsigned char out[HASH_BYTES]) {
+    unsigned char buffer[1 + 2 * HASH_BYTES];
+    buffer[0] = MERKLE_NODE_PREFIX;
+    memcpy(buffer + 1, left, HASH_BYTES);
+    memcpy(buffer + 1 + HASH_BYTES, right, HASH_BYTES);
+    return sha256_bytes(buffer, sizeof(buffer), out);
+}
+
+// Combine one level into the next, in place, returning the new node count
+// (-1 if hashing failed). An odd last node is carried up unchanged rather
+// than paired with itself.
+static int reduce_level(unsigned char (*level)[HASH_BYTES], int count) {
+    int next = 0;
+    for (int i = 0; i < count; i += 2) {
+        if (i + 1 < count) {
+            if (!hash_node(level[i], level[i + 1], level[next])) {
+                return -1;
+            }
+        } else {
+            memmove(level[next], level[i], HASH_BYTES);
+        }
+        next++;
+    }
+    return next;
+}
+
+static unsigned char (*build_leaves(const Block* block))[HASH_BYTES] {
+    unsigned char (*leaves)[HASH_BYTES] = malloc((size_t)block->transaction_count * HASH_BYTES);
+    if (!leaves) {
+        return NULL;
+    }
+    for (int i = 0; i < block->transaction_count; i++) {
+        if (!merkle_leaf_hash(&block->transactions[i], leaves[i])) {
+            free(leaves);
+            return NULL;
+        }
+    }
+    return leaves;
+}
+
+// The root of an empty block is all zeros. Returns 0 if the root could
+// not be computed, leaving it all zeros; such a root must not be used.
+int calculate_merkle_root(const Block* block, unsigned char root[HASH_BYTES]) {
+    memset(root, 0, HASH_BYTES);
+    if (!block) {
+        return 0;
+    }
+    if (block->transaction_count <= 0) {
+        return 1;
+    }
+
+    unsigned char (*level)[HASH_BYTES] = build_leaves(block);
+    if (!level) {
+        return 0;
+    }
+
+    int count = block->transaction_count;
+    while (count > 1) {
+        count = reduce_level(level, count);
+        if (count < 0) {
+            free(level);
+            return 0;
+        }
+    }
+    memcpy(root, level[0], HASH_BYTES);
+    free(level);
+    return 1;
+}
+
+int build_merkle_proof(const Block* block, int index, MerkleProof* proof) {
+    if (!block || !proof || index < 0 || index >= block->transaction_count) {
+        return 0;
+    }
+
+    unsigned char (*level)[HASH_BYTES] = build_leaves(block);
+    if (!level) {
+        return 0;
+    }
+
+    memcpy(proof->leaf, level[index], HASH_BYTES);
+    proof->index = index;
+    proof->depth = 0;
+
+    int count = block->transaction_count;
+    int position = index;
+    while (count > 1) {
+        int sibling = position ^ 1;
+        if (sibling < count) {
+            MerkleStep* step = &proof->steps[proof->depth++];
+            memcpy(step->sibling, level[sibling], HASH_BYTES);
+            step->sibling_on_left = sibling < position;
+        }
+        count = reduce_level(level, count);
+        if (count < 0) {
+            free(level);
+            return 0;
+        }
+        position /= 2;
+    }
+
+    free(level);
+    return 1;
+}
+
+int verify_merkle_proof(const MerkleProof* proof, const unsigned char root[HASH_BYTES]) {
+    if (!proof || !root || proof->depth < 0 || proof->depth > MERKLE_MAX_DEPTH) {
+        return 0;
+    }
+
+    unsigned char current[HASH_BYTES];
+    memcpy(current, proof->leaf, HASH_BYTES);
+    for (int i = 0; i < proof->depth; i++) {
+        const MerkleStep* step = &proof->steps[i];
+        int hashed = step->sibling_on_left ? hash_node(step->sibling, current, current)
+                                           : hash_node(current, step->sibling, current);
+        if (!hashed) {
+            return 0;
+        }
+    }
+
+    return memcmp(current, root, HASH_BYTES) == 0;
+}
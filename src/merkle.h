@@ -0,0 +1,28 @@
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include "block.h"
+
+#define MERKLE_MAX_DEPTH 32  // Enough levels for 2^32 transactions
+
+// One level of an inclusion proof
+typedef struct {
+    unsigned char sibling[HASH_BYTES];
+    int sibling_on_left;     // 1 if the sibling is hashed before the running hash
+} MerkleStep;
+
+// Inclusion proof for one transaction of a block
+typedef struct {
+    unsigned char leaf[HASH_BYTES];
+    int index;               // Transaction slot in the block
+    int depth;               // Number of steps used
+    MerkleStep steps[MERKLE_MAX_DEPTH];
+} MerkleProof;
+
+// Function declarations
+int merkle_leaf_hash(const Transaction* transaction, unsigned char leaf[HASH_BYTES]);
+int calculate_merkle_root(const Block* block, unsigned char root[HASH_BYTES]);
+int build_merkle_proof(const Block* block, int index, MerkleProof* proof);
+int verify_merkle_proof(const MerkleProof* proof, const unsigned char root[HASH_BYTES]);
+
+#endif // MERKLE_H
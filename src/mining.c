@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "mining.h"
+#include "utils.h"
+#include "sha256.h"
+#include "merkle.h"
+
+#define NONCE_SPACE ((uint64_t)UINT32_MAX + 1)
+#define NONCE_WORD ((BLOCK_NONCE_OFFSET - SHA256_BLOCK_SIZE) / 4)  // Nonce position in the final chunk
+
+// State shared by all workers of one mining round
+typedef struct {
+    Sha256Midstate midstate;        // Header hashed up to the chunk holding the nonce
+    const Sha256Kernel* kernel;     // Fastest SHA-256 kernel this CPU supports
+    int difficulty;
+    MiningControl* control;         // Caller's cancel flag and progress counter
+    atomic_int found;               // Set by the first worker to find a valid hash
+    uint32_t nonce;                 // Winning nonce (written by the winner only)
+} MiningRound;
+
+// Per-thread mining state
+typedef struct {
+    uint64_t nonce_start;           // First nonce of this worker's range
+    uint64_t nonce_end;             // One past the last nonce of the range
+    MiningRound* round;
+} MiningWorker;
+
+// The header stores the nonce little-endian; SHA-256 reads big-endian words
+static uint32_t nonce_to_word(uint32_t nonce) {
+    return ((nonce & 0xff) << 24) | ((nonce & 0xff00) << 8) |
+           ((nonce >> 8) & 0xff00) | (nonce >> 24);
+}
+
+static void* mining_worker(void* arg) {
+    MiningWorker* worker = (MiningWorker*)arg;
+    MiningRound* round = worker->round;
+    const Sha256Kernel* kernel = round->kernel;
+    uint32_t words[SHA256_MAX_LANES];
+    unsigned char digests[SHA256_MAX_LANES][SHA256_DIGEST_SIZE];
+    uint64_t next_check = worker->nonce_start;
+    uint64_t last_report = worker->nonce_start;
+
+    for (uint64_t nonce = worker->nonce_start; nonce < worker->nonce_end; nonce += kernel->lanes) {
+        // Publish progress and stop early once another worker has won or mining was cancelled
+        if (nonce >= next_check) {
+            atomic_fetch_add_explicit(&round->control->attempts, nonce - last_report, memory_order_relaxed);
+            last_report = nonce;
+            if (atomic_load_explicit(&round->found, memory_order_relaxed) ||
+                atomic_load_explicit(&round->control->cancel, memory_order_relaxed)) {
+                return NULL;
+            }
+            next_check = nonce + MINING_CHECK_INTERVAL;
+        }
+
+        // Only the final chunk changes between attempts; lanes past the
+        // end of the range repeat the last nonce and are ignored
+        uint64_t remaining = worker->nonce_end - nonce;
+        int count = remaining < (uint64_t)kernel->lanes ? (int)remaining : kernel->lanes;
+        for (int lane = 0; lane < kernel->lanes; lane++) {
+            words[lane] = nonce_to_word((uint32_t)(nonce + (lane < count ? lane : count - 1)));
+        }
+        kernel->hash_tail(&round->midstate, NONCE_WORD, words, digests);
+
+        for (int lane = 0; lane < count; lane++) {
+            if (hash_meets_difficulty(digests[lane], round->difficulty)) {
+                int expected = 0;
+                if (atomic_compare_exchange_strong(&round->found, &expected, 1)) {
+                    round->nonce = (uint32_t)(nonce + lane);
+                }
+                atomic_fetch_add_explicit(&round->control->attempts, nonce + lane + 1 - last_report,
+                                          memory_order_relaxed);
+                return NULL;
+            }
+        }
+    }
+
+    atomic_fetch_add_explicit(&round->control->attempts, worker->nonce_end - last_report, memory_order_relaxed);
+    return NULL;
+}
+
+// Search the whole nonce space once, split evenly across thread_count workers
+static int mine_round(Block* block, int difficulty, int thread_count, MiningControl* control) {
+    MiningRound round;
+    unsigned char header[BLOCK_HEADER_SIZE];
+    serialize_block_header(block, block->merkle_root, header);
+    if (!sha256_midstate_init(&round.midstate, header, sizeof(header))) {
+        return -1;
+    }
+    round.kernel = sha256_best_kernel();
+    round.difficulty = difficulty;
+    round.control = control;
+    atomic_init(&round.found, 0);
+
+    MiningWorker* workers = (MiningWorker*)malloc(sizeof(MiningWorker) * thread_count);
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * thread_count);
+    if (!workers || !threads) {
+        free(workers);
+        free(threads);
+        return -1;
+    }
+
+    uint64_t range = NONCE_SPACE / thread_count;
+    for (int i = 0; i < thread_count; i++) {
+        workers[i].nonce_start = range * i;
+        workers[i].nonce_end = (i == thread_count - 1) ? NONCE_SPACE : range * (i + 1);
+        workers[i].round = &round;
+    }
+
+    // Worker 0 runs on the calling thread; the rest get their own threads
+    int started = 1;
+    for (int i = 1; i < thread_count; i++) {
+        if (pthread_create(&threads[i], NULL, mining_worker, &workers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    mining_worker(&workers[0]);
+
+    // Cover the ranges of workers whose threads could not be started
+    for (int i = started; i < thread_count; i++) {
+        mining_worker(&workers[i]);
+    }
+
+    for (int i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    int found = atomic_load(&round.found);
+    if (found) {
+        // Recompute through the canonical path so block->hash is authoritative
+        block->nonce = round.nonce;
+        calculate_block_hash(block);
+        if (!is_valid_hash(block->hash, difficulty)) {
+            found = -1;
+        }
+    }
+
+    free(workers);
+    free(threads);
+    return found;
+}
+
+int mine_block_parallel(Block* block, int difficulty, int thread_count, MiningControl* control) {
+    if (!block) {
+        return 0;
+    }
+
+    MiningControl local_control;
+    if (!control) {
+        atomic_init(&local_control.cancel, 0);
+        atomic_init(&local_control.attempts, 0);
+        control = &local_control;
+    }
+
+    if (thread_count <= 0) {
+        thread_count = get_online_cpus();
+    }
+
+    // Transactions are fixed while mining, so the Merkle root is computed once
+    if (!calculate_merkle_root(block, block->merkle_root)) {
+        return 0;
+    }
+
+    for (;;) {
+        int result = mine_round(block, difficulty, thread_count, control);
+        if (result != 0) {
+            return result > 0;
+        }
+        if (atomic_load(&control->cancel)) {
+            return 0;
+        }
+
+        // Nonce space exhausted: move the timestamp forward and search again
+        time_t now = time(NULL);
+        block->timestamp = now > block->timestamp ? now : block->timestamp + 1;
+    }
+}
+
+static void* mining_job_main(void* arg) {
+    MiningJob* job = (MiningJob*)arg;
+    job->result = mine_block_parallel(job->block, job->difficulty, job->thread_count, &job->control);
+    atomic_store(&job->finished, 1);
+    return NULL;
+}
+
+MiningJob* mining_job_start(Block* block, int difficulty, int thread_count) {
+    if (!block) {
+        return NULL;
+    }
+
+    MiningJob* job = (MiningJob*)malloc(sizeof(MiningJob));
+    if (!job) {
+        return NULL;
+    }
+
+    job->block = block;
+    job->difficulty = difficulty;
+    job->thread_count = thread_count;
+    job->result = 0;
+    atomic_init(&job->control.cancel, 0);
+    atomic_init(&job->control.attempts, 0);
+    atomic_init(&job->finished, 0);
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+
+    if (pthread_create(&job->thread, NULL, mining_job_main, job) != 0) {
+        free(job);
+        return NULL;
+    }
+    return job;
+}
+
+int mining_job_finished(const MiningJob* job) {
+    return job && atomic_load((atomic_int*)&job->finished);
+}
+
+void mining_job_cancel(MiningJob* job) {
+    if (job) {
+        atomic_store(&job->control.cancel, 1);
+    }
+}
+
+// Wait for the job thread, free the job and hand the block back to the caller
+Block* mining_job_finish(MiningJob* job, int* result) {
+    if (!job) {
+        return NULL;
+    }
+
+    pthread_join(job->thread, NULL);
+    Block* block = job->block;
+    if (result) {
+        *result = job->result;
+    }
+    free(job);
+    return block;
+}
+
+void mining_job_progress(const MiningJob* job, MiningProgress* progress) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    progress->attempts = atomic_load((atomic_ullong*)&job->control.attempts);
+    progress->elapsed = (double)(now.tv_sec - job->started.tv_sec) +
+                        (double)(now.tv_nsec - job->started.tv_nsec) / 1e9;
+    progress->hash_rate = progress->elapsed > 0 ? progress->attempts / progress->elapsed : 0;
+
+    // Attempts are memoryless, so a hit is always 2^difficulty attempts away on average
+    double expected_attempts = 1.0;
+    for (int i = 0; i < job->difficulty; i++) {
+        expected_attempts *= 2;
+    }
+    progress->eta = progress->hash_rate > 0 ? expected_attempts / progress->hash_rate : -1;
+}
@@ -0,0 +1,46 @@
+#ifndef MINING_H
+#define MINING_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "block.h"
+
+#define MINING_CHECK_INTERVAL 1024  // Nonces tried between checks of the stop flag
+
+// Cancellation and progress shared with a running miner
+typedef struct {
+    atomic_int cancel;              // Set to stop mining early
+    atomic_ullong attempts;         // Nonces tried so far
+} MiningControl;
+
+// Mining job running on a background thread
+typedef struct {
+    pthread_t thread;
+    Block* block;                   // Block being mined, owned by the job
+    int difficulty;
+    int thread_count;
+    MiningControl control;
+    atomic_int finished;            // Set by the job thread when mining stops
+    int result;                     // 1 if a valid nonce was found
+    struct timespec started;
+} MiningJob;
+
+// Snapshot of a job's progress
+typedef struct {
+    unsigned long long attempts;
+    double elapsed;                 // Seconds since the job started
+    double hash_rate;               // Attempts per second
+    double eta;                     // Expected seconds until a valid hash
+} MiningProgress;
+
+// Function declarations
+int mine_block_parallel(Block* block, int difficulty, int thread_count, MiningControl* control);
+
+// Background mining
+MiningJob* mining_job_start(Block* block, int difficulty, int thread_count);
+int mining_job_finished(const MiningJob* job);
+void mining_job_cancel(MiningJob* job);
+Block* mining_job_finish(MiningJob* job, int* result);
+void mining_job_progress(const MiningJob* job, MiningProgress* progress);
+
+#endif // MINING_H
@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <string.h>
+#include "overlay.h"
+
+static size_t hash_ref(TxRef ref) {
+    uint64_t key = ((uint64_t)ref.block_id << 32) | (uint32_t)ref.slot;
+    return (size_t)((key * 11400714819323198485ULL) >> 32);
+}
+
+static int same_ref(TxRef a, TxRef b) {
+    return a.block_id == b.block_id && a.slot == b.slot;
+}
+
+CiphertextOverlay* create_overlay(void) {
+    CiphertextOverlay* overlay = (CiphertextOverlay*)calloc(1, sizeof(CiphertextOverlay));
+    if (!overlay) {
+        return NULL;
+    }
+
+    overlay->buckets = (OverlayEntry**)calloc(OVERLAY_INITIAL_BUCKETS, sizeof(OverlayEntry*));
+    if (!overlay->buckets) {
+        free(overlay);
+        return NULL;
+    }
+    pthread_mutex_init(&overlay->lock, NULL);
+    overlay->bucket_count = OVERLAY_INITIAL_BUCKETS;
+    return overlay;
+}
+
+// Drop every entry
+void overlay_clear(CiphertextOverlay* overlay) {
+    if (!overlay) {
+        return;
+    }
+
+    pthread_mutex_lock(&overlay->lock);
+    for (size_t i = 0; i < overlay->bucket_count; i++) {
+        OverlayEntry* entry = overlay->buckets[i];
+        while (entry) {
+            OverlayEntry* next = entry->next;
+            free_encrypted_data(entry->encrypted);
+            free(entry);
+            entry = next;
+        }
+        overlay->buckets[i] = NULL;
+    }
+    overlay->entry_count = 0;
+    pthread_mutex_unlock(&overlay->lock);
+}
+
+void free_overlay(CiphertextOverlay* overlay) {
+    if (!overlay) {
+        return;
+    }
+
+    overlay_clear(overlay);
+    pthread_mutex_destroy(&overlay->lock);
+    free(overlay->buckets);
+    free(overlay);
+}
+
+static OverlayEntry* find_entry(const CiphertextOverlay* overlay, TxRef ref) {
+    OverlayEntry* entry = overlay->buckets[hash_ref(ref) & (overlay->bucket_count - 1)];
+    while (entry && !same_ref(entry->ref, ref)) {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+// Double the bucket array once there are more entries than buckets
+static void grow_buckets(CiphertextOverlay* overlay) {
+    size_t bucket_count = overlay->bucket_count * 2;
+    OverlayEntry** buckets = (OverlayEntry**)calloc(bucket_count, sizeof(OverlayEntry*));
+    if (!buckets) {
+        return;  // Keep the current, slower table
+    }
+
+    for (size_t i = 0; i < overlay->bucket_count; i++) {
+        OverlayEntry* entry = overlay->buckets[i];
+        while (entry) {
+            OverlayEntry* next = entry->next;
+            size_t bucket = hash_ref(entry->ref) & (bucket_count - 1);
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    free(overlay->buckets);
+    overlay->buckets = buckets;
+    overlay->bucket_count = bucket_count;
+}
+
+// Make `encrypted` the ciphertext of `ref`, freeing any it replaces. The
+// overlay owns `encrypted` on success.
+int overlay_put(CiphertextOverlay* overlay, TxRef ref, EncryptedData* encrypted) {
+    if (!overlay || !encrypted) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&overlay->lock);
+    OverlayEntry* entry = find_entry(overlay, ref);
+    if (entry) {
+        free_encrypted_data(entry->encrypted);
+        entry->encrypted = encrypted;
+        pthread_mutex_unlock(&overlay->lock);
+        return 1;
+    }
+
+    entry = (OverlayEntry*)malloc(sizeof(OverlayEntry));
+    if (!entry) {
+        pthread_mutex_unlock(&overlay->lock);
+        return 0;
+    }
+    if (overlay->entry_count >= overlay->bucket_count) {
+        grow_buckets(overlay);
+    }
+    size_t bucket = hash_ref(ref) & (overlay->bucket_count - 1);
+    entry->ref = ref;
+    entry->encrypted = encrypted;
+    entry->next = overlay->buckets[bucket];
+    overlay->buckets[bucket] = entry;
+    overlay->entry_count++;
+    pthread_mutex_unlock(&overlay->lock);
+    return 1;
+}
+
+// Copy of the replacement ciphertext of `ref`, or NULL if it has none. A
+// copy stays valid however the overlay changes afterwards.
+EncryptedData* overlay_copy(CiphertextOverlay* overlay, TxRef ref) {
+    if (!overlay) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&overlay->lock);
+    OverlayEntry* entry = find_entry(overlay, ref);
+    EncryptedData* copy = entry ? copy_encrypted_data(entry->encrypted) : NULL;
+    pthread_mutex_unlock(&overlay->lock);
+    return copy;
+}
+
+size_t overlay_count(CiphertextOverlay* overlay) {
+    if (!overlay) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&overlay->lock);
+    size_t count = overlay->entry_count;
+    pthread_mutex_unlock(&overlay->lock);
+    return count;
+}
@@ -0,0 +1,37 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "index.h"
+#include "security.h"
+
+// Replacement ciphertexts of mined records, keyed by (block id, slot).
+// Blocks are never modified once mined, so re-encrypting a record puts
+// its new ciphertext here; readers prefer it to the block's, and saving
+// the chain writes it in the block's place.
+#define OVERLAY_INITIAL_BUCKETS 256  // Doubles as entries are added
+
+// One replaced record
+typedef struct OverlayEntry {
+    TxRef ref;
+    EncryptedData* encrypted;
+    struct OverlayEntry* next;       // Next entry in the same bucket
+} OverlayEntry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    OverlayEntry** buckets;
+    size_t bucket_count;
+    size_t entry_count;
+} CiphertextOverlay;
+
+// Function declarations. All are thread-safe.
+CiphertextOverlay* create_overlay(void);
+void free_overlay(CiphertextOverlay* overlay);
+void overlay_clear(CiphertextOverlay* overlay);
+int overlay_put(CiphertextOverlay* overlay, TxRef ref, EncryptedData* encrypted);
+EncryptedData* overlay_copy(CiphertextOverlay* overlay, TxRef ref);
+size_t overlay_count(CiphertextOverlay* overlay);
+
+#endif // OVERLAY_H
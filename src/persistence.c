@@ -6,28 +6,487 @@
 #include "persistence.h"
 #include "block.h"
 #include "blockchain.h"
+#include "dictionary.h"
+
+// Fixed properties of older block record formats
+#define FORMAT1_MAX_TRANSACTIONS 10
+#define FORMAT2_BLOOM_BYTES 128
+#define FORMAT3_ID_BYTES 32        // Patient ids and record types were stored as text
+
+// String ids of a file mapped to ids of this process. Files before
+// format 4 have no dictionary (count 0).
+typedef struct {
+    StringId* ids;
+    uint32_t count;
+} FileDictionary;
+
+// Write every interned string, in id order, as a length byte and the text
+static void write_dictionary(FILE* file) {
+    uint32_t count = dictionary_size();
+    fwrite(&count, sizeof(uint32_t), 1, file);
+    for (StringId id = 1; id < count; id++) {
+        const char* str = string_for_id(id);
+        unsigned char len = (unsigned char)strlen(str);
+        fwrite(&len, 1, 1, file);
+        fwrite(str, 1, len, file);
+    }
+}
+
+// Read a dictionary, interning its strings
+static int read_dictionary(FileDictionary* dictionary, FILE* file) {
+    uint32_t count;
+    if (fread(&count, sizeof(uint32_t), 1, file) != 1 || count == 0 ||
+        count > (uint32_t)DICTIONARY_MAX_CHUNKS * DICTIONARY_CHUNK_STRINGS) {
+        return 0;
+    }
+
+    StringId* ids = (StringId*)malloc(sizeof(StringId) * count);
+    if (!ids) {
+        return 0;
+    }
+    ids[0] = STRING_ID_NONE;
+    for (uint32_t i = 1; i < count; i++) {
+        char str[DICTIONARY_STRING_SIZE];
+        unsigned char len;
+        if (fread(&len, 1, 1, file) != 1 || len == 0 || len >= DICTIONARY_STRING_SIZE ||
+            fread(str, 1, len, file) != len) {
+            free(ids);
+            return 0;
+        }
+        str[len] = '\0';
+        if ((ids[i] = intern_string(str)) == STRING_ID_NONE) {
+            free(ids);
+            return 0;
+        }
+    }
+
+    dictionary->ids = ids;
+    dictionary->count = count;
+    return 1;
+}
+
+static void free_dictionary(FileDictionary* dictionary) {
+    free(dictionary->ids);
+    dictionary->ids = NULL;
+    dictionary->count = 0;
+}
+
+// Write blockchain metadata
+static void write_metadata(const Blockchain* chain, FILE* file) {
+    fwrite(&chain->block_count, sizeof(uint32_t), 1, file);
+    fwrite(&chain->difficulty, sizeof(int), 1, file);
+    fwrite(&chain->retarget_interval, sizeof(uint32_t), 1, file);
+    fwrite(&chain->target_block_time, sizeof(uint32_t), 1, file);
+    fwrite(&chain->verified_height, sizeof(uint32_t), 1, file);
+    fwrite(chain->verified_hash, sizeof(char), HASH_SIZE + 1, file);
+
+    uint32_t block_format = BLOCK_FORMAT_VERSION;
+    fwrite(&block_format, sizeof(uint32_t), 1, file);
+    fwrite(&chain->max_block_transactions, sizeof(uint32_t), 1, file);
+    fwrite(&chain->max_block_bytes, sizeof(uint32_t), 1, file);
+    write_dictionary(file);
+}
+
+// Read blockchain metadata; fields missing from older files keep their defaults.
+// The stored block count, block record format and dictionary are returned
+// separately; the caller frees the dictionary.
+static int read_metadata(Blockchain* chain, FILE* file, uint32_t* block_count, uint32_t* block_format,
+                         FileDictionary* dictionary) {
+    dictionary->ids = NULL;
+    dictionary->count = 0;
+
+    int difficulty;
+    if (fread(block_count, sizeof(uint32_t), 1, file) != 1 ||
+        fread(&difficulty, sizeof(int), 1, file) != 1) {
+        return 0;
+    }
+
+    // Files from before difficulty retargeting count leading hex zeros, 4 bits each
+    uint32_t retarget_interval, target_block_time;
+    if (fread(&retarget_interval, sizeof(uint32_t), 1, file) == 1 &&
+        fread(&target_block_time, sizeof(uint32_t), 1, file) == 1) {
+        chain->retarget_interval = retarget_interval;
+        chain->target_block_time = target_block_time;
+    } else if (difficulty > 0 && difficulty <= MAX_DIFFICULTY / 4) {
+        difficulty *= 4;
+    }
+    if (difficulty < MIN_DIFFICULTY) {
+        difficulty = MIN_DIFFICULTY;
+    } else if (difficulty > MAX_DIFFICULTY) {
+        difficulty = MAX_DIFFICULTY;
+    }
+    chain->difficulty = difficulty;
+
+    uint32_t verified_height;
+    char verified_hash[HASH_SIZE + 1];
+    if (fread(&verified_height, sizeof(uint32_t), 1, file) == 1 &&
+        fread(verified_hash, sizeof(char), HASH_SIZE + 1, file) == HASH_SIZE + 1) {
+        verified_hash[HASH_SIZE] = '\0';
+        chain->verified_height = verified_height;
+        memcpy(chain->verified_hash, verified_hash, HASH_SIZE + 1);
+    } else {
+        chain->verified_hash[0] = '\0';
+    }
+
+    if (fread(block_format, sizeof(uint32_t), 1, file) != 1) {
+        *block_format = 1;
+    }
+
+    uint32_t max_block_transactions, max_block_bytes;
+    if (fread(&max_block_transactions, sizeof(uint32_t), 1, file) == 1 &&
+        fread(&max_block_bytes, sizeof(uint32_t), 1, file) == 1) {
+        chain->max_block_transactions = max_block_transactions;
+        chain->max_block_bytes = max_block_bytes;
+    }
+    return *block_format < 4 || read_dictionary(dictionary, file);
+}
 
 // Save blockchain metadata
 static int save_metadata(const Blockchain* chain) {
     FILE* file = fopen(BLOCKCHAIN_META_FILE, "wb");
     if (!file) return 0;
 
-    // Write metadata
-    fwrite(&chain->block_count, sizeof(uint32_t), 1, file);
-    fwrite(&chain->difficulty, sizeof(int), 1, file);
+    write_metadata(chain, file);
     fclose(file);
     return 1;
 }
 
 // Load blockchain metadata
-static int load_metadata(Blockchain* chain) {
+static int load_metadata(Blockchain* chain, uint32_t* block_count, uint32_t* block_format,
+                         FileDictionary* dictionary) {
     FILE* file = fopen(BLOCKCHAIN_META_FILE, "rb");
     if (!file) return 0;
 
-    // Read metadata
-    fread(&chain->block_count, sizeof(uint32_t), 1, file);
-    fread(&chain->difficulty, sizeof(int), 1, file);
+    int result = read_metadata(chain, file, block_count, block_format, dictionary);
     fclose(file);
+    return result;
+}
+
+// Write one transaction, including its ciphertext
+static void write_transaction(const Transaction* transaction, FILE* file) {
+    fwrite(&transaction->patient_id, sizeof(StringId), 1, file);
+    fwrite(&transaction->record_type, sizeof(StringId), 1, file);
+    fwrite(&transaction->timestamp, sizeof(time_t), 1, file);
+
+    const EncryptedData* encrypted = transaction->encrypted_data;
+    uint32_t data_len = encrypted ? (uint32_t)encrypted->data_len : 0;
+    uint8_t cipher = encrypted ? encrypted->cipher : CIPHER_AES_256_GCM;
+    uint8_t key_scheme = encrypted ? encrypted->key_scheme : KEY_SCHEME_SHARED;
+    uint32_t key_id = encrypted ? encrypted->key_id : 0;
+    unsigned char zeros[AES_IV_SIZE + AES_GCM_TAG_SIZE] = {0};
+    fwrite(&cipher, 1, 1, file);
+    fwrite(&key_scheme, 1, 1, file);
+    fwrite(&key_id, sizeof(uint32_t), 1, file);
+    fwrite(encrypted ? encrypted->iv : zeros, 1, AES_IV_SIZE, file);
+    fwrite(encrypted ? encrypted->tag : zeros, 1, AES_GCM_TAG_SIZE, file);
+    fwrite(&data_len, sizeof(uint32_t), 1, file);
+    if (data_len > 0) {
+        fwrite(encrypted->data, 1, data_len, file);
+    }
+}
+
+// Read a transaction's patient id and record type as ids of this process
+static int read_transaction_ids(Transaction* transaction, FILE* file, const FileDictionary* dictionary) {
+    if (dictionary->count == 0) {
+        char patient_id[FORMAT3_ID_BYTES];
+        char record_type[FORMAT3_ID_BYTES];
+        if (fread(patient_id, 1, FORMAT3_ID_BYTES, file) != FORMAT3_ID_BYTES ||
+            fread(record_type, 1, FORMAT3_ID_BYTES, file) != FORMAT3_ID_BYTES) {
+            return 0;
+        }
+        patient_id[FORMAT3_ID_BYTES - 1] = '\0';
+        record_type[FORMAT3_ID_BYTES - 1] = '\0';
+        transaction->patient_id = intern_string(patient_id);
+        transaction->record_type = intern_string(record_type);
+        return 1;
+    }
+
+    StringId ids[2];
+    if (fread(ids, sizeof(StringId), 2, file) != 2 || ids[0] >= dictionary->count || ids[1] >= dictionary->count) {
+        return 0;
+    }
+    transaction->patient_id = dictionary->ids[ids[0]];
+    transaction->record_type = dictionary->ids[ids[1]];
+    return 1;
+}
+
+// Read one transaction; the caller owns its encrypted data. Records
+// before format 5 carry no cipher id or tag and are all CBC, records
+// before format 6 all use the shared key, and patient-key records before
+// format 7 all use master key 1.
+static int read_transaction(Transaction* transaction, FILE* file, uint32_t block_format,
+                            const FileDictionary* dictionary) {
+    uint32_t data_len;
+    uint8_t cipher = CIPHER_AES_256_CBC;
+    uint8_t key_scheme = KEY_SCHEME_SHARED;
+    uint32_t key_id = 0;
+    unsigned char iv[AES_IV_SIZE];
+    unsigned char tag[AES_GCM_TAG_SIZE] = {0};
+
+    if (!read_transaction_ids(transaction, file, dictionary) ||
+        fread(&transaction->timestamp, sizeof(time_t), 1, file) != 1 ||
+        (block_format >= 5 && fread(&cipher, 1, 1, file) != 1) ||
+        (block_format >= 6 && fread(&key_scheme, 1, 1, file) != 1) ||
+        (block_format >= 7 && fread(&key_id, sizeof(uint32_t), 1, file) != 1) ||
+        fread(iv, 1, AES_IV_SIZE, file) != AES_IV_SIZE ||
+        (block_format >= 5 && fread(tag, 1, AES_GCM_TAG_SIZE, file) != AES_GCM_TAG_SIZE) ||
+        fread(&data_len, sizeof(uint32_t), 1, file) != 1 ||
+        (cipher != CIPHER_AES_256_CBC && cipher != CIPHER_AES_256_GCM) ||
+        (key_scheme != KEY_SCHEME_SHARED && key_scheme != KEY_SCHEME_PATIENT)) {
+        return 0;
+    }
+    transaction->encrypted_data = NULL;
+    if (block_format < 7 && key_scheme == KEY_SCHEME_PATIENT) {
+        key_id = 1;
+    }
+
+    if (data_len == 0) {
+        return 1;
+    }
+
+    EncryptedData* encrypted = alloc_encrypted_data(data_len);
+    if (!encrypted) return 0;
+    if (fread(encrypted->data, 1, data_len, file) != data_len) {
+        free_encrypted_data(encrypted);
+        return 0;
+    }
+    memcpy(encrypted->iv, iv, AES_IV_SIZE);
+    memcpy(encrypted->tag, tag, AES_GCM_TAG_SIZE);
+    encrypted->cipher = cipher;
+    encrypted->key_scheme = key_scheme;
+    encrypted->key_id = key_id;
+    transaction->encrypted_data = encrypted;
+    return 1;
+}
+
+// Write one block record. The Bloom filter and the size of the
+// transactions follow the header so a scan can skip the block unread.
+// Records with a re-encrypted ciphertext in `overlay` are written with it.
+static void write_block(const Block* block, CiphertextOverlay* overlay, FILE* file) {
+    // Replacements are taken up front since they change the body size
+    size_t replaced_count = overlay_count(overlay) > 0 ? (size_t)block->transaction_count : 0;
+    EncryptedData** replaced = replaced_count ? (EncryptedData**)calloc(replaced_count, sizeof(EncryptedData*)) : NULL;
+    uint32_t payload_bytes = block->payload_bytes;
+    for (size_t i = 0; replaced && i < replaced_count; i++) {
+        TxRef ref = {block->id, (int)i};
+        replaced[i] = overlay_copy(overlay, ref);
+        if (replaced[i]) {
+            Transaction transaction = block->transactions[i];
+            payload_bytes -= transaction_size(&transaction);
+            transaction.encrypted_data = replaced[i];
+            payload_bytes += transaction_size(&transaction);
+        }
+    }
+
+    fwrite(&block->id, sizeof(uint32_t), 1, file);
+    fwrite(&block->timestamp, sizeof(time_t), 1, file);
+    fwrite(block->previous_hash, sizeof(char), HASH_SIZE + 1, file);
+    fwrite(block->hash, sizeof(char), HASH_SIZE + 1, file);
+    fwrite(&block->nonce, sizeof(uint32_t), 1, file);
+    fwrite(block->merkle_root, 1, HASH_BYTES, file);
+    fwrite(&block->transaction_count, sizeof(int), 1, file);
+
+    fwrite(&block->bloom_bytes, sizeof(uint32_t), 1, file);
+    fwrite(block->bloom, 1, block->bloom_bytes, file);
+    fwrite(&payload_bytes, sizeof(uint32_t), 1, file);
+
+    for (int i = 0; i < block->transaction_count; i++) {
+        if (replaced && replaced[i]) {
+            Transaction transaction = block->transactions[i];
+            transaction.encrypted_data = replaced[i];
+            write_transaction(&transaction, file);
+            free_encrypted_data(replaced[i]);
+        } else {
+            write_transaction(&block->transactions[i], file);
+        }
+    }
+    free(replaced);
+}
+
+// Bytes of a current transaction record's fixed part that an older
+// format lacks: the cipher id and tag (format 5), the key scheme (6) and
+// the key id (7)
+static uint32_t missing_record_bytes(uint32_t block_format) {
+    uint32_t missing = 0;
+    if (block_format < 5) {
+        missing += 1 + AES_GCM_TAG_SIZE;
+    }
+    if (block_format < 6) {
+        missing += 1;
+    }
+    if (block_format < 7) {
+        missing += sizeof(uint32_t);
+    }
+    return missing;
+}
+
+// Read everything before a block's transactions. Format 1 records have no
+// Bloom filter or body size (body_size is then 0), and format 2 filters
+// are always FORMAT2_BLOOM_BYTES long.
+static int read_block_header(Block* block, FILE* file, uint32_t block_format,
+                             int* transaction_count, uint32_t* body_size) {
+    if (fread(&block->id, sizeof(uint32_t), 1, file) != 1 ||
+        fread(&block->timestamp, sizeof(time_t), 1, file) != 1 ||
+        fread(block->previous_hash, sizeof(char), HASH_SIZE + 1, file) != HASH_SIZE + 1 ||
+        fread(block->hash, sizeof(char), HASH_SIZE + 1, file) != HASH_SIZE + 1 ||
+        fread(&block->nonce, sizeof(uint32_t), 1, file) != 1 ||
+        fread(block->merkle_root, 1, HASH_BYTES, file) != HASH_BYTES ||
+        fread(transaction_count, sizeof(int), 1, file) != 1 || *transaction_count < 0) {
+        return 0;
+    }
+    block->previous_hash[HASH_SIZE] = '\0';
+    block->hash[HASH_SIZE] = '\0';
+
+    *body_size = 0;
+    if (block_format < 2) {
+        return *transaction_count <= FORMAT1_MAX_TRANSACTIONS;
+    }
+
+    uint32_t bloom_bytes = FORMAT2_BLOOM_BYTES;
+    if ((block_format >= 3 && fread(&bloom_bytes, sizeof(uint32_t), 1, file) != 1) ||
+        !resize_block_bloom(block, bloom_bytes) ||
+        fread(block->bloom, 1, bloom_bytes, file) != bloom_bytes ||
+        fread(body_size, sizeof(uint32_t), 1, file) != 1) {
+        return 0;
+    }
+
+    // Every transaction record has a fixed part, which bounds the count
+    Transaction empty = {0};
+    uint32_t fixed_bytes = transaction_size(&empty) - missing_record_bytes(block_format);
+    return (uint64_t)*transaction_count * fixed_bytes <= *body_size;
+}
+
+// Read one block record into a new block; NULL on a short or corrupt read
+static Block* read_block(FILE* file, uint32_t block_format, const FileDictionary* dictionary) {
+    Block* block = create_block(0, NULL);
+    if (!block) return NULL;
+
+    int transaction_count;
+    uint32_t body_size;
+    if (!read_block_header(block, file, block_format, &transaction_count, &body_size)) {
+        free_block(block);
+        return NULL;
+    }
+
+    // Limits apply to blocks being filled, not to ones already sealed
+    uint32_t stored_bloom_bytes = block->bloom_bytes;
+    block->max_transactions = UINT32_MAX;
+    block->max_bytes = UINT32_MAX;
+    if (!reserve_transactions(block, transaction_count)) {
+        free_block(block);
+        return NULL;
+    }
+
+    for (int i = 0; i < transaction_count; i++) {
+        if (!read_transaction(&block->transactions[i], file, block_format, dictionary)) {
+            free_block(block);
+            return NULL;
+        }
+        block->transaction_count++;
+        block->payload_bytes += transaction_size(&block->transactions[i]);
+    }
+
+    // A filter that was missing, or resized while reserving, is recomputed
+    if (block_format < 2 || block->bloom_bytes != stored_bloom_bytes) {
+        rebuild_block_bloom(block);
+    }
+    return block;
+}
+
+// Write every block of the chain, with its re-encrypted records
+static void write_blocks(const Blockchain* chain, FILE* file) {
+    for (uint32_t i = 0; i < chain->block_count; i++) {
+        write_block(chain->blocks[i], chain->overlay, file);
+    }
+}
+
+static void free_block_list(Block* genesis) {
+    while (genesis) {
+        Block* next = genesis->next;
+        free_block(genesis);
+        genesis = next;
+    }
+}
+
+// Read block_count blocks and install them as the chain's blocks
+static int read_blocks(Blockchain* chain, FILE* file, uint32_t block_count, uint32_t block_format,
+                       const FileDictionary* dictionary) {
+    Block* genesis = NULL;
+    Block* previous = NULL;
+    for (uint32_t i = 0; i < block_count; i++) {
+        Block* block = read_block(file, block_format, dictionary);
+        if (!block) {
+            free_block_list(genesis);
+            return 0;
+        }
+
+        // Link blocks
+        if (previous) {
+            previous->next = block;
+        } else {
+            genesis = block;
+        }
+        previous = block;
+    }
+
+    if (!replace_blocks(chain, genesis)) {
+        free_block_list(genesis);
+        return 0;
+    }
+    return 1;
+}
+
+// Write the urgent record types, then pending transactions in mining order.
+// The transactions use the block record format of the same save.
+static void write_mempool(const Mempool* mempool, FILE* file) {
+    uint32_t urgent_type_count = (uint32_t)mempool->urgent_type_count;
+    fwrite(&urgent_type_count, sizeof(uint32_t), 1, file);
+    for (uint32_t i = 0; i < urgent_type_count; i++) {
+        char urgent_type[FORMAT3_ID_BYTES] = {0};
+        strncpy(urgent_type, string_for_id(mempool->urgent_types[i]), sizeof(urgent_type) - 1);
+        fwrite(urgent_type, 1, sizeof(urgent_type), file);
+    }
+
+    uint32_t count = (uint32_t)mempool_count(mempool);
+    fwrite(&count, sizeof(uint32_t), 1, file);
+    for (int p = 0; p < MEMPOOL_PRIORITIES; p++) {
+        const Transaction* transaction;
+        for (size_t i = 0; (transaction = mempool_at(mempool, p, i)) != NULL; i++) {
+            write_transaction(transaction, file);
+        }
+    }
+}
+
+// Read pending transactions into the mempool; on a corrupt file the
+// transactions read so far are kept
+static int read_mempool(Mempool* mempool, FILE* file, uint32_t block_format, const FileDictionary* dictionary) {
+    uint32_t urgent_type_count;
+    char urgent_types[MEMPOOL_MAX_URGENT_TYPES][FORMAT3_ID_BYTES];
+    if (fread(&urgent_type_count, sizeof(uint32_t), 1, file) != 1 ||
+        urgent_type_count > MEMPOOL_MAX_URGENT_TYPES ||
+        fread(urgent_types, sizeof(urgent_types[0]), urgent_type_count, file) != urgent_type_count) {
+        return 0;
+    }
+    mempool->urgent_type_count = 0;
+    for (uint32_t i = 0; i < urgent_type_count; i++) {
+        urgent_types[i][FORMAT3_ID_BYTES - 1] = '\0';
+        mempool_add_urgent_type(mempool, urgent_types[i]);
+    }
+
+    uint32_t count;
+    if (fread(&count, sizeof(uint32_t), 1, file) != 1) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        Transaction transaction;
+        if (!read_transaction(&transaction, file, block_format, dictionary)) {
+            return 0;
+        }
+        if (!mempool_add(mempool, &transaction)) {
+            free_encrypted_data(transaction.encrypted_data);
+            return 0;
+        }
+    }
     return 1;
 }
 
@@ -41,35 +500,14 @@ int save_blockchain(const Blockchain* chain) {
     FILE* file = fopen(BLOCKCHAIN_FILE, "wb");
     if (!file) return 0;
 
-    // Write each block
-    Block* current = chain->genesis;
-    while (current) {
-        // Write block ID
-        fwrite(&current->id, sizeof(uint32_t), 1, file);
-        
-        // Write timestamp
-        fwrite(&current->timestamp, sizeof(time_t), 1, file);
-        
-        // Write previous hash
-        fwrite(current->previous_hash, sizeof(char), HASH_SIZE + 1, file);
-        
-        // Write current hash
-        fwrite(current->hash, sizeof(char), HASH_SIZE + 1, file);
-        
-        // Write nonce
-        fwrite(&current->nonce, sizeof(uint32_t), 1, file);
-        
-        // Write transaction count
-        fwrite(&current->transaction_count, sizeof(int), 1, file);
-        
-        // Write transactions
-        for (int i = 0; i < current->transaction_count; i++) {
-            fwrite(&current->transactions[i], sizeof(Transaction), 1, file);
-        }
-        
-        current = current->next;
-    }
+    write_blocks(chain, file);
+    fclose(file);
+
+    // Pending transactions survive restarts
+    file = fopen(MEMPOOL_FILE, "wb");
+    if (!file) return 0;
 
+    write_mempool(&chain->mempool, file);
     fclose(file);
     return 1;
 }
@@ -80,60 +518,37 @@ Blockchain* load_blockchain(void) {
     if (!chain) return NULL;
 
     // Load metadata
-    if (!load_metadata(chain)) {
+    uint32_t block_count, block_format;
+    FileDictionary dictionary;
+    if (!load_metadata(chain, &block_count, &block_format, &dictionary)) {
         free_blockchain(chain);
         return NULL;
     }
 
     FILE* file = fopen(BLOCKCHAIN_FILE, "rb");
     if (!file) {
+        free_dictionary(&dictionary);
         free_blockchain(chain);
         return NULL;
     }
 
-    Block* previous = NULL;
-    for (uint32_t i = 0; i < chain->block_count; i++) {
-        Block* block = create_block(i, previous ? previous->hash : "");
-        if (!block) {
-            fclose(file);
-            free_blockchain(chain);
-            return NULL;
-        }
-
-        // Read block ID
-        fread(&block->id, sizeof(uint32_t), 1, file);
-        
-        // Read timestamp
-        fread(&block->timestamp, sizeof(time_t), 1, file);
-        
-        // Read previous hash
-        fread(block->previous_hash, sizeof(char), HASH_SIZE + 1, file);
-        
-        // Read current hash
-        fread(block->hash, sizeof(char), HASH_SIZE + 1, file);
-        
-        // Read nonce
-        fread(&block->nonce, sizeof(uint32_t), 1, file);
-        
-        // Read transaction count
-        fread(&block->transaction_count, sizeof(int), 1, file);
-        
-        // Read transactions
-        for (int j = 0; j < block->transaction_count; j++) {
-            fread(&block->transactions[j], sizeof(Transaction), 1, file);
-        }
+    if (!read_blocks(chain, file, block_count, block_format, &dictionary)) {
+        fclose(file);
+        free_dictionary(&dictionary);
+        free_blockchain(chain);
+        return NULL;
+    }
+    fclose(file);
 
-        // Link blocks
-        if (previous) {
-            previous->next = block;
-        } else {
-            chain->genesis = block;
+    // A missing mempool file (older saves) just means nothing is pending
+    file = fopen(MEMPOOL_FILE, "rb");
+    if (file) {
+        if (!read_mempool(&chain->mempool, file, block_format, &dictionary)) {
+            fprintf(stderr, "Warning: %s is damaged; some pending transactions were lost\n", MEMPOOL_FILE);
         }
-        previous = block;
+        fclose(file);
     }
-
-    chain->latest = previous;
-    fclose(file);
+    free_dictionary(&dictionary);
     return chain;
 }
 
@@ -158,27 +573,11 @@ int backup_blockchain(const Blockchain* chain) {
     }
 
     // Write metadata
-    fwrite(&chain->block_count, sizeof(uint32_t), 1, meta_file);
-    fwrite(&chain->difficulty, sizeof(int), 1, meta_file);
+    write_metadata(chain, meta_file);
     fclose(meta_file);
 
     // Write blockchain data
-    Block* current = chain->genesis;
-    while (current) {
-        fwrite(&current->id, sizeof(uint32_t), 1, file);
-        fwrite(&current->timestamp, sizeof(time_t), 1, file);
-        fwrite(current->previous_hash, sizeof(char), HASH_SIZE + 1, file);
-        fwrite(current->hash, sizeof(char), HASH_SIZE + 1, file);
-        fwrite(&current->nonce, sizeof(uint32_t), 1, file);
-        fwrite(&current->transaction_count, sizeof(int), 1, file);
-        
-        for (int i = 0; i < current->transaction_count; i++) {
-            fwrite(&current->transactions[i], sizeof(Transaction), 1, file);
-        }
-        
-        current = current->next;
-    }
-
+    write_blocks(chain, file);
     fclose(file);
     return 1;
 }
@@ -219,50 +618,103 @@ int restore_blockchain(Blockchain* chain) {
         return 0;
     }
 
-    // Read metadata
-    fread(&chain->block_count, sizeof(uint32_t), 1, meta_file);
-    fread(&chain->difficulty, sizeof(int), 1, meta_file);
+    // Read metadata into a scratch copy so a bad backup leaves the chain untouched
+    Blockchain restored = *chain;
+    uint32_t block_count, block_format;
+    FileDictionary dictionary;
+    if (!read_metadata(&restored, meta_file, &block_count, &block_format, &dictionary)) {
+        fclose(meta_file);
+        fclose(file);
+        return 0;
+    }
     fclose(meta_file);
 
-    // Clear existing blockchain
-    Block* current = chain->genesis;
-    while (current) {
-        Block* next = current->next;
-        free(current);
-        current = next;
+    // Read blockchain data; the live blocks are only replaced on success
+    int result = read_blocks(&restored, file, block_count, block_format, &dictionary);
+    if (result) {
+        *chain = restored;
     }
-    chain->genesis = NULL;
-    chain->latest = NULL;
+    free_dictionary(&dictionary);
+    fclose(file);
+    return result;
+}
 
-    // Read blockchain data
-    Block* previous = NULL;
-    for (uint32_t i = 0; i < chain->block_count; i++) {
-        Block* block = create_block(i, previous ? previous->hash : "");
-        if (!block) {
-            fclose(file);
-            return 0;
+// Scan the saved chain for transactions matching the given keys (NULL
+// matches anything) without loading it. Blocks whose Bloom filter rules
+// out the keys are skipped without reading their transactions.
+int scan_saved_blockchain(const char* patient_id, const char* record_type,
+                          SavedTransactionVisitor visit, void* context, ScanStats* stats) {
+    ScanStats counts = {0, 0, 0};
+    Blockchain metadata;
+    memset(&metadata, 0, sizeof(metadata));
+
+    uint32_t block_count, block_format;
+    FileDictionary dictionary;
+    if (!load_metadata(&metadata, &block_count, &block_format, &dictionary)) return 0;
+
+    FILE* file = fopen(BLOCKCHAIN_FILE, "rb");
+    Block* block = file ? create_block(0, NULL) : NULL;
+    if (!block) {
+        if (file) fclose(file);
+        free_dictionary(&dictionary);
+        return 0;
+    }
+
+    // Keys are compared as ids. Older files intern their strings as they
+    // are read, so their keys are interned up front to have an id to match.
+    StringId (*key_id)(const char*) = dictionary.count > 0 ? find_string : intern_string;
+    StringId wanted_patient = patient_id ? key_id(patient_id) : STRING_ID_NONE;
+    StringId wanted_type = record_type ? key_id(record_type) : STRING_ID_NONE;
+
+    int result = 1;
+    int stopped = 0;
+    for (uint32_t i = 0; i < block_count && !stopped; i++) {
+        int transaction_count;
+        uint32_t body_size;
+        if (!read_block_header(block, file, block_format, &transaction_count, &body_size)) {
+            result = 0;
+            break;
         }
 
-        fread(&block->id, sizeof(uint32_t), 1, file);
-        fread(&block->timestamp, sizeof(time_t), 1, file);
-        fread(block->previous_hash, sizeof(char), HASH_SIZE + 1, file);
-        fread(block->hash, sizeof(char), HASH_SIZE + 1, file);
-        fread(&block->nonce, sizeof(uint32_t), 1, file);
-        fread(&block->transaction_count, sizeof(int), 1, file);
-        
-        for (int j = 0; j < block->transaction_count; j++) {
-            fread(&block->transactions[j], sizeof(Transaction), 1, file);
+        if (block_format >= 2 && !block_may_contain(block, patient_id, record_type)) {
+            counts.blocks_skipped++;
+            if (fseek(file, (long)body_size, SEEK_CUR) != 0) {
+                result = 0;
+                break;
+            }
+            continue;
         }
 
-        if (previous) {
-            previous->next = block;
-        } else {
-            chain->genesis = block;
+        counts.blocks_read++;
+        for (int slot = 0; slot < transaction_count; slot++) {
+            Transaction transaction;
+            if (!read_transaction(&transaction, file, block_format, &dictionary)) {
+                result = 0;
+                stopped = 1;
+                break;
+            }
+            int matches = (!patient_id || (wanted_patient != STRING_ID_NONE &&
+                                           transaction.patient_id == wanted_patient)) &&
+                          (!record_type || (wanted_type != STRING_ID_NONE &&
+                                            transaction.record_type == wanted_type));
+            if (matches) {
+                counts.matches++;
+                if (visit && !stopped && !visit(block->id, slot, &transaction, context)) {
+                    stopped = 1;
+                }
+            }
+            free_encrypted_data(transaction.encrypted_data);
+            if (stopped) {
+                break;
+            }
         }
-        previous = block;
     }
 
-    chain->latest = previous;
+    free_block(block);
     fclose(file);
-    return 1;
-} 
\ No newline at end of file
+    free_dictionary(&dictionary);
+    if (stats) {
+        *stats = counts;
+    }
+    return result;
+}
@@ -6,11 +6,34 @@
 // File paths for blockchain storage
 #define BLOCKCHAIN_FILE "blockchain.dat"
 #define BLOCKCHAIN_META_FILE "blockchain_meta.dat"
+#define MEMPOOL_FILE "mempool.dat"
+
+// Layout of block records in blockchain.dat: 1 = transactions follow the
+// header directly, 2 = a 128-byte Bloom filter and the transaction size
+// come first, 3 = as 2 but the filter is length-prefixed, 4 = as 3 but
+// transactions store dictionary ids, with the dictionary in the metadata,
+// 5 = as 4 but each transaction stores its cipher id and GCM tag,
+// 6 = as 5 plus each transaction's key scheme, 7 = as 6 plus each
+// transaction's master key id
+#define BLOCK_FORMAT_VERSION 7
+
+// Called for each matching transaction of a saved-chain scan; the
+// transaction is only valid during the call. Return 0 to stop the scan.
+typedef int (*SavedTransactionVisitor)(uint32_t block_id, int slot, const Transaction* transaction, void* context);
+
+// Work done by a saved-chain scan
+typedef struct {
+    uint32_t blocks_read;     // Blocks whose transactions were read
+    uint32_t blocks_skipped;  // Blocks ruled out by their Bloom filter
+    uint32_t matches;         // Matching transactions
+} ScanStats;
 
 // Function declarations
 int save_blockchain(const Blockchain* chain);
 Blockchain* load_blockchain(void);
 int backup_blockchain(const Blockchain* chain);
 int restore_blockchain(Blockchain* chain);
+int scan_saved_blockchain(const char* patient_id, const char* record_type,
+                          SavedTransactionVisitor visit, void* context, ScanStats* stats);
 
 #endif // PERSISTENCE_H 
\ No newline at end of file
@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "pool.h"
+
+#define POOL_LARGE_CLASS -1
+#define POOL_EMPTY_SLABS_KEPT 1  // Empty slabs a class keeps for reuse before returning them
+
+// Header at the start of every slab. A large object gets a region of its
+// own with the same header, so pool_free() treats both alike.
+typedef struct Slab {
+    struct Slab* prev;          // Neighbours in the class's list of slabs with room
+    struct Slab* next;
+    void* free_list;            // Freed objects, linked through their first word
+    size_t bytes;               // Size of the whole region
+    uint32_t object_size;
+    uint32_t capacity;          // Objects that fit in the slab
+    uint32_t carved;            // Objects handed out at least once; the rest are untouched
+    uint32_t live;
+    int size_class;             // POOL_LARGE_CLASS for a single large object
+} Slab;
+
+_Static_assert(sizeof(Slab) <= POOL_HEADER_BYTES, "slab header does not fit");
+
+typedef struct {
+    pthread_mutex_t lock;
+    Slab* partial;              // Slabs with at least one free object
+    size_t empty_slabs;         // Slabs in `partial` with no live object
+    size_t slabs;
+    size_t live_objects;
+} SizeClass;
+
+static SizeClass classes[POOL_CLASS_COUNT];
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static atomic_size_t large_objects;
+static atomic_size_t large_bytes;
+
+static void pool_init(void) {
+    for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+        pthread_mutex_init(&classes[i].lock, NULL);
+    }
+}
+
+static Slab* slab_of(const void* ptr) {
+    return (Slab*)((uintptr_t)ptr & ~(uintptr_t)(POOL_SLAB_BYTES - 1));
+}
+
+static int class_for(size_t size) {
+    int size_class = 0;
+    size_t object_size = POOL_MIN_OBJECT_BYTES;
+    while (object_size < size) {
+        object_size *= 2;
+        size_class++;
+    }
+    return size_class;
+}
+
+static void unlink_slab(SizeClass* size_class, Slab* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        size_class->partial = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = NULL;
+    slab->next = NULL;
+}
+
+static void push_slab(SizeClass* size_class, Slab* slab) {
+    slab->prev = NULL;
+    slab->next = size_class->partial;
+    if (size_class->partial) {
+        size_class->partial->prev = slab;
+    }
+    size_class->partial = slab;
+}
+
+static void* alloc_large(size_t size) {
+    size_t bytes = (POOL_HEADER_BYTES + size + POOL_SLAB_BYTES - 1) / POOL_SLAB_BYTES * POOL_SLAB_BYTES;
+    Slab* slab = (Slab*)aligned_alloc(POOL_SLAB_BYTES, bytes);
+    if (!slab) {
+        return NULL;
+    }
+
+    memset(slab, 0, sizeof(Slab));
+    slab->bytes = bytes;
+    slab->size_class = POOL_LARGE_CLASS;
+    atomic_fetch_add(&large_objects, 1);
+    atomic_fetch_add(&large_bytes, bytes);
+    return (unsigned char*)slab + POOL_HEADER_BYTES;
+}
+
+static void free_large(Slab* slab) {
+    atomic_fetch_sub(&large_objects, 1);
+    atomic_fetch_sub(&large_bytes, slab->bytes);
+    free(slab);
+}
+
+// Allocate one object of class `index`; the class lock is held
+static void* alloc_locked(SizeClass* size_class, int index) {
+    Slab* slab = size_class->partial;
+    if (!slab) {
+        slab = (Slab*)aligned_alloc(POOL_SLAB_BYTES, POOL_SLAB_BYTES);
+        if (!slab) {
+            return NULL;
+        }
+        memset(slab, 0, sizeof(Slab));
+        slab->bytes = POOL_SLAB_BYTES;
+        slab->object_size = (uint32_t)POOL_MIN_OBJECT_BYTES << index;
+        slab->capacity = (POOL_SLAB_BYTES - POOL_HEADER_BYTES) / slab->object_size;
+        slab->size_class = index;
+        push_slab(size_class, slab);
+        size_class->slabs++;
+        size_class->empty_slabs++;
+    }
+
+    // Reuse a freed object, else carve the next untouched one so a new
+    // slab is only paged in as it fills
+    void* object;
+    if (slab->free_list) {
+        object = slab->free_list;
+        slab->free_list = *(void**)object;
+    } else {
+        object = (unsigned char*)slab + POOL_HEADER_BYTES + (size_t)slab->carved * slab->object_size;
+        slab->carved++;
+    }
+
+    if (slab->live++ == 0) {
+        size_class->empty_slabs--;
+    }
+    if (!slab->free_list && slab->carved == slab->capacity) {
+        unlink_slab(size_class, slab);
+    }
+    size_class->live_objects++;
+    return object;
+}
+
+// Return one object to its slab; the class lock is held
+static void free_locked(SizeClass* size_class, Slab* slab, void* object) {
+    if (!slab->free_list && slab->carved == slab->capacity) {
+        push_slab(size_class, slab);  // Was full, has room again
+    }
+    *(void**)object = slab->free_list;
+    slab->free_list = object;
+    size_class->live_objects--;
+
+    if (--slab->live == 0) {
+        if (size_class->empty_slabs >= POOL_EMPTY_SLABS_KEPT) {
+            unlink_slab(size_class, slab);
+            size_class->slabs--;
+            free(slab);
+        } else {
+            size_class->empty_slabs++;
+        }
+    }
+}
+
+// Memory is 16-byte aligned. A size of zero still returns a unique object.
+void* pool_alloc(size_t size) {
+    pthread_once(&pool_once, pool_init);
+    if (size > POOL_MAX_OBJECT_BYTES) {
+        return alloc_large(size);
+    }
+
+    int index = class_for(size);
+    SizeClass* size_class = &classes[index];
+    pthread_mutex_lock(&size_class->lock);
+    void* object = alloc_locked(size_class, index);
+    pthread_mutex_unlock(&size_class->lock);
+    return object;
+}
+
+void* pool_calloc(size_t size) {
+    void* object = pool_alloc(size);
+    if (object) {
+        memset(object, 0, size);
+    }
+    return object;
+}
+
+// Like realloc(); shrinking, or growing within the object's size class,
+// keeps the object in place
+void* pool_realloc(void* ptr, size_t size) {
+    if (!ptr) {
+        return pool_alloc(size);
+    }
+
+    Slab* slab = slab_of(ptr);
+    size_t usable = slab->size_class == POOL_LARGE_CLASS ? slab->bytes - POOL_HEADER_BYTES : slab->object_size;
+    if (size <= usable) {
+        return ptr;
+    }
+
+    void* object = pool_alloc(size);
+    if (!object) {
+        return NULL;
+    }
+    memcpy(object, ptr, usable);
+    pool_free(ptr);
+    return object;
+}
+
+void pool_free(void* ptr) {
+    pool_free_batch(&ptr, 1);
+}
+
+// Free many objects at once. Runs of objects from the same size class
+// share one lock acquisition, so releasing a block's payloads costs a
+// handful of locks rather than one per ciphertext. NULL entries are skipped.
+void pool_free_batch(void** ptrs, size_t count) {
+    SizeClass* held = NULL;
+    for (size_t i = 0; i < count; i++) {
+        if (!ptrs[i]) {
+            continue;
+        }
+
+        Slab* slab = slab_of(ptrs[i]);
+        if (slab->size_class == POOL_LARGE_CLASS) {
+            free_large(slab);
+            continue;
+        }
+
+        SizeClass* size_class = &classes[slab->size_class];
+        if (size_class != held) {
+            if (held) {
+                pthread_mutex_unlock(&held->lock);
+            }
+            pthread_mutex_lock(&size_class->lock);
+            held = size_class;
+        }
+        free_locked(size_class, slab, ptrs[i]);
+    }
+    if (held) {
+        pthread_mutex_unlock(&held->lock);
+    }
+}
+
+// Return every cached empty slab to the system
+void pool_trim(void) {
+    pthread_once(&pool_once, pool_init);
+    for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+        SizeClass* size_class = &classes[i];
+        pthread_mutex_lock(&size_class->lock);
+        Slab* slab = size_class->partial;
+        while (slab) {
+            Slab* next = slab->next;
+            if (slab->live == 0) {
+                unlink_slab(size_class, slab);
+                size_class->slabs--;
+                size_class->empty_slabs--;
+                free(slab);
+            }
+            slab = next;
+        }
+        pthread_mutex_unlock(&size_class->lock);
+    }
+}
+
+void pool_stats(PoolStats* stats) {
+    if (!stats) {
+        return;
+    }
+
+    pthread_once(&pool_once, pool_init);
+    memset(stats, 0, sizeof(PoolStats));
+    for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+        SizeClass* size_class = &classes[i];
+        pthread_mutex_lock(&size_class->lock);
+        stats->slabs += size_class->slabs;
+        stats->live_objects += size_class->live_objects;
+        pthread_mutex_unlock(&size_class->lock);
+    }
+    stats->large_objects = atomic_load(&large_objects);
+    stats->live_objects += stats->large_objects;
+    stats->reserved_bytes = stats->slabs * POOL_SLAB_BYTES + atomic_load(&large_bytes);
+}
@@ -0,0 +1,35 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+// Slab allocator for the many small, similarly sized objects a chain is
+// made of: blocks, transaction arrays, Bloom filters and ciphertexts.
+// Objects are carved out of POOL_SLAB_BYTES slabs, one list of slabs per
+// power-of-two size class. Slabs are aligned to their size, so freeing
+// finds an object's slab (and size) by masking the pointer.
+#define POOL_SLAB_BYTES (64 * 1024)
+#define POOL_MIN_OBJECT_BYTES 32
+#define POOL_MAX_OBJECT_BYTES 8192          // Larger requests get a region of their own
+#define POOL_CLASS_COUNT 9                  // 32, 64, ..., 8192
+#define POOL_HEADER_BYTES 64                // Slab header, padded to a cache line
+#define POOL_FREE_BATCH 256                 // Pointers callers gather per pool_free_batch() call
+
+// Allocator counters, summed over all size classes
+typedef struct {
+    size_t slabs;                // Slabs currently held, including cached empty ones
+    size_t live_objects;         // Objects handed out and not yet freed
+    size_t large_objects;        // Live objects too big for a size class
+    size_t reserved_bytes;       // Memory held from the system
+} PoolStats;
+
+// Function declarations. All are thread-safe.
+void* pool_alloc(size_t size);
+void* pool_calloc(size_t size);
+void* pool_realloc(void* ptr, size_t size);
+void pool_free(void* ptr);
+void pool_free_batch(void** ptrs, size_t count);
+void pool_trim(void);
+void pool_stats(PoolStats* stats);
+
+#endif // POOL_H
@@ -0,0 +1,324 @@
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/crypto.h>
+#include "record_cache.h"
+
+static size_t hash_ref(TxRef ref) {
+    uint64_t key = ((uint64_t)ref.block_id << 32) | (uint32_t)ref.slot;
+    return (size_t)((key * 11400714819323198485ULL) >> 32);
+}
+
+static int same_ref(TxRef a, TxRef b) {
+    return a.block_id == b.block_id && a.slot == b.slot;
+}
+
+RecordCache* create_record_cache(size_t max_bytes, uint32_t ttl) {
+    if (max_bytes == 0 || max_bytes > RECORD_CACHE_MAX_BYTES || ttl > RECORD_CACHE_MAX_TTL) {
+        return NULL;
+    }
+
+    RecordCache* cache = (RecordCache*)calloc(1, sizeof(RecordCache));
+    if (!cache) {
+        return NULL;
+    }
+
+    cache->buckets = (CachedRecord**)calloc(RECORD_CACHE_INITIAL_BUCKETS, sizeof(CachedRecord*));
+    if (!cache->buckets) {
+        free(cache);
+        return NULL;
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->bucket_count = RECORD_CACHE_INITIAL_BUCKETS;
+    cache->max_bytes = max_bytes;
+    cache->ttl = ttl;
+    return cache;
+}
+
+// Wipe and free one entry already unlinked from its bucket and the LRU list
+static void destroy_entry(CachedRecord* entry) {
+    OPENSSL_cleanse(entry, entry->bytes);
+    free(entry);
+}
+
+// Unlink an entry from both structures and drop it; the lock is held
+static void remove_entry(RecordCache* cache, CachedRecord* entry) {
+    CachedRecord** link = &cache->buckets[hash_ref(entry->ref) & (cache->bucket_count - 1)];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        cache->newest = entry->older;
+    }
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        cache->oldest = entry->newer;
+    }
+
+    cache->bytes -= entry->bytes;
+    cache->entry_count--;
+    destroy_entry(entry);
+}
+
+// Move an entry to the newest end of the LRU list; the lock is held
+static void touch_entry(RecordCache* cache, CachedRecord* entry) {
+    if (cache->newest == entry) {
+        return;
+    }
+
+    entry->newer->older = entry->older;
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        cache->oldest = entry->newer;
+    }
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    cache->newest->newer = entry;
+    cache->newest = entry;
+}
+
+static CachedRecord* find_entry(const RecordCache* cache, TxRef ref) {
+    CachedRecord* entry = cache->buckets[hash_ref(ref) & (cache->bucket_count - 1)];
+    while (entry && !same_ref(entry->ref, ref)) {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+// Double the bucket array once there are more entries than buckets
+static void grow_buckets(RecordCache* cache) {
+    size_t bucket_count = cache->bucket_count * 2;
+    CachedRecord** buckets = (CachedRecord**)calloc(bucket_count, sizeof(CachedRecord*));
+    if (!buckets) {
+        return;  // Keep the current, slower table
+    }
+
+    for (size_t i = 0; i < cache->bucket_count; i++) {
+        CachedRecord* entry = cache->buckets[i];
+        while (entry) {
+            CachedRecord* next = entry->next;
+            size_t bucket = hash_ref(entry->ref) & (bucket_count - 1);
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_count = bucket_count;
+}
+
+// Drop and wipe every entry; counters are kept
+void record_cache_clear(RecordCache* cache) {
+    if (!cache) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    CachedRecord* entry = cache->newest;
+    while (entry) {
+        CachedRecord* older = entry->older;
+        destroy_entry(entry);
+        entry = older;
+    }
+    memset(cache->buckets, 0, sizeof(CachedRecord*) * cache->bucket_count);
+    cache->newest = NULL;
+    cache->oldest = NULL;
+    cache->entry_count = 0;
+    cache->bytes = 0;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void free_record_cache(RecordCache* cache) {
+    if (!cache) {
+        return;
+    }
+
+    record_cache_clear(cache);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->buckets);
+    free(cache);
+}
+
+// Copy the cached plaintext of `ref` into `out` if it is present, not
+// expired and fits in `size` bytes. Returns 1 on a hit.
+int record_cache_get(RecordCache* cache, TxRef ref, char* out, size_t size) {
+    if (!cache || !out) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    CachedRecord* entry = find_entry(cache, ref);
+    if (entry && entry->expires != 0 && time(NULL) >= entry->expires) {
+        remove_entry(cache, entry);
+        cache->expirations++;
+        entry = NULL;
+    }
+
+    int hit = 0;
+    if (entry) {
+        size_t len = strlen(entry->text);
+        if (len < size) {
+            memcpy(out, entry->text, len + 1);
+            touch_entry(cache, entry);
+            hit = 1;
+        }
+    }
+    if (hit) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return hit;
+}
+
+// Cache the plaintext of `ref`, replacing any older entry, then evict the
+// least recently used entries until the cache fits its budget. A record
+// bigger than the whole budget is not cached.
+int record_cache_put(RecordCache* cache, TxRef ref, const char* text) {
+    if (!cache || !text) {
+        return 0;
+    }
+
+    size_t bytes = sizeof(CachedRecord) + strlen(text) + 1;
+    if (bytes > cache->max_bytes) {
+        return 0;
+    }
+    CachedRecord* entry = (CachedRecord*)malloc(bytes);
+    if (!entry) {
+        return 0;
+    }
+    entry->ref = ref;
+    entry->bytes = bytes;
+    memcpy(entry->text, text, bytes - sizeof(CachedRecord));
+
+    pthread_mutex_lock(&cache->lock);
+    entry->expires = cache->ttl > 0 ? time(NULL) + cache->ttl : 0;
+
+    CachedRecord* old = find_entry(cache, ref);
+    if (old) {
+        remove_entry(cache, old);
+    }
+    while (cache->oldest && cache->bytes + bytes > cache->max_bytes) {
+        remove_entry(cache, cache->oldest);
+        cache->evictions++;
+    }
+    if (cache->entry_count >= cache->bucket_count) {
+        grow_buckets(cache);
+    }
+
+    size_t bucket = hash_ref(ref) & (cache->bucket_count - 1);
+    entry->next = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest) {
+        cache->newest->newer = entry;
+    } else {
+        cache->oldest = entry;
+    }
+    cache->newest = entry;
+    cache->bytes += bytes;
+    cache->entry_count++;
+    pthread_mutex_unlock(&cache->lock);
+    return 1;
+}
+
+void record_cache_stats(RecordCache* cache, RecordCacheStats* stats) {
+    if (!stats) {
+        return;
+    }
+
+    memset(stats, 0, sizeof(RecordCacheStats));
+    if (!cache) {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    stats->entries = cache->entry_count;
+    stats->bytes = cache->bytes;
+    stats->max_bytes = cache->max_bytes;
+    stats->ttl = cache->ttl;
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->expirations = cache->expirations;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// decrypt_batch_parallel() with the cache in front: refs[i] locates
+// encrypted[i] in the chain and keys[i] is its key. Cached records are
+// copied out, the rest are decrypted together and added to the cache. The
+// result has the same layout as decrypt_batch(). With no cache this is
+// decrypt_batch_parallel().
+char* record_cache_decrypt(RecordCache* cache, const TxRef* refs, const EncryptedData* const* encrypted,
+                           const unsigned char* const* keys, size_t count, char** texts) {
+    if (!cache) {
+        return decrypt_batch_parallel(encrypted, keys, count, 0, texts);
+    }
+    if (!refs || !encrypted || !keys || !texts) {
+        return NULL;
+    }
+
+    // Same layout as decrypt_batch(): a plaintext never outgrows its ciphertext
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += encrypted[i] ? encrypted[i]->data_len + 1 : 0;
+    }
+    char* buffer = (char*)malloc(total > 0 ? total : 1);
+    size_t* misses = (size_t*)malloc(sizeof(size_t) * (count ? count : 1));
+    const EncryptedData** missed = (const EncryptedData**)malloc(sizeof(EncryptedData*) * (count ? count : 1));
+    const unsigned char** missed_keys = (const unsigned char**)malloc(sizeof(unsigned char*) * (count ? count : 1));
+    char** missed_texts = (char**)malloc(sizeof(char*) * (count ? count : 1));
+    if (!buffer || !misses || !missed || !missed_keys || !missed_texts) {
+        free(buffer);
+        free(misses);
+        free(missed);
+        free(missed_keys);
+        free(missed_texts);
+        return NULL;
+    }
+
+    size_t miss_count = 0;
+    char* out = buffer;
+    for (size_t i = 0; i < count; i++) {
+        texts[i] = NULL;
+        if (!encrypted[i]) {
+            continue;
+        }
+        if (record_cache_get(cache, refs[i], out, encrypted[i]->data_len + 1)) {
+            texts[i] = out;
+        } else {
+            misses[miss_count] = i;
+            missed_keys[miss_count] = keys[i];
+            missed[miss_count++] = encrypted[i];
+            texts[i] = out;  // Where the plaintext goes once decrypted
+        }
+        out += encrypted[i]->data_len + 1;
+    }
+
+    if (miss_count > 0) {
+        char* decrypted = decrypt_batch_parallel(missed, missed_keys, miss_count, 0, missed_texts);
+        for (size_t m = 0; m < miss_count; m++) {
+            size_t i = misses[m];
+            if (decrypted && missed_texts[m]) {
+                memcpy(texts[i], missed_texts[m], strlen(missed_texts[m]) + 1);
+                record_cache_put(cache, refs[i], texts[i]);
+            } else {
+                texts[i] = NULL;
+            }
+        }
+        free_decrypted(decrypted, missed, miss_count);
+    }
+
+    free(misses);
+    free(missed);
+    free(missed_keys);
+    free(missed_texts);
+    return buffer;
+}
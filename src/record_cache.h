@@ -0,0 +1,69 @@
+#ifndef RECORD_CACHE_H
+#define RECORD_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "index.h"
+#include "security.h"
+
+// Opt-in cache of decrypted records, keyed by (block id, slot). Mined
+// records never change, so a plaintext stays valid until its entry expires
+// or the chain's blocks are replaced. Entries are wiped when dropped.
+#define RECORD_CACHE_DEFAULT_BYTES (4 * 1024 * 1024)  // Memory budget, entry overhead included
+#define RECORD_CACHE_DEFAULT_TTL 300                  // Seconds an entry is served (0 = no expiry)
+#define RECORD_CACHE_MAX_BYTES (1024 * 1024 * 1024)   // Largest memory budget accepted
+#define RECORD_CACHE_MAX_TTL (7 * 24 * 3600)          // Longest TTL accepted
+#define RECORD_CACHE_INITIAL_BUCKETS 256              // Doubles as entries are added
+
+// One decrypted record, in a hash bucket and in the LRU list
+typedef struct CachedRecord {
+    TxRef ref;
+    time_t expires;              // 0 = never
+    size_t bytes;                // Entry size charged to the budget
+    struct CachedRecord* newer;  // LRU neighbours
+    struct CachedRecord* older;
+    struct CachedRecord* next;   // Next entry in the same bucket
+    char text[];                 // NUL-terminated plaintext
+} CachedRecord;
+
+typedef struct {
+    pthread_mutex_t lock;
+    CachedRecord** buckets;
+    size_t bucket_count;
+    size_t entry_count;
+    CachedRecord* newest;
+    CachedRecord* oldest;        // Evicted first
+    size_t bytes;
+    size_t max_bytes;
+    uint32_t ttl;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;          // Dropped to stay within the budget
+    uint64_t expirations;        // Dropped because their TTL ran out
+} RecordCache;
+
+// Snapshot of a cache's counters
+typedef struct {
+    size_t entries;
+    size_t bytes;
+    size_t max_bytes;
+    uint32_t ttl;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t expirations;
+} RecordCacheStats;
+
+// Function declarations. All are thread-safe.
+RecordCache* create_record_cache(size_t max_bytes, uint32_t ttl);
+void free_record_cache(RecordCache* cache);
+void record_cache_clear(RecordCache* cache);
+int record_cache_get(RecordCache* cache, TxRef ref, char* out, size_t size);
+int record_cache_put(RecordCache* cache, TxRef ref, const char* text);
+void record_cache_stats(RecordCache* cache, RecordCacheStats* stats);
+char* record_cache_decrypt(RecordCache* cache, const TxRef* refs, const EncryptedData* const* encrypted,
+                           const unsigned char* const* keys, size_t count, char** texts);
+
+#endif // RECORD_CACHE_H
@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "rekey.h"
+
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Sleep until `done` records fit the job's rate, waking early on cancel
+static void throttle(RekeyJob* job, unsigned long long done) {
+    if (job->rate == 0) {
+        return;
+    }
+    double wait = (double)done / job->rate - seconds_since(&job->started);
+    while (wait > 0 && !atomic_load_explicit(&job->cancel, memory_order_relaxed)) {
+        double step = wait < 0.1 ? wait : 0.1;
+        struct timespec pause = {0, (long)(step * 1e9)};
+        nanosleep(&pause, NULL);
+        wait -= step;
+    }
+}
+
+// Re-encrypt one record unless it already uses the job's key. The current
+// ciphertext is the overlay's if an earlier run replaced it.
+static void rekey_record(RekeyJob* job, const Block* block, int slot) {
+    const Transaction* transaction = &block->transactions[slot];
+    if (!transaction->encrypted_data) {
+        return;
+    }
+
+    TxRef ref = {block->id, slot};
+    EncryptedData* replaced = overlay_copy(job->overlay, ref);
+    const EncryptedData* current = replaced ? replaced : transaction->encrypted_data;
+    if (!record_uses_key(current, job->key_id)) {
+        EncryptedData* encrypted = reencrypt_record(job->store, current, transaction->patient_id, job->key_id);
+        if (encrypted && overlay_put(job->overlay, ref, encrypted)) {
+            atomic_fetch_add_explicit(&job->migrated, 1, memory_order_relaxed);
+        } else {
+            free_encrypted_data(encrypted);
+            atomic_fetch_add_explicit(&job->failed, 1, memory_order_relaxed);
+        }
+    }
+    free_encrypted_data(replaced);
+}
+
+static void* rekey_job_main(void* arg) {
+    RekeyJob* job = (RekeyJob*)arg;
+    unsigned long long since_check = 0;
+    for (uint32_t b = 0; b < job->block_count; b++) {
+        const Block* block = job->blocks[b];
+        for (int i = 0; i < block->transaction_count; i++) {
+            if (since_check++ == REKEY_BATCH) {
+                since_check = 0;
+                throttle(job, atomic_load_explicit(&job->migrated, memory_order_relaxed));
+                if (atomic_load_explicit(&job->cancel, memory_order_relaxed)) {
+                    atomic_store(&job->finished, 1);
+                    return NULL;
+                }
+            }
+            rekey_record(job, block, i);
+            atomic_fetch_add_explicit(&job->scanned, 1, memory_order_relaxed);
+        }
+    }
+    atomic_store(&job->finished, 1);
+    return NULL;
+}
+
+RekeyJob* rekey_job_start(Block* const* blocks, uint32_t block_count, KeyStore* store,
+                          CiphertextOverlay* overlay, uint32_t key_id, uint32_t rate) {
+    if (!blocks || !store || !overlay || key_id == 0) {
+        return NULL;
+    }
+
+    RekeyJob* job = (RekeyJob*)malloc(sizeof(RekeyJob));
+    Block** snapshot = (Block**)malloc(sizeof(Block*) * (block_count ? block_count : 1));
+    if (!job || !snapshot) {
+        free(job);
+        free(snapshot);
+        return NULL;
+    }
+
+    memcpy(snapshot, blocks, sizeof(Block*) * block_count);
+    job->blocks = snapshot;
+    job->block_count = block_count;
+    job->store = store;
+    job->overlay = overlay;
+    job->key_id = key_id;
+    job->rate = rate;
+    job->total = 0;
+    for (uint32_t b = 0; b < block_count; b++) {
+        job->total += (unsigned long long)snapshot[b]->transaction_count;
+    }
+    atomic_init(&job->cancel, 0);
+    atomic_init(&job->finished, 0);
+    atomic_init(&job->scanned, 0);
+    atomic_init(&job->migrated, 0);
+    atomic_init(&job->failed, 0);
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+
+    if (pthread_create(&job->thread, NULL, rekey_job_main, job) != 0) {
+        free(snapshot);
+        free(job);
+        return NULL;
+    }
+    return job;
+}
+
+int rekey_job_finished(const RekeyJob* job) {
+    return job && atomic_load((atomic_int*)&job->finished);
+}
+
+void rekey_job_cancel(RekeyJob* job) {
+    if (job) {
+        atomic_store(&job->cancel, 1);
+    }
+}
+
+// Wait for the job thread, report its final progress and free the job
+void rekey_job_finish(RekeyJob* job, RekeyProgress* progress) {
+    if (!job) {
+        return;
+    }
+
+    pthread_join(job->thread, NULL);
+    if (progress) {
+        rekey_job_progress(job, progress);
+    }
+    free(job->blocks);
+    free(job);
+}
+
+void rekey_job_progress(const RekeyJob* job, RekeyProgress* progress) {
+    progress->key_id = job->key_id;
+    progress->total = job->total;
+    progress->scanned = atomic_load((atomic_ullong*)&job->scanned);
+    progress->migrated = atomic_load((atomic_ullong*)&job->migrated);
+    progress->failed = atomic_load((atomic_ullong*)&job->failed);
+    progress->elapsed = seconds_since(&job->started);
+    progress->rate = progress->elapsed > 0 ? progress->migrated / progress->elapsed : 0;
+}
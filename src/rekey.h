@@ -0,0 +1,54 @@
+#ifndef REKEY_H
+#define REKEY_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "block.h"
+#include "keys.h"
+#include "overlay.h"
+
+#define REKEY_BATCH 64              // Records re-encrypted between checks of the stop flag and rate
+#define REKEY_DEFAULT_RATE 2000     // Records per second, leaving room for foreground work
+
+// Background re-encryption of mined records under one master key. The job
+// walks a snapshot of the chain's blocks and puts each record's new
+// ciphertext in the overlay, so blocks (and their hashes) never change and
+// new records keep being added while it runs.
+typedef struct {
+    pthread_t thread;
+    Block** blocks;                 // Snapshot of the block index, owned by the job
+    uint32_t block_count;
+    KeyStore* store;
+    CiphertextOverlay* overlay;
+    uint32_t key_id;                // Master key records are moved to
+    uint32_t rate;                  // Records re-encrypted per second (0 = unthrottled)
+    unsigned long long total;       // Records in the snapshot
+    atomic_int cancel;              // Set to stop early
+    atomic_int finished;            // Set by the job thread when it stops
+    atomic_ullong scanned;          // Records looked at
+    atomic_ullong migrated;         // Records re-encrypted
+    atomic_ullong failed;           // Records that could not be decrypted or re-encrypted
+    struct timespec started;
+} RekeyJob;
+
+// Snapshot of a job's progress
+typedef struct {
+    uint32_t key_id;
+    unsigned long long total;
+    unsigned long long scanned;
+    unsigned long long migrated;
+    unsigned long long failed;
+    double elapsed;                 // Seconds since the job started
+    double rate;                    // Records re-encrypted per second
+} RekeyProgress;
+
+// Function declarations. The blocks must stay alive until the job is finished.
+RekeyJob* rekey_job_start(Block* const* blocks, uint32_t block_count, KeyStore* store,
+                          CiphertextOverlay* overlay, uint32_t key_id, uint32_t rate);
+int rekey_job_finished(const RekeyJob* job);
+void rekey_job_cancel(RekeyJob* job);
+void rekey_job_finish(RekeyJob* job, RekeyProgress* progress);
+void rekey_job_progress(const RekeyJob* job, RekeyProgress* progress);
+
+#endif // REKEY_H
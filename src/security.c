@@ -2,122 +2,449 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <openssl/aes.h>
 #include <openssl/rand.h>
 #include <openssl/evp.h>
 #include <openssl/sha.h>
+#include <openssl/crypto.h>
 #include "security.h"
+#include "pool.h"
+#include "utils.h"
 
 // Encryption functions
-EncryptedData* encrypt_data(const char* data, const unsigned char* key) {
-    if (!data || !key) return NULL;
 
-    EncryptedData* encrypted = (EncryptedData*)malloc(sizeof(EncryptedData));
-    if (!encrypted) return NULL;
+#define ENCRYPT_IV_BATCH 64  // IVs drawn per RAND_bytes() call in encrypt_batch()
+
+// Creating and keying a cipher context costs more than encrypting a short
+// record, so each thread keeps its contexts and re-keys them only when
+// the key changes
+typedef struct {
+    EVP_CIPHER_CTX* encrypt;
+    EVP_CIPHER_CTX* decrypt;
+    EVP_CIPHER_CTX* legacy;   // CBC decryption of records saved before GCM
+    unsigned char encrypt_key[AES_KEY_SIZE];
+    unsigned char decrypt_key[AES_KEY_SIZE];
+    int encrypt_keyed;
+    int decrypt_keyed;
+} CipherContexts;
+
+static pthread_key_t contexts_key;
+static pthread_once_t contexts_once = PTHREAD_ONCE_INIT;
+
+static void free_cipher_contexts(void* ptr) {
+    CipherContexts* contexts = (CipherContexts*)ptr;
+    EVP_CIPHER_CTX_free(contexts->encrypt);
+    EVP_CIPHER_CTX_free(contexts->decrypt);
+    EVP_CIPHER_CTX_free(contexts->legacy);
+    OPENSSL_cleanse(contexts, sizeof(CipherContexts));
+    free(contexts);
+}
 
-    // Generate random IV
-    if (RAND_bytes(encrypted->iv, AES_IV_SIZE) != 1) {
-        free(encrypted);
-        return NULL;
-    }
+static void create_contexts_key(void) {
+    pthread_key_create(&contexts_key, free_cipher_contexts);
+}
 
-    // Initialize encryption context
-    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-        free(encrypted);
+// This thread's contexts, created on first use and freed when it exits
+static CipherContexts* thread_contexts(void) {
+    pthread_once(&contexts_once, create_contexts_key);
+    CipherContexts* contexts = (CipherContexts*)pthread_getspecific(contexts_key);
+    if (contexts) return contexts;
+
+    contexts = (CipherContexts*)calloc(1, sizeof(CipherContexts));
+    if (!contexts) return NULL;
+    contexts->encrypt = EVP_CIPHER_CTX_new();
+    contexts->decrypt = EVP_CIPHER_CTX_new();
+    contexts->legacy = EVP_CIPHER_CTX_new();
+    if (!contexts->encrypt || !contexts->decrypt || !contexts->legacy ||
+        EVP_EncryptInit_ex(contexts->encrypt, EVP_aes_256_gcm(), NULL, NULL, NULL) != 1 ||
+        EVP_DecryptInit_ex(contexts->decrypt, EVP_aes_256_gcm(), NULL, NULL, NULL) != 1 ||
+        pthread_setspecific(contexts_key, contexts) != 0) {
+        free_cipher_contexts(contexts);
         return NULL;
     }
+    return contexts;
+}
 
-    // Initialize encryption
-    if (EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, encrypted->iv) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        free(encrypted);
-        return NULL;
+// Point a cached GCM context at the next record. The key schedule is only
+// recomputed when the key differs from the one the context holds.
+static int start_gcm(EVP_CIPHER_CTX* ctx, int encrypting, unsigned char cached_key[AES_KEY_SIZE], int* keyed,
+                     const unsigned char* key, const unsigned char* iv) {
+    int rekey = !*keyed || CRYPTO_memcmp(cached_key, key, AES_KEY_SIZE) != 0;
+    const unsigned char* new_key = rekey ? key : NULL;
+    int ok = encrypting ? EVP_EncryptInit_ex(ctx, NULL, NULL, new_key, iv)
+                        : EVP_DecryptInit_ex(ctx, NULL, NULL, new_key, iv);
+    if (ok != 1) {
+        *keyed = 0;
+        return 0;
     }
-
-    // Calculate output size
-    int data_len = strlen(data);
-    int block_size = EVP_CIPHER_CTX_block_size(ctx);
-    int encrypted_len = data_len + block_size;
-    encrypted->data = (unsigned char*)malloc(encrypted_len);
-    if (!encrypted->data) {
-        EVP_CIPHER_CTX_free(ctx);
-        free(encrypted);
-        return NULL;
+    if (rekey) {
+        memcpy(cached_key, key, AES_KEY_SIZE);
+        *keyed = 1;
     }
+    return 1;
+}
+
+// Encrypt one plaintext with GCM into a new record whose IV is `iv`
+static EncryptedData* seal_record(CipherContexts* contexts, const char* data, const unsigned char* key,
+                                  const unsigned char iv[AES_GCM_IV_SIZE]) {
+    size_t data_len = strlen(data);
+    if (data_len > INT_MAX) return NULL;
+
+    // GCM is a stream mode, so the ciphertext is as long as the plaintext
+    EncryptedData* encrypted = alloc_encrypted_data(data_len);
+    if (!encrypted) return NULL;
+    memset(encrypted->iv, 0, AES_IV_SIZE);
+    memcpy(encrypted->iv, iv, AES_GCM_IV_SIZE);
+    encrypted->cipher = CIPHER_AES_256_GCM;
 
-    // Perform encryption
     int len;
-    if (EVP_EncryptUpdate(ctx, encrypted->data, &len, (const unsigned char*)data, data_len) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        free(encrypted->data);
-        free(encrypted);
+    if (!start_gcm(contexts->encrypt, 1, contexts->encrypt_key, &contexts->encrypt_keyed, key, encrypted->iv) ||
+        EVP_EncryptUpdate(contexts->encrypt, encrypted->data, &len, (const unsigned char*)data, (int)data_len) != 1 ||
+        EVP_EncryptFinal_ex(contexts->encrypt, encrypted->data + len, &len) != 1 ||
+        EVP_CIPHER_CTX_ctrl(contexts->encrypt, EVP_CTRL_GCM_GET_TAG, AES_GCM_TAG_SIZE, encrypted->tag) != 1) {
+        free_encrypted_data(encrypted);
         return NULL;
     }
-    encrypted->data_len = len;
+    return encrypted;
+}
 
-    // Finalize encryption
-    if (EVP_EncryptFinal_ex(ctx, encrypted->data + len, &len) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        free(encrypted->data);
-        free(encrypted);
-        return NULL;
+// Decrypt one record into `out`, which has room for data_len bytes plus a
+// NUL. Returns 0 if the record fails to decrypt or, for GCM, to
+// authenticate; `out` is then wiped.
+static int open_record(CipherContexts* contexts, const EncryptedData* encrypted, const unsigned char* key,
+                       char* out) {
+    if (encrypted->data_len > INT_MAX) return 0;
+
+    unsigned char* plain = (unsigned char*)out;
+    int data_len = (int)encrypted->data_len;
+    int len = 0, final_len = 0;
+    int ok;
+    if (encrypted->cipher == CIPHER_AES_256_GCM) {
+        unsigned char tag[AES_GCM_TAG_SIZE];
+        memcpy(tag, encrypted->tag, AES_GCM_TAG_SIZE);
+        EVP_CIPHER_CTX* ctx = contexts->decrypt;
+        ok = start_gcm(ctx, 0, contexts->decrypt_key, &contexts->decrypt_keyed, key, encrypted->iv) &&
+             EVP_DecryptUpdate(ctx, plain, &len, encrypted->data, data_len) == 1 &&
+             EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, AES_GCM_TAG_SIZE, tag) == 1 &&
+             EVP_DecryptFinal_ex(ctx, plain + len, &final_len) == 1;
+    } else if (encrypted->cipher == CIPHER_AES_256_CBC) {
+        EVP_CIPHER_CTX* ctx = contexts->legacy;
+        ok = EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, encrypted->iv) == 1 &&
+             EVP_DecryptUpdate(ctx, plain, &len, encrypted->data, data_len) == 1 &&
+             EVP_DecryptFinal_ex(ctx, plain + len, &final_len) == 1;
+    } else {
+        ok = 0;
     }
-    encrypted->data_len += len;
 
-    EVP_CIPHER_CTX_free(ctx);
+    if (!ok) {
+        OPENSSL_cleanse(out, encrypted->data_len + 1);
+        return 0;
+    }
+    out[len + final_len] = '\0';
+    return 1;
+}
+
+// The struct and its ciphertext share one pool object, so a record costs a
+// single allocation and free_encrypted_data() a single free
+EncryptedData* alloc_encrypted_data(size_t data_len) {
+    EncryptedData* encrypted = (EncryptedData*)pool_alloc(sizeof(EncryptedData) + data_len);
+    if (!encrypted) return NULL;
+
+    memset(encrypted->tag, 0, AES_GCM_TAG_SIZE);
+    encrypted->cipher = CIPHER_AES_256_GCM;
+    encrypted->key_scheme = KEY_SCHEME_SHARED;
+    encrypted->key_id = 0;
+    encrypted->data = (unsigned char*)(encrypted + 1);
+    encrypted->data_len = data_len;
     return encrypted;
 }
 
+EncryptedData* encrypt_data(const char* data, const unsigned char* key) {
+    EncryptedData* encrypted;
+    return encrypt_batch(&data, 1, key, &encrypted) ? encrypted : NULL;
+}
+
 char* decrypt_data(const EncryptedData* encrypted, const unsigned char* key) {
-    if (!encrypted || !key) return NULL;
+    char* text;
+    char* buffer = decrypt_batch(&encrypted, 1, key, &text);
+    if (buffer && !text) {
+        free_decrypted(buffer, &encrypted, 1);
+        return NULL;
+    }
+    return buffer;
+}
 
-    // Initialize decryption context
-    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) return NULL;
+// Encrypt `count` strings with one key into encrypted[0..count). The
+// thread's cached context is keyed once for the batch and IVs are drawn
+// ENCRYPT_IV_BATCH at a time. Each ciphertext is still its own pool object
+// because the transactions receiving them free them one by one. Returns 0
+// and leaves nothing allocated if any string fails.
+int encrypt_batch(const char* const* data, size_t count, const unsigned char* key, EncryptedData** encrypted) {
+    if (!data || !key || !encrypted) return 0;
+
+    CipherContexts* contexts = thread_contexts();
+    if (!contexts) return 0;
+
+    unsigned char ivs[ENCRYPT_IV_BATCH][AES_GCM_IV_SIZE];
+    for (size_t i = 0; i < count; i++) {
+        size_t iv = i % ENCRYPT_IV_BATCH;
+        if ((iv == 0 && RAND_bytes(ivs[0], sizeof(ivs)) != 1) || !data[i] ||
+            !(encrypted[i] = seal_record(contexts, data[i], key, ivs[iv]))) {
+            while (i > 0) {
+                free_encrypted_data(encrypted[--i]);
+            }
+            return 0;
+        }
+    }
+    return 1;
+}
 
-    // Initialize decryption
-    if (EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, encrypted->iv) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        return NULL;
+// A worker's share of a batch decryption
+typedef struct {
+    const EncryptedData* const* encrypted;
+    const unsigned char* const* keys;
+    size_t start;
+    size_t end;
+    char** texts;
+    char* out;                 // Where record `start` is decrypted to
+} DecryptWorker;
+
+// Decrypt the worker's records with this thread's cached contexts
+static void decrypt_slice(DecryptWorker* worker) {
+    CipherContexts* contexts = thread_contexts();
+    char* out = worker->out;
+    for (size_t i = worker->start; i < worker->end; i++) {
+        worker->texts[i] = NULL;
+        const EncryptedData* encrypted = worker->encrypted[i];
+        if (encrypted) {
+            if (contexts && worker->keys[i] && open_record(contexts, encrypted, worker->keys[i], out)) {
+                worker->texts[i] = out;
+            }
+            out += encrypted->data_len + 1;
+        }
     }
+}
 
-    // Allocate output buffer
-    char* decrypted = (char*)malloc(encrypted->data_len + 1);
-    if (!decrypted) {
-        EVP_CIPHER_CTX_free(ctx);
-        return NULL;
+// Threads that decrypt batch slices. They are started the first time a
+// batch needs them and then kept, so each keeps its cipher contexts (and
+// their key schedules) from one batch to the next. One batch uses the
+// pool at a time; a batch posted while another runs decrypts on its
+// caller's thread.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;       // A batch was posted, or the pool is stopping
+    pthread_cond_t done;       // The last slice of the batch finished
+    pthread_t threads[DECRYPT_POOL_MAX_WORKERS];
+    int thread_count;
+    DecryptWorker* slices;     // The posted batch; NULL when idle
+    int slice_count;
+    int next_slice;            // Next slice nobody has taken
+    int unfinished;            // Slices taken or not, still being decrypted
+    int stopping;
+} DecryptPool;
+
+static DecryptPool decrypt_pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER, .work = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER};
+
+// Take and decrypt slices of the posted batch until none are left.
+// Called and returns with the pool locked.
+static void run_posted_slices(DecryptPool* pool) {
+    while (pool->slices && pool->next_slice < pool->slice_count) {
+        DecryptWorker* slice = &pool->slices[pool->next_slice++];
+        pthread_mutex_unlock(&pool->lock);
+        decrypt_slice(slice);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->unfinished == 0) {
+            pthread_cond_signal(&pool->done);
+        }
     }
+}
 
-    // Perform decryption
-    int len;
-    if (EVP_DecryptUpdate(ctx, (unsigned char*)decrypted, &len, encrypted->data, encrypted->data_len) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        free(decrypted);
-        return NULL;
+static void* decrypt_pool_thread(void* arg) {
+    DecryptPool* pool = (DecryptPool*)arg;
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stopping) {
+        run_posted_slices(pool);
+        if (!pool->stopping) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
     }
-    int decrypted_len = len;
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
 
-    // Finalize decryption
-    if (EVP_DecryptFinal_ex(ctx, (unsigned char*)decrypted + len, &len) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        free(decrypted);
-        return NULL;
+// Start threads until the pool has `wanted` (at most DECRYPT_POOL_MAX_WORKERS).
+// Called with the pool locked; keeps however many could be started.
+static void grow_decrypt_pool(DecryptPool* pool, int wanted) {
+    if (wanted > DECRYPT_POOL_MAX_WORKERS) {
+        wanted = DECRYPT_POOL_MAX_WORKERS;
+    }
+    while (pool->thread_count < wanted &&
+           pthread_create(&pool->threads[pool->thread_count], NULL, decrypt_pool_thread, pool) == 0) {
+        pool->thread_count++;
+    }
+}
+
+// Decrypt the slices across the pool's threads and the calling thread
+static void run_decrypt_slices(DecryptWorker* slices, int slice_count) {
+    DecryptPool* pool = &decrypt_pool;
+    pthread_mutex_lock(&pool->lock);
+    if (slice_count == 1 || pool->slices || pool->stopping) {
+        pthread_mutex_unlock(&pool->lock);
+        for (int i = 0; i < slice_count; i++) {
+            decrypt_slice(&slices[i]);
+        }
+        return;
     }
-    decrypted_len += len;
-    decrypted[decrypted_len] = '\0';
 
-    EVP_CIPHER_CTX_free(ctx);
-    return decrypted;
+    grow_decrypt_pool(pool, slice_count - 1);
+    pool->slices = slices;
+    pool->slice_count = slice_count;
+    pool->next_slice = 0;
+    pool->unfinished = slice_count;
+    pthread_cond_broadcast(&pool->work);
+
+    // The caller works too, so a pool that could not grow still finishes
+    run_posted_slices(pool);
+    while (pool->unfinished > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pool->slices = NULL;
+    pool->slice_count = 0;
+    pthread_mutex_unlock(&pool->lock);
 }
 
-void free_encrypted_data(EncryptedData* encrypted) {
-    if (encrypted) {
-        if (encrypted->data) {
-            free(encrypted->data);
+// Threads currently in the decrypt pool
+int decrypt_pool_workers(void) {
+    pthread_mutex_lock(&decrypt_pool.lock);
+    int count = decrypt_pool.thread_count;
+    pthread_mutex_unlock(&decrypt_pool.lock);
+    return count;
+}
+
+// Stop and join the decrypt pool's threads, freeing their cipher contexts.
+// Call once no batch is running, e.g. on exit; a later batch starts the
+// pool again.
+void shutdown_decrypt_pool(void) {
+    DecryptPool* pool = &decrypt_pool;
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work);
+    int count = pool->thread_count;
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->thread_count = 0;
+    pool->stopping = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Decrypt `count` records into one buffer of NUL-terminated plaintexts,
+// laid out back to back in record order. texts[i] points at record i's
+// plaintext, or is NULL if the record is NULL or fails to decrypt. Returns
+// the buffer, to be released with free() (a single decrypt_data() result
+// is its own buffer), or NULL if it cannot be allocated.
+char* decrypt_batch(const EncryptedData* const* encrypted, size_t count, const unsigned char* key, char** texts) {
+    if (!key) return NULL;
+
+    const unsigned char** keys = (const unsigned char**)malloc(sizeof(unsigned char*) * (count ? count : 1));
+    if (!keys) return NULL;
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = key;
+    }
+    char* buffer = decrypt_batch_parallel(encrypted, keys, count, 1, texts);
+    free(keys);
+    return buffer;
+}
+
+// decrypt_batch() across thread_count workers (0 = online CPUs), with
+// keys[i] the key of encrypted[i] (a NULL key leaves the record
+// undecrypted). Each worker decrypts a contiguous slice of the records
+// into its own part of the buffer, so results come back in order without
+// any merging. The calling thread takes slices alongside the decrypt
+// pool's threads. Runs of records sharing a key keep the cached key schedule.
+char* decrypt_batch_parallel(const EncryptedData* const* encrypted, const unsigned char* const* keys, size_t count,
+                             int thread_count, char** texts) {
+    if (!encrypted || !keys || !texts) return NULL;
+
+    if (thread_count <= 0) {
+        thread_count = get_online_cpus();
+    }
+    size_t max_threads = count / MIN_DECRYPT_RECORDS_PER_THREAD;
+    if ((size_t)thread_count > max_threads) {
+        thread_count = max_threads > 0 ? (int)max_threads : 1;
+    }
+
+    // A plaintext is never longer than its ciphertext
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += encrypted[i] ? encrypted[i]->data_len + 1 : 0;
+    }
+    char* buffer = (char*)malloc(total > 0 ? total : 1);
+    DecryptWorker* workers = (DecryptWorker*)malloc(sizeof(DecryptWorker) * thread_count);
+    if (!buffer || !workers) {
+        free(buffer);
+        free(workers);
+        return NULL;
+    }
+
+    size_t slice = count / thread_count;
+    char* out = buffer;
+    for (int i = 0; i < thread_count; i++) {
+        workers[i].encrypted = encrypted;
+        workers[i].keys = keys;
+        workers[i].start = slice * i;
+        workers[i].end = (i == thread_count - 1) ? count : slice * (i + 1);
+        workers[i].texts = texts;
+        workers[i].out = out;
+        for (size_t r = workers[i].start; r < workers[i].end; r++) {
+            out += encrypted[r] ? encrypted[r]->data_len + 1 : 0;
         }
-        free(encrypted);
     }
+
+    run_decrypt_slices(workers, thread_count);
+    free(workers);
+    return buffer;
+}
+
+// Wipe and free a decrypt_batch() or decrypt_batch_parallel() result for
+// the same `count` records, so no plaintext is left in freed memory
+void free_decrypted(char* buffer, const EncryptedData* const* encrypted, size_t count) {
+    if (!buffer) return;
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += encrypted[i] ? encrypted[i]->data_len + 1 : 0;
+    }
+    OPENSSL_cleanse(buffer, total);
+    free(buffer);
+}
+
+// Independent copy of a record, as one pool object like the original
+EncryptedData* copy_encrypted_data(const EncryptedData* encrypted) {
+    if (!encrypted) return NULL;
+
+    EncryptedData* copy = alloc_encrypted_data(encrypted->data_len);
+    if (!copy) return NULL;
+    memcpy(copy->iv, encrypted->iv, AES_IV_SIZE);
+    memcpy(copy->tag, encrypted->tag, AES_GCM_TAG_SIZE);
+    copy->cipher = encrypted->cipher;
+    copy->key_scheme = encrypted->key_scheme;
+    copy->key_id = encrypted->key_id;
+    memcpy(copy->data, encrypted->data, encrypted->data_len);
+    return copy;
+}
+
+void free_encrypted_data(EncryptedData* encrypted) {
+    pool_free(encrypted);
 }
 
 // User management functions
@@ -210,22 +537,38 @@ int generate_key(unsigned char* key) {
     return RAND_bytes(key, AES_KEY_SIZE) == 1;
 }
 
+// Write a key to a new file readable only by its owner. Fails rather than
+// overwrite an existing file, and removes a partly written one.
 int store_key(const unsigned char* key, const char* filename) {
-    FILE* file = fopen(filename, "wb");
-    if (!file) return 0;
+    int fd = open(filename, O_CREAT | O_EXCL | O_WRONLY, 0600);
+    if (fd < 0) return 0;
+    FILE* file = fdopen(fd, "wb");
+    if (!file) {
+        close(fd);
+        unlink(filename);
+        return 0;
+    }
 
     size_t written = fwrite(key, 1, AES_KEY_SIZE, file);
-    fclose(file);
-    return written == AES_KEY_SIZE;
+    if (fclose(file) != 0 || written != AES_KEY_SIZE) {
+        unlink(filename);
+        return 0;
+    }
+    return 1;
 }
 
+// Read a key file, which must hold exactly AES_KEY_SIZE bytes
 int load_key(unsigned char* key, const char* filename) {
     FILE* file = fopen(filename, "rb");
     if (!file) return 0;
 
     size_t read = fread(key, 1, AES_KEY_SIZE, file);
+    int exact = read == AES_KEY_SIZE && fgetc(file) == EOF;
     fclose(file);
-    return read == AES_KEY_SIZE;
+    if (!exact) {
+        OPENSSL_cleanse(key, AES_KEY_SIZE);
+    }
+    return exact;
 }
 
 // Access control function
@@ -4,16 +4,34 @@
 #include <openssl/aes.h>
 #include <openssl/rand.h>
 #include <openssl/evp.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define AES_KEY_SIZE 32  // 256 bits
 #define AES_IV_SIZE 16   // 128 bits
+#define AES_GCM_IV_SIZE 12   // GCM nonce; the first bytes of the IV field
+#define AES_GCM_TAG_SIZE 16  // GCM authentication tag
 #define MAX_PASSWORD_LENGTH 64
 #define SALT_SIZE 16
+#define MIN_DECRYPT_RECORDS_PER_THREAD 64  // Smaller batches are decrypted on fewer threads
+#define DECRYPT_POOL_MAX_WORKERS 64        // Threads kept for decrypt_batch_parallel()
 
-// Structure for encrypted data
+// Ciphers a record can be encrypted with
+#define CIPHER_AES_256_CBC 0   // Records saved before block format 5; no integrity check
+#define CIPHER_AES_256_GCM 1   // Authenticated; used for all new records
+
+// How a record's data key is chosen (see keys.h)
+#define KEY_SCHEME_SHARED 0    // One key for every record; records saved before block format 6
+#define KEY_SCHEME_PATIENT 1   // Key derived for the record's patient; used for all new records
+
+// Structure for encrypted data. The ciphertext is stored right after the
+// struct; allocate with alloc_encrypted_data().
 typedef struct {
     unsigned char iv[AES_IV_SIZE];
+    unsigned char tag[AES_GCM_TAG_SIZE];  // Unused for CBC records
+    uint8_t cipher;
+    uint8_t key_scheme;
+    uint32_t key_id;                      // Master key of a KEY_SCHEME_PATIENT record (see keys.h)
     unsigned char* data;
     size_t data_len;
 } EncryptedData;
@@ -27,8 +45,17 @@ typedef struct {
 } User;
 
 // Function declarations
+EncryptedData* alloc_encrypted_data(size_t data_len);
 EncryptedData* encrypt_data(const char* data, const unsigned char* key);
 char* decrypt_data(const EncryptedData* encrypted, const unsigned char* key);
+int encrypt_batch(const char* const* data, size_t count, const unsigned char* key, EncryptedData** encrypted);
+char* decrypt_batch(const EncryptedData* const* encrypted, size_t count, const unsigned char* key, char** texts);
+char* decrypt_batch_parallel(const EncryptedData* const* encrypted, const unsigned char* const* keys, size_t count,
+                             int thread_count, char** texts);
+void free_decrypted(char* buffer, const EncryptedData* const* encrypted, size_t count);
+int decrypt_pool_workers(void);
+void shutdown_decrypt_pool(void);
+EncryptedData* copy_encrypted_data(const EncryptedData* encrypted);
 void free_encrypted_data(EncryptedData* encrypted);
 
 // User management
@@ -0,0 +1,202 @@
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "sha256.h"
+
+#define KERNEL_CALIBRATION_HASHES 4096  // Hashes timed per kernel when choosing one
+
+#if defined(__x86_64__) || defined(__i386__)
+// Vector kernels (sha256_x86.c)
+extern const Sha256Kernel sha256_kernel_shani;
+extern const Sha256Kernel sha256_kernel_avx2;
+extern const Sha256Kernel sha256_kernel_sse2;
+#endif
+
+// Round constants, shared with the vector kernels
+const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t INITIAL_STATE[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define BSIG0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define BSIG1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SSIG0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SSIG1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+static uint32_t load_be32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void store_be32(unsigned char* p, uint32_t value) {
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+void sha256_compress(uint32_t state[8], const uint32_t block[16]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = block[i];
+    }
+    for (int i = 16; i < 64; i++) {
+        w[i] = SSIG1(w[i - 2]) + w[i - 7] + SSIG0(w[i - 15]) + w[i - 16];
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + BSIG1(e) + CH(e, f, g) + sha256_k[i] + w[i];
+        uint32_t t2 = BSIG0(a) + MAJ(a, b, c);
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+// Hash every full block of the message and pad the remainder into a
+// single final block. Only messages whose padded tail fits in one block
+// (length % 64 <= 55) are supported.
+int sha256_midstate_init(Sha256Midstate* mid, const unsigned char* message, size_t length) {
+    if (!mid || !message || length % SHA256_BLOCK_SIZE > SHA256_BLOCK_SIZE - 9) {
+        return 0;
+    }
+
+    memcpy(mid->state, INITIAL_STATE, sizeof(INITIAL_STATE));
+
+    size_t full_blocks = length / SHA256_BLOCK_SIZE;
+    uint32_t words[16];
+    for (size_t i = 0; i < full_blocks; i++) {
+        for (int j = 0; j < 16; j++) {
+            words[j] = load_be32(message + i * SHA256_BLOCK_SIZE + j * 4);
+        }
+        sha256_compress(mid->state, words);
+    }
+
+    // Pad the tail: message bytes, 0x80, zeros, 64-bit big-endian bit length
+    unsigned char tail[SHA256_BLOCK_SIZE];
+    size_t remaining = length % SHA256_BLOCK_SIZE;
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, message + full_blocks * SHA256_BLOCK_SIZE, remaining);
+    tail[remaining] = 0x80;
+    uint64_t bit_length = (uint64_t)length * 8;
+    store_be32(tail + 56, (uint32_t)(bit_length >> 32));
+    store_be32(tail + 60, (uint32_t)bit_length);
+
+    for (int j = 0; j < 16; j++) {
+        mid->tail[j] = load_be32(tail + j * 4);
+    }
+    return 1;
+}
+
+void sha256_midstate_digest(const Sha256Midstate* mid, unsigned char digest[SHA256_DIGEST_SIZE]) {
+    uint32_t state[8];
+    memcpy(state, mid->state, sizeof(state));
+    sha256_compress(state, mid->tail);
+
+    for (int i = 0; i < 8; i++) {
+        store_be32(digest + i * 4, state[i]);
+    }
+}
+
+static void scalar_hash_tail(const Sha256Midstate* mid, int word_index, const uint32_t* words,
+                             unsigned char digests[][SHA256_DIGEST_SIZE]) {
+    Sha256Midstate lane = *mid;
+    lane.tail[word_index] = words[0];
+    sha256_midstate_digest(&lane, digests[0]);
+}
+
+static int scalar_supported(void) {
+    return 1;
+}
+
+static const Sha256Kernel sha256_kernel_scalar = {"scalar", 1, scalar_hash_tail, scalar_supported};
+
+static const Sha256Kernel* const KERNELS[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    &sha256_kernel_shani,
+    &sha256_kernel_avx2,
+    &sha256_kernel_sse2,
+#endif
+    &sha256_kernel_scalar
+};
+
+static const Sha256Kernel* best_kernel = &sha256_kernel_scalar;
+static pthread_once_t best_kernel_once = PTHREAD_ONCE_INIT;
+
+// Time one kernel on a dummy header; returns hashes per second
+static double measure_kernel(const Sha256Kernel* kernel) {
+    unsigned char message[80] = {0};
+    Sha256Midstate mid;
+    uint32_t words[SHA256_MAX_LANES] = {0};
+    unsigned char digests[SHA256_MAX_LANES][SHA256_DIGEST_SIZE];
+    struct timespec start, end;
+
+    sha256_midstate_init(&mid, message, sizeof(message));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < KERNEL_CALIBRATION_HASHES; i += kernel->lanes) {
+        words[0] = (uint32_t)i;
+        kernel->hash_tail(&mid, 3, words, digests);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return elapsed > 0 ? KERNEL_CALIBRATION_HASHES / elapsed : 0;
+}
+
+// Which kernel wins depends on the CPU and on compiler optimization
+// (SHA-NI vs. AVX2 in particular), so pick by measuring once
+static void select_best_kernel(void) {
+    double best_rate = 0;
+    for (size_t i = 0; i < sizeof(KERNELS) / sizeof(KERNELS[0]); i++) {
+        if (!KERNELS[i]->supported()) {
+            continue;
+        }
+        double rate = measure_kernel(KERNELS[i]);
+        if (rate > best_rate) {
+            best_rate = rate;
+            best_kernel = KERNELS[i];
+        }
+    }
+}
+
+const Sha256Kernel* const* sha256_kernels(int* count) {
+    if (count) {
+        *count = (int)(sizeof(KERNELS) / sizeof(KERNELS[0]));
+    }
+    return KERNELS;
+}
+
+const Sha256Kernel* sha256_best_kernel(void) {
+    pthread_once(&best_kernel_once, select_best_kernel);
+    return best_kernel;
+}
@@ -0,0 +1,40 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_BLOCK_SIZE 64   // Bytes per compression block
+#define SHA256_DIGEST_SIZE 32  // Bytes in a raw digest
+#define SHA256_MAX_LANES 8     // Widest multi-buffer kernel (AVX2)
+
+// SHA-256 state after hashing every full 64-byte block of a message,
+// plus the padded final block. Callers that only change words of the
+// final block (e.g. a mining nonce) can rehash with one compression.
+typedef struct {
+    uint32_t state[8];   // Chaining value after the constant prefix
+    uint32_t tail[16];   // Padded final block as big-endian message words
+} Sha256Midstate;
+
+// Multi-buffer kernel: hashes `lanes` variants of the midstate's final
+// block, lane i with tail[word_index] replaced by words[i]
+typedef void (*Sha256TailFunc)(const Sha256Midstate* mid, int word_index, const uint32_t* words,
+                               unsigned char digests[][SHA256_DIGEST_SIZE]);
+
+typedef struct {
+    const char* name;
+    int lanes;                 // Candidates hashed per call
+    Sha256TailFunc hash_tail;
+    int (*supported)(void);    // Runtime CPU feature check
+} Sha256Kernel;
+
+// Function declarations
+void sha256_compress(uint32_t state[8], const uint32_t block[16]);
+int sha256_midstate_init(Sha256Midstate* mid, const unsigned char* message, size_t length);
+void sha256_midstate_digest(const Sha256Midstate* mid, unsigned char digest[SHA256_DIGEST_SIZE]);
+
+// Kernel dispatch: every compiled-in kernel, and the fastest supported one
+const Sha256Kernel* const* sha256_kernels(int* count);
+const Sha256Kernel* sha256_best_kernel(void);
+
+#endif // SHA256_H
@@ -0,0 +1,219 @@
+#include "sha256.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+extern const uint32_t sha256_k[64];
+
+static void store_be32(unsigned char* p, uint32_t value) {
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+// Transpose lane-major state words into one big-endian digest per lane
+static void store_lane_digests(const uint32_t* words, int lanes, unsigned char digests[][SHA256_DIGEST_SIZE]) {
+    for (int lane = 0; lane < lanes; lane++) {
+        for (int i = 0; i < 8; i++) {
+            store_be32(digests[lane] + i * 4, words[i * lanes + lane]);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------
+// SSE2: four candidates per call, one per 32-bit lane. SSE2 is part of
+// the x86-64 baseline, so this kernel is always available there.
+// ---------------------------------------------------------------------
+
+#define SSE_ROTR(x, n) _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - (n)))
+#define SSE_CH(x, y, z) _mm_xor_si128(_mm_and_si128(x, y), _mm_andnot_si128(x, z))
+#define SSE_MAJ(x, y, z) _mm_or_si128(_mm_and_si128(x, y), _mm_and_si128(z, _mm_or_si128(x, y)))
+#define SSE_BSIG0(x) _mm_xor_si128(_mm_xor_si128(SSE_ROTR(x, 2), SSE_ROTR(x, 13)), SSE_ROTR(x, 22))
+#define SSE_BSIG1(x) _mm_xor_si128(_mm_xor_si128(SSE_ROTR(x, 6), SSE_ROTR(x, 11)), SSE_ROTR(x, 25))
+#define SSE_SSIG0(x) _mm_xor_si128(_mm_xor_si128(SSE_ROTR(x, 7), SSE_ROTR(x, 18)), _mm_srli_epi32(x, 3))
+#define SSE_SSIG1(x) _mm_xor_si128(_mm_xor_si128(SSE_ROTR(x, 17), SSE_ROTR(x, 19)), _mm_srli_epi32(x, 10))
+
+__attribute__((target("sse2")))
+static void sse2_hash_tail(const Sha256Midstate* mid, int word_index, const uint32_t* words,
+                           unsigned char digests[][SHA256_DIGEST_SIZE]) {
+    __m128i w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (i == word_index) ? _mm_loadu_si128((const __m128i*)words)
+                                 : _mm_set1_epi32((int)mid->tail[i]);
+    }
+    for (int i = 16; i < 64; i++) {
+        w[i] = _mm_add_epi32(_mm_add_epi32(SSE_SSIG1(w[i - 2]), w[i - 7]),
+                             _mm_add_epi32(SSE_SSIG0(w[i - 15]), w[i - 16]));
+    }
+
+    __m128i s[8];
+    for (int i = 0; i < 8; i++) {
+        s[i] = _mm_set1_epi32((int)mid->state[i]);
+    }
+    __m128i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+    for (int i = 0; i < 64; i++) {
+        __m128i t1 = _mm_add_epi32(_mm_add_epi32(h, SSE_BSIG1(e)),
+                                   _mm_add_epi32(SSE_CH(e, f, g),
+                                                 _mm_add_epi32(_mm_set1_epi32((int)sha256_k[i]), w[i])));
+        __m128i t2 = _mm_add_epi32(SSE_BSIG0(a), SSE_MAJ(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = _mm_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm_add_epi32(t1, t2);
+    }
+
+    uint32_t out[8 * 4];
+    __m128i result[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; i++) {
+        _mm_storeu_si128((__m128i*)(out + i * 4), _mm_add_epi32(result[i], s[i]));
+    }
+    store_lane_digests(out, 4, digests);
+}
+
+static int sse2_supported(void) {
+    return __builtin_cpu_supports("sse2");
+}
+
+// ---------------------------------------------------------------------
+// AVX2: eight candidates per call
+// ---------------------------------------------------------------------
+
+#define AVX_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define AVX_CH(x, y, z) _mm256_xor_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(x, z))
+#define AVX_MAJ(x, y, z) _mm256_or_si256(_mm256_and_si256(x, y), _mm256_and_si256(z, _mm256_or_si256(x, y)))
+#define AVX_BSIG0(x) _mm256_xor_si256(_mm256_xor_si256(AVX_ROTR(x, 2), AVX_ROTR(x, 13)), AVX_ROTR(x, 22))
+#define AVX_BSIG1(x) _mm256_xor_si256(_mm256_xor_si256(AVX_ROTR(x, 6), AVX_ROTR(x, 11)), AVX_ROTR(x, 25))
+#define AVX_SSIG0(x) _mm256_xor_si256(_mm256_xor_si256(AVX_ROTR(x, 7), AVX_ROTR(x, 18)), _mm256_srli_epi32(x, 3))
+#define AVX_SSIG1(x) _mm256_xor_si256(_mm256_xor_si256(AVX_ROTR(x, 17), AVX_ROTR(x, 19)), _mm256_srli_epi32(x, 10))
+
+__attribute__((target("avx2")))
+static void avx2_hash_tail(const Sha256Midstate* mid, int word_index, const uint32_t* words,
+                           unsigned char digests[][SHA256_DIGEST_SIZE]) {
+    __m256i w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (i == word_index) ? _mm256_loadu_si256((const __m256i*)words)
+                                 : _mm256_set1_epi32((int)mid->tail[i]);
+    }
+    for (int i = 16; i < 64; i++) {
+        w[i] = _mm256_add_epi32(_mm256_add_epi32(AVX_SSIG1(w[i - 2]), w[i - 7]),
+                                _mm256_add_epi32(AVX_SSIG0(w[i - 15]), w[i - 16]));
+    }
+
+    __m256i s[8];
+    for (int i = 0; i < 8; i++) {
+        s[i] = _mm256_set1_epi32((int)mid->state[i]);
+    }
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+    for (int i = 0; i < 64; i++) {
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, AVX_BSIG1(e)),
+                                      _mm256_add_epi32(AVX_CH(e, f, g),
+                                                       _mm256_add_epi32(_mm256_set1_epi32((int)sha256_k[i]), w[i])));
+        __m256i t2 = _mm256_add_epi32(AVX_BSIG0(a), AVX_MAJ(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t1, t2);
+    }
+
+    uint32_t out[8 * 8];
+    __m256i result[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i*)(out + i * 8), _mm256_add_epi32(result[i], s[i]));
+    }
+    store_lane_digests(out, 8, digests);
+}
+
+static int avx2_supported(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+// ---------------------------------------------------------------------
+// SHA-NI: one candidate per call using the SHA extensions, which beat
+// the multi-buffer kernels per hash on CPUs that have them
+// ---------------------------------------------------------------------
+
+__attribute__((target("sha,sse4.1")))
+static void shani_hash_tail(const Sha256Midstate* mid, int word_index, const uint32_t* words,
+                            unsigned char digests[][SHA256_DIGEST_SIZE]) {
+    uint32_t block[16];
+    for (int i = 0; i < 16; i++) {
+        block[i] = mid->tail[i];
+    }
+    block[word_index] = words[0];
+
+    // Rearrange A..H into the ABEF/CDGH layout used by sha256rnds2
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&mid->state[0]), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&mid->state[4]), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+    __m128i abef_save = state0;
+    __m128i cdgh_save = state1;
+
+    // Four rounds per group; msg[j % 4] holds schedule words 4j..4j+3
+    __m128i msg[4];
+    for (int j = 0; j < 4; j++) {
+        msg[j] = _mm_loadu_si128((const __m128i*)&block[j * 4]);
+    }
+
+    for (int group = 0; group < 16; group++) {
+        __m128i current = msg[group % 4];
+        __m128i rounds = _mm_add_epi32(current, _mm_loadu_si128((const __m128i*)&sha256_k[group * 4]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, rounds);
+
+        // Finish words 4(group+1).. from the partial schedule started earlier
+        if (group >= 3 && group <= 14) {
+            __m128i next = msg[(group + 1) % 4];
+            next = _mm_add_epi32(next, _mm_alignr_epi8(current, msg[(group + 3) % 4], 4));
+            msg[(group + 1) % 4] = _mm_sha256msg2_epu32(next, current);
+        }
+
+        rounds = _mm_shuffle_epi32(rounds, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, rounds);
+
+        // Start words 4(group+3).. in the slot of the group just consumed
+        if (group >= 1 && group <= 12) {
+            msg[(group + 3) % 4] = _mm_sha256msg1_epu32(msg[(group + 3) % 4], current);
+        }
+    }
+
+    state0 = _mm_add_epi32(state0, abef_save);
+    state1 = _mm_add_epi32(state1, cdgh_save);
+
+    // Back to A..H order
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    uint32_t out[8];
+    _mm_storeu_si128((__m128i*)&out[0], state0);
+    _mm_storeu_si128((__m128i*)&out[4], state1);
+    store_lane_digests(out, 1, digests);
+}
+
+static int shani_supported(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return (ebx & bit_SHA) != 0 && __builtin_cpu_supports("sse4.1");
+}
+
+const Sha256Kernel sha256_kernel_shani = {"sha-ni", 1, shani_hash_tail, shani_supported};
+const Sha256Kernel sha256_kernel_avx2 = {"avx2", 8, avx2_hash_tail, avx2_supported};
+const Sha256Kernel sha256_kernel_sse2 = {"sse2", 4, sse2_hash_tail, sse2_supported};
+
+#endif // __x86_64__ || __i386__
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include "stats.h"
+
+void chain_stats_init(ChainStats* stats) {
+    if (stats) {
+        stats->transactions = 0;
+        stats->ciphertext_bytes = 0;
+        stats->first_timestamp = 0;
+        stats->last_timestamp = 0;
+        stats->record_types = NULL;
+        stats->record_type_count = 0;
+        stats->record_type_capacity = 0;
+    }
+}
+
+void chain_stats_free(ChainStats* stats) {
+    if (stats) {
+        free(stats->record_types);
+        chain_stats_init(stats);
+    }
+}
+
+// There are few record types, so a short array scan finds a type's count
+static RecordTypeCount* find_type_count(const ChainStats* stats, StringId record_type) {
+    for (size_t i = 0; i < stats->record_type_count; i++) {
+        if (stats->record_types[i].record_type == record_type) {
+            return &stats->record_types[i];
+        }
+    }
+    return NULL;
+}
+
+// Room for the record types of a block that are not counted yet, so
+// counting the block cannot fail halfway
+static int reserve_record_types(ChainStats* stats, const Block* block) {
+    size_t needed = stats->record_type_count;
+    for (int i = 0; i < block->transaction_count; i++) {
+        if (!find_type_count(stats, block->transactions[i].record_type)) {
+            needed++;  // May count a new type twice; only the capacity grows
+        }
+    }
+    if (needed <= stats->record_type_capacity) {
+        return 1;
+    }
+
+    size_t capacity = stats->record_type_capacity ? stats->record_type_capacity * 2 : 8;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    RecordTypeCount* record_types = (RecordTypeCount*)realloc(stats->record_types, sizeof(RecordTypeCount) * capacity);
+    if (!record_types) {
+        return 0;
+    }
+    stats->record_types = record_types;
+    stats->record_type_capacity = capacity;
+    return 1;
+}
+
+// Count one record of a type; capacity for a new type is reserved
+static void count_record_type(ChainStats* stats, StringId record_type) {
+    RecordTypeCount* entry = find_type_count(stats, record_type);
+    if (!entry) {
+        entry = &stats->record_types[stats->record_type_count++];
+        entry->record_type = record_type;
+        entry->count = 0;
+    }
+    entry->count++;
+}
+
+// Fold a newly added block into the totals. On failure the totals are
+// unchanged.
+int chain_stats_add_block(ChainStats* stats, const Block* block) {
+    if (!stats || !block || !reserve_record_types(stats, block)) {
+        return 0;
+    }
+
+    for (int i = 0; i < block->transaction_count; i++) {
+        const Transaction* transaction = &block->transactions[i];
+        count_record_type(stats, transaction->record_type);
+
+        if (stats->transactions == 0 || transaction->timestamp < stats->first_timestamp) {
+            stats->first_timestamp = transaction->timestamp;
+        }
+        if (stats->transactions == 0 || transaction->timestamp > stats->last_timestamp) {
+            stats->last_timestamp = transaction->timestamp;
+        }
+        stats->transactions++;
+        if (transaction->encrypted_data) {
+            stats->ciphertext_bytes += transaction->encrypted_data->data_len;
+        }
+    }
+    return 1;
+}
+
+uint64_t chain_stats_type_count(const ChainStats* stats, StringId record_type) {
+    const RecordTypeCount* entry = stats ? find_type_count(stats, record_type) : NULL;
+    return entry ? entry->count : 0;
+}
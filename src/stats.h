@@ -0,0 +1,33 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "block.h"
+
+// Transactions of one record type in the chain
+typedef struct {
+    StringId record_type;
+    uint64_t count;
+} RecordTypeCount;
+
+// Totals over the chain's mined transactions, kept up to date as blocks
+// are added so reading them never walks the chain
+typedef struct {
+    uint64_t transactions;
+    uint64_t ciphertext_bytes;      // Encrypted record bytes, without IVs
+    time_t first_timestamp;         // Earliest and latest record; 0 while there are none
+    time_t last_timestamp;
+    RecordTypeCount* record_types;  // In order of first appearance
+    size_t record_type_count;
+    size_t record_type_capacity;
+} ChainStats;
+
+// Function declarations
+void chain_stats_init(ChainStats* stats);
+void chain_stats_free(ChainStats* stats);
+int chain_stats_add_block(ChainStats* stats, const Block* block);
+uint64_t chain_stats_type_count(const ChainStats* stats, StringId record_type);
+
+#endif // STATS_H
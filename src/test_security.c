@@ -1,10 +1,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "block.h"
 #include "blockchain.h"
 #include "security.h"
+#include "sha256.h"
+#include "merkle.h"
+#include "mempool.h"
+#include "ingest.h"
+#include "pool.h"
+#include "keys.h"
+#include "rekey.h"
+#include "mining.h"
+#include "utils.h"
+#include "persistence.h"
 
 // Test data
 const char* TEST_PATIENT_ID = "P12345";
@@ -12,6 +27,31 @@ const char* TEST_RECORD_TYPE = "diagnosis";
 const char* TEST_MEDICAL_DATA = "Patient shows symptoms of fever and cough. Prescribed rest and medication.";
 const char* TEST_PASSWORD = "secure_password123";
 
+// Mine `count` blocks of one record each onto the chain at its current
+// difficulty. Callers wanting a fixed difficulty set retarget_interval to 0.
+static int mine_test_blocks(Blockchain* chain, int count, const unsigned char* key) {
+    for (int b = 0; b < count; b++) {
+        Transaction transaction;
+        memset(&transaction, 0, sizeof(Transaction));
+        char patient_id[DICTIONARY_STRING_SIZE];
+        snprintf(patient_id, sizeof(patient_id), "B%05u", chain->block_count);
+        transaction.patient_id = intern_string(patient_id);
+        transaction.record_type = intern_string("visit");
+        transaction.timestamp = time(NULL);
+        transaction.encrypted_data = encrypt_data(TEST_MEDICAL_DATA, key);
+        if (!submit_transaction(chain, &transaction)) {
+            free_encrypted_data(transaction.encrypted_data);
+            return 0;
+        }
+        Block* block = build_block_template(chain);
+        if (!block || !mine_block(chain, block) || !add_block(chain, block)) {
+            discard_block_template(chain, block);
+            return 0;
+        }
+    }
+    return 1;
+}
+
 void test_encryption(const unsigned char* key) {
     printf("\n=== Testing Encryption ===\n");
     
@@ -131,8 +171,8 @@ void test_blockchain_security(const unsigned char* key) {
     
     // Create and add a transaction
     Transaction transaction;
-    strncpy(transaction.patient_id, TEST_PATIENT_ID, sizeof(transaction.patient_id) - 1);
-    strncpy(transaction.record_type, TEST_RECORD_TYPE, sizeof(transaction.record_type) - 1);
+    transaction.patient_id = intern_string(TEST_PATIENT_ID);
+    transaction.record_type = intern_string(TEST_RECORD_TYPE);
     transaction.timestamp = time(NULL);
     
     // Encrypt the medical data
@@ -171,11 +211,1790 @@ void test_blockchain_security(const unsigned char* key) {
     printf("\nBlock Contents:\n");
     print_block(chain->latest, key);
     
-    // Cleanup
-    free_encrypted_data(transaction.encrypted_data);
+    // Cleanup (the block owns the encrypted data)
+    free_blockchain(chain);
+}
+
+void test_sha256_kernels(void) {
+    printf("\n=== Testing SHA-256 Mining Kernels ===\n");
+
+    // An 80-byte header-sized message with no NUL bytes, so sha256() can hash it as a string
+    char message[BLOCK_HEADER_SIZE + 1];
+    for (int i = 0; i < BLOCK_HEADER_SIZE; i++) {
+        message[i] = (char)('A' + i % 26);
+    }
+    message[BLOCK_HEADER_SIZE] = '\0';
+
+    Sha256Midstate mid;
+    if (!sha256_midstate_init(&mid, (const unsigned char*)message, BLOCK_HEADER_SIZE)) {
+        printf("❌ Midstate initialization failed\n");
+        return;
+    }
+
+    int word_index = (BLOCK_NONCE_OFFSET - SHA256_BLOCK_SIZE) / 4;
+    int count;
+    const Sha256Kernel* const* kernels = sha256_kernels(&count);
+    for (int k = 0; k < count; k++) {
+        const Sha256Kernel* kernel = kernels[k];
+        if (!kernel->supported()) {
+            printf("-  %s kernel not supported on this CPU\n", kernel->name);
+            continue;
+        }
+
+        // Candidate nonces whose bytes are all printable
+        uint32_t words[SHA256_MAX_LANES];
+        unsigned char digests[SHA256_MAX_LANES][SHA256_DIGEST_SIZE];
+        for (int lane = 0; lane < kernel->lanes; lane++) {
+            words[lane] = 0x30313233 + (uint32_t)lane;
+        }
+        kernel->hash_tail(&mid, word_index, words, digests);
+
+        int matches = 1;
+        for (int lane = 0; lane < kernel->lanes; lane++) {
+            char expected[HASH_SIZE + 1];
+            char actual[HASH_SIZE + 1];
+            for (int b = 0; b < 4; b++) {
+                message[BLOCK_NONCE_OFFSET + b] = (char)(words[lane] >> (24 - 8 * b));
+            }
+            sha256(message, expected);
+            str_to_hex(digests[lane], actual, SHA256_DIGEST_SIZE);
+            if (strcmp(expected, actual) != 0) {
+                matches = 0;
+            }
+        }
+
+        if (matches) {
+            printf("✅ %s kernel (%d lanes) matches sha256()\n", kernel->name, kernel->lanes);
+        } else {
+            printf("❌ %s kernel (%d lanes) differs from sha256()\n", kernel->name, kernel->lanes);
+        }
+    }
+    printf("Selected kernel: %s\n", sha256_best_kernel()->name);
+}
+
+void test_merkle_proofs(const unsigned char* key) {
+    printf("\n=== Testing Merkle Inclusion Proofs ===\n");
+
+    Block* block = create_block(1, NULL);
+    if (!block) {
+        printf("❌ Block creation failed\n");
+        return;
+    }
+
+    // An odd count exercises the carried-up last node
+    const int count = 7;
+    for (int i = 0; i < count; i++) {
+        Transaction transaction;
+        memset(&transaction, 0, sizeof(Transaction));
+        char patient_id[DICTIONARY_STRING_SIZE];
+        snprintf(patient_id, sizeof(patient_id), "P%05d", i);
+        transaction.patient_id = intern_string(patient_id);
+        transaction.record_type = intern_string(TEST_RECORD_TYPE);
+        transaction.timestamp = time(NULL) + i;
+        transaction.encrypted_data = encrypt_data(TEST_MEDICAL_DATA, key);
+        if (!add_transaction(block, &transaction, key)) {
+            printf("❌ Transaction addition failed\n");
+            free_encrypted_data(transaction.encrypted_data);
+            free_block(block);
+            return;
+        }
+    }
+
+    int all_valid = 1;
+    for (int i = 0; i < count; i++) {
+        MerkleProof proof;
+        if (!build_merkle_proof(block, i, &proof) || !verify_merkle_proof(&proof, block->merkle_root)) {
+            all_valid = 0;
+        }
+    }
+    printf("%s Proofs for all %d transactions verify\n", all_valid ? "✅" : "❌", count);
+
+    // Root computation reports its status; an empty block has the zero root
+    unsigned char root[HASH_BYTES];
+    unsigned char zeros[HASH_BYTES] = {0};
+    Block* empty = create_block(2, NULL);
+    printf("%s Merkle root computation reports success and failure\n",
+           calculate_merkle_root(block, root) && memcmp(root, block->merkle_root, HASH_BYTES) == 0 &&
+           empty && calculate_merkle_root(empty, root) && memcmp(root, zeros, HASH_BYTES) == 0 &&
+           !calculate_merkle_root(NULL, root) ? "✅" : "❌");
+    free_block(empty);
+
+    MerkleProof proof;
+    build_merkle_proof(block, 2, &proof);
+    proof.steps[0].sibling[0] ^= 0x01;
+    printf("%s Tampered proof rejected\n", verify_merkle_proof(&proof, block->merkle_root) ? "❌" : "✅");
+
+    block->transactions[3].patient_id = intern_string("P99999");
+    printf("%s Tampered transaction fails block verification\n", verify_block(block) ? "❌" : "✅");
+
+    free_block(block);
+}
+
+void test_patient_index(const unsigned char* key) {
+    printf("\n=== Testing Patient Index ===\n");
+
+    Blockchain* chain = create_blockchain();
+    if (!chain) {
+        printf("❌ Blockchain creation failed\n");
+        return;
+    }
+
+    // Interleave two patients in one mined block
+    const int count = 6;
+    for (int i = 0; i < count; i++) {
+        Transaction transaction;
+        memset(&transaction, 0, sizeof(Transaction));
+        transaction.patient_id = intern_string(i % 2 ? "P00002" : "P00001");
+        transaction.record_type = intern_string(TEST_RECORD_TYPE);
+        transaction.timestamp = time(NULL) + i;
+        transaction.encrypted_data = encrypt_data(TEST_MEDICAL_DATA, key);
+        if (!submit_transaction(chain, &transaction)) {
+            printf("❌ Transaction submission failed\n");
+            free_encrypted_data(transaction.encrypted_data);
+            free_blockchain(chain);
+            return;
+        }
+    }
+    printf("%s Pending records are not indexed before mining\n",
+           patient_index_lookup(&chain->patient_index, find_string("P00002")) ? "❌" : "✅");
+
+    Block* block = build_block_template(chain);
+    if (!block || !mine_block(chain, block) || !add_block(chain, block)) {
+        printf("❌ Mining the pending records failed\n");
+        discard_block_template(chain, block);
+        free_blockchain(chain);
+        return;
+    }
+
+    const PatientEntry* entry = patient_index_lookup(&chain->patient_index, find_string("P00002"));
+    int found = entry && entry->ref_count == 3;
+    for (size_t i = 0; found && i < entry->ref_count; i++) {
+        const Block* block = get_block_by_id(chain, entry->refs[i].block_id);
+        found = block && strcmp(string_for_id(block->transactions[entry->refs[i].slot].patient_id), "P00002") == 0;
+    }
+    printf("%s Index returns every record of a patient\n", found ? "✅" : "❌");
+    printf("%s Unknown patient has no entry\n",
+           patient_index_lookup(&chain->patient_index, find_string("P99999")) ? "❌" : "✅");
+
+    // Reinstalling the blocks must rebuild the same index
+    Block* copy = create_block(0, NULL);
+    if (copy) {
+        for (int i = 0; i < 2; i++) {
+            Transaction transaction;
+            memset(&transaction, 0, sizeof(Transaction));
+            transaction.patient_id = intern_string("P00003");
+            transaction.record_type = intern_string(TEST_RECORD_TYPE);
+            transaction.timestamp = time(NULL);
+            transaction.encrypted_data = encrypt_data(TEST_MEDICAL_DATA, key);
+            add_transaction(copy, &transaction, key);
+        }
+        int replaced = replace_blocks(chain, copy);
+        if (!replaced) {
+            free_block(copy);
+        }
+        entry = patient_index_lookup(&chain->patient_index, find_string("P00003"));
+        printf("%s Index rebuilt when blocks are replaced\n",
+               replaced && entry && entry->ref_count == 2 &&
+               !patient_index_lookup(&chain->patient_index, find_string("P00001")) ? "✅" : "❌");
+    }
+
+    free_blockchain(chain);
+}
+
+// Stops a range query after `limit` matches
+static int count_until_limit(const TxRef* ref, time_t timestamp, void* context) {
+    (void)ref;
+    (void)timestamp;
+    int* remaining = (int*)context;
+    return --(*remaining) > 0;
+}
+
+void test_record_type_index(void) {
+    printf("\n=== Testing Record Type Index ===\n");
+
+    RecordTypeIndex index;
+    record_type_index_init(&index);
+
+    // Out-of-order timestamps must still come back sorted
+    const time_t base = 1700000000;
+    const int offsets[] = {50, 10, 30, 20, 40, 0};
+    int added = 1;
+    for (int i = 0; i < 6; i++) {
+        added &= record_type_index_add(&index, intern_string("prescription"), base + offsets[i], (uint32_t)i, 0);
+        added &= record_type_index_add(&index, intern_string("visit"), base + offsets[i], (uint32_t)i, 1);
+    }
+    printf("%s Records indexed\n", added ? "✅" : "❌");
+
+    const RecordTypeEntry* entry = &index.entries[0];
+    int sorted = entry->ref_count == 6;
+    for (size_t i = 1; sorted && i < entry->ref_count; i++) {
+        sorted = entry->refs[i - 1].timestamp <= entry->refs[i].timestamp;
+    }
+    printf("%s Entries kept in timestamp order\n", sorted ? "✅" : "❌");
+
+    size_t matches = record_type_index_query(&index, intern_string("prescription"), base + 10, base + 40, NULL, NULL);
+    printf("%s Inclusive range returns %zu of 4 records\n", matches == 4 ? "✅" : "❌", matches);
+    matches = record_type_index_query(&index, intern_string("diagnosis"), base, base + 50, NULL, NULL);
+    printf("%s Unknown type returns nothing\n", matches == 0 ? "✅" : "❌");
+
+    int limit = 2;
+    matches = record_type_index_query(&index, intern_string("visit"), base, base + 50, count_until_limit, &limit);
+    printf("%s Visitor can stop the scan early\n", matches == 2 ? "✅" : "❌");
+
+    // A block that fails to be added is backed out of both indexes
+    record_type_index_remove(&index, intern_string("visit"), base + 30, 2, 1);
+    record_type_index_remove(&index, intern_string("visit"), base + 30, 9, 1);  // Not indexed
+    matches = record_type_index_query(&index, intern_string("visit"), base, base + 50, NULL, NULL);
+    PatientIndex patients;
+    int removed = matches == 5 && patient_index_init(&patients) &&
+                  patient_index_add(&patients, intern_string("P1"), 1, 0) &&
+                  patient_index_add(&patients, intern_string("P1"), 2, 0);
+    patient_index_remove_latest(&patients, intern_string("P1"), 1, 0);  // Not the latest
+    patient_index_remove_latest(&patients, intern_string("P1"), 2, 0);
+    const PatientEntry* patient = patient_index_lookup(&patients, intern_string("P1"));
+    printf("%s Indexed refs can be backed out\n",
+           removed && patient && patient->ref_count == 1 && patient->refs[0].block_id == 1 ? "✅" : "❌");
+    patient_index_free(&patients);
+
+    record_type_index_free(&index);
+}
+
+void test_block_bloom_filters(const unsigned char* key) {
+    printf("\n=== Testing Block Bloom Filters ===\n");
+
+    Block* block = create_block(1, NULL);
+    if (!block) {
+        printf("❌ Block creation failed\n");
+        return;
+    }
+
+    const int count = 10;
+    for (int i = 0; i < count; i++) {
+        Transaction transaction;
+        memset(&transaction, 0, sizeof(Transaction));
+        char patient_id[DICTIONARY_STRING_SIZE];
+        snprintf(patient_id, sizeof(patient_id), "P%05d", i);
+        transaction.patient_id = intern_string(patient_id);
+        transaction.record_type = intern_string(i % 2 ? "visit" : TEST_RECORD_TYPE);
+        transaction.timestamp = time(NULL);
+        transaction.encrypted_data = encrypt_data(TEST_MEDICAL_DATA, key);
+        if (!add_transaction(block, &transaction, key)) {
+            printf("❌ Transaction addition failed\n");
+            free_encrypted_data(transaction.encrypted_data);
+            free_block(block);
+            return;
+        }
+    }
+
+    int all_present = 1;
+    for (int i = 0; i < count; i++) {
+        char patient_id[32];
+        snprintf(patient_id, sizeof(patient_id), "P%05d", i);
+        all_present &= block_may_contain(block, patient_id, i % 2 ? "visit" : TEST_RECORD_TYPE);
+    }
+    printf("%s No false negatives for present keys\n", all_present ? "✅" : "❌");
+
+    int false_positives = 0;
+    const int probes = 1000;
+    for (int i = 0; i < probes; i++) {
+        char patient_id[32];
+        snprintf(patient_id, sizeof(patient_id), "Q%05d", i);
+        false_positives += block_may_contain(block, patient_id, NULL);
+    }
+    printf("%s Absent patients rejected (%d/%d false positives)\n",
+           false_positives < probes / 20 ? "✅" : "❌", false_positives, probes);
+    printf("%s Patient id does not match as a record type\n",
+           block_may_contain(block, NULL, "P00000") ? "❌" : "✅");
+
+    unsigned char saved[BLOOM_MIN_BYTES];
+    memcpy(saved, block->bloom, BLOOM_MIN_BYTES);
+    rebuild_block_bloom(block);
+    printf("%s Rebuilt filter matches the incremental one\n",
+           block->bloom_bytes == BLOOM_MIN_BYTES && memcmp(saved, block->bloom, BLOOM_MIN_BYTES) == 0 ? "✅" : "❌");
+
+    free_block(block);
+}
+
+static int add_test_record(Block* block, int i, const unsigned char* key) {
+    Transaction transaction;
+    memset(&transaction, 0, sizeof(Transaction));
+    char patient_id[DICTIONARY_STRING_SIZE];
+    snprintf(patient_id, sizeof(patient_id), "P%05d", i);
+    transaction.patient_id = intern_string(patient_id);
+    transaction.record_type = intern_string(TEST_RECORD_TYPE);
+    transaction.timestamp = time(NULL);
+    transaction.encrypted_data = encrypt_data(TEST_MEDICAL_DATA, key);
+    if (!add_transaction(block, &transaction, key)) {
+        free_encrypted_data(transaction.encrypted_data);
+        return 0;
+    }
+    return 1;
+}
+
+void test_block_limits(const unsigned char* key) {
+    printf("\n=== Testing Variable-Capacity Blocks ===\n");
+
+    Block* block = create_block(1, NULL);
+    if (!block) {
+        printf("❌ Block creation failed\n");
+        return;
+    }
+
+    // Well past the old fixed capacity of 10
+    const int count = 500;
+    int added = 1;
+    for (int i = 0; i < count && added; i++) {
+        added = add_test_record(block, i, key);
+    }
+    printf("%s %d transactions added to one block\n", added ? "✅" : "❌", block->transaction_count);
+
+    int present = 1;
+    for (int i = 0; i < count; i++) {
+        char patient_id[32];
+        snprintf(patient_id, sizeof(patient_id), "P%05d", i);
+        present &= block_may_contain(block, patient_id, NULL);
+    }
+    printf("%s Bloom filter grew to %u bytes without false negatives\n",
+           present && block->bloom_bytes > BLOOM_MIN_BYTES ? "✅" : "❌", block->bloom_bytes);
+
+    MerkleProof proof;
+    printf("%s Block verifies and the last transaction is provable\n",
+           verify_block(block) && build_merkle_proof(block, count - 1, &proof) &&
+           verify_merkle_proof(&proof, block->merkle_root) ? "✅" : "❌");
+
+    block->max_transactions = (uint32_t)block->transaction_count;
+    printf("%s Count limit rejects further transactions\n", add_test_record(block, count, key) ? "❌" : "✅");
+
+    block->max_transactions = DEFAULT_MAX_BLOCK_TRANSACTIONS;
+    block->max_bytes = block->payload_bytes + 10;
+    printf("%s Byte limit rejects a transaction that does not fit\n",
+           add_test_record(block, count, key) ? "❌" : "✅");
+
+    free_block(block);
+
+    // A record too large for a block must not wedge the queue behind it
+    Blockchain* chain = create_blockchain();
+    if (!chain) {
+        printf("❌ Blockchain creation failed\n");
+        return;
+    }
+    printf("%s Byte limit below the largest record is refused\n",
+           max_transaction_size() <= MIN_BLOCK_BYTES && !set_block_limits(chain, 1, MIN_BLOCK_BYTES - 1) &&
+           set_block_limits(chain, DEFAULT_MAX_BLOCK_TRANSACTIONS, MIN_BLOCK_BYTES) ? "✅" : "❌");
+
+    char oversized[MAX_RECORD_DATA_BYTES * 4 + 1];
+    memset(oversized, 'x', sizeof(oversized) - 1);
+    oversized[sizeof(oversized) - 1] = '\0';
+    const char* texts[] = {oversized, TEST_MEDICAL_DATA};
+    int submitted[2];
+    Transaction transactions[2];
+    for (int i = 0; i < 2; i++) {
+        memset(&transactions[i], 0, sizeof(Transaction));
+        transactions[i].patient_id = intern_string(i ? "P00002" : "P00001");
+        transactions[i].record_type = intern_string("visit");
+        transactions[i].timestamp = time(NULL);
+        transactions[i].encrypted_data = encrypt_data(texts[i], key);
+        submitted[i] = submit_transaction(chain, &transactions[i]);
+        if (!submitted[i]) {
+            free_encrypted_data(transactions[i].encrypted_data);
+        }
+    }
+    printf("%s Oversized record refused, the next one accepted\n", !submitted[0] && submitted[1] ? "✅" : "❌");
+
+    // One that reached the mempool anyway (an older mempool file) is dropped
+    drain_ingest_queue(chain);
+    memset(&transactions[0], 0, sizeof(Transaction));
+    transactions[0].patient_id = intern_string("P00001");
+    transactions[0].record_type = intern_string("emergency");
+    transactions[0].timestamp = time(NULL);
+    transactions[0].encrypted_data = encrypt_data(oversized, key);
+    if (!mempool_add(&chain->mempool, &transactions[0])) {
+        free_encrypted_data(transactions[0].encrypted_data);
+    }
+    Block* next = build_block_template(chain);
+    printf("%s Oversized pending record dropped, the next one mined\n",
+           next && next->transaction_count == 1 && chain->mempool.dropped == 1 &&
+           mempool_count(&chain->mempool) == 0 ? "✅" : "❌");
+    discard_block_template(chain, next);
+    free_blockchain(chain);
+}
+
+void test_mempool(const unsigned char* key) {
+    printf("\n=== Testing Mempool ===\n");
+
+    Mempool mempool;
+    if (!mempool_init(&mempool)) {
+        printf("❌ Mempool creation failed\n");
+        return;
+    }
+
+    // Urgent records jump the queue but keep arrival order among themselves
+    const char* types[] = {"visit", "emergency", "diagnosis", "emergency", "visit"};
+    for (int i = 0; i < 5; i++) {
+        Transaction transaction;
+        memset(&transaction, 0, sizeof(Transaction));
+        char patient_id[DICTIONARY_STRING_SIZE];
+        snprintf(patient_id, sizeof(patient_id), "P%05d", i);
+        transaction.patient_id = intern_string(patient_id);
+        transaction.record_type = intern_string(types[i]);
+        transaction.timestamp = time(NULL);
+        transaction.encrypted_data = encrypt_data(TEST_MEDICAL_DATA, key);
+        if (!mempool_add(&mempool, &transaction)) {
+            printf("❌ Transaction submission failed\n");
+            free_encrypted_data(transaction.encrypted_data);
+        }
+    }
+    printf("%s %zu transactions pending\n", mempool_count(&mempool) == 5 ? "✅" : "❌", mempool_count(&mempool));
+
+    Block* block = create_block(1, NULL);
+    if (!block) {
+        printf("❌ Block creation failed\n");
+        mempool_free(&mempool);
+        return;
+    }
+    block->max_transactions = 3;
+
+    const char* expected[] = {"P00001", "P00003", "P00000"};
+    int moved = mempool_fill_block(&mempool, block);
+    int ordered = moved == 3;
+    for (int i = 0; ordered && i < 3; i++) {
+        ordered = strcmp(string_for_id(block->transactions[i].patient_id), expected[i]) == 0;
+    }
+    printf("%s Template filled to its limit, urgent records first\n", ordered ? "✅" : "❌");
+    printf("%s Template is hashed over its transactions\n", verify_block(block) ? "✅" : "❌");
+    printf("%s Records that did not fit stay pending\n",
+           mempool_count(&mempool) == 2 && mempool.dropped == 0 ? "✅" : "❌");
+
+    // A discarded template gives its records back in their original order
+    mempool_return_block(&mempool, block);
+    const Transaction* first = mempool_at(&mempool, MEMPOOL_URGENT, 0);
+    const Transaction* normal = mempool_at(&mempool, MEMPOOL_NORMAL, 0);
+    printf("%s Returned records are pending again in order\n",
+           mempool_count(&mempool) == 5 && block->transaction_count == 0 && first && normal &&
+           strcmp(string_for_id(first->patient_id), "P00001") == 0 &&
+           strcmp(string_for_id(normal->patient_id), "P00000") == 0 ? "✅" : "❌");
+
+    // A head record no block accepts (as an older mempool file could hold)
+    // is dropped rather than leaving every later template empty
+    if (normal) {
+        ((Transaction*)normal)->record_type = STRING_ID_NONE;
+    }
+    block->max_transactions = 10;
+    moved = mempool_fill_block(&mempool, block);
+    printf("%s Unusable record dropped, the rest mined (%d moved)\n",
+           moved == 4 && mempool.dropped == 1 && mempool_count(&mempool) == 0 && verify_block(block) ? "✅" : "❌",
+           moved);
+
+    free_block(block);
+    mempool_free(&mempool);
+}
+
+#define INGEST_TEST_PRODUCERS 4
+#define INGEST_TEST_RECORDS 2000
+
+typedef struct {
+    IngestQueue* queue;
+    int producer;
+    const unsigned char* key;
+    unsigned long long refused;   // Submissions that met a full queue
+} IngestProducer;
+
+// Submit records tagged with producer and sequence, retrying while the queue is full
+static void* ingest_producer(void* arg) {
+    IngestProducer* producer = (IngestProducer*)arg;
+    for (int i = 0; i < INGEST_TEST_RECORDS; i++) {
+        Transaction transaction;
+        memset(&transaction, 0, sizeof(Transaction));
+        char patient_id[DICTIONARY_STRING_SIZE];
+        snprintf(patient_id, sizeof(patient_id), "T%d-%05d", producer->producer, i);
+        transaction.patient_id = intern_string(patient_id);
+        transaction.record_type = intern_string("visit");
+        transaction.timestamp = time(NULL);
+        transaction.encrypted_data = encrypt_data("intake", producer->key);
+        while (!ingest_submit(producer->queue, &transaction)) {
+            producer->refused++;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+void test_ingest_queue(const unsigned char* key) {
+    printf("\n=== Testing Ingest Queue ===\n");
+
+    IngestQueue* queue = ingest_queue_create(256);
+    Mempool mempool;
+    if (!queue || !mempool_init(&mempool)) {
+        printf("❌ Queue creation failed\n");
+        ingest_queue_free(queue);
+        return;
+    }
+    mempool.max_pending = INGEST_TEST_PRODUCERS * INGEST_TEST_RECORDS;
+
+    // A small queue and several producers force contention and backpressure
+    pthread_t threads[INGEST_TEST_PRODUCERS];
+    IngestProducer producers[INGEST_TEST_PRODUCERS];
+    for (int i = 0; i < INGEST_TEST_PRODUCERS; i++) {
+        producers[i] = (IngestProducer){queue, i, key, 0};
+        pthread_create(&threads[i], NULL, ingest_producer, &producers[i]);
+    }
+
+    size_t expected = (size_t)INGEST_TEST_PRODUCERS * INGEST_TEST_RECORDS;
+    while (mempool_count(&mempool) < expected) {
+        if (ingest_drain(queue, &mempool) == 0) {
+            sched_yield();
+        }
+    }
+    unsigned long long refused = 0;
+    for (int i = 0; i < INGEST_TEST_PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+        refused += producers[i].refused;
+    }
+    printf("%s All %zu concurrent submissions reached the mempool\n",
+           mempool_count(&mempool) == expected ? "✅" : "❌", expected);
+
+    // Each producer's records must arrive in the order it submitted them
+    int next[INGEST_TEST_PRODUCERS] = {0};
+    int ordered = 1;
+    const Transaction* transaction;
+    for (size_t i = 0; (transaction = mempool_at(&mempool, MEMPOOL_NORMAL, i)) != NULL; i++) {
+        int producer, sequence;
+        if (sscanf(string_for_id(transaction->patient_id), "T%d-%d", &producer, &sequence) != 2 ||
+            producer < 0 || producer >= INGEST_TEST_PRODUCERS || sequence != next[producer]++) {
+            ordered = 0;
+        }
+    }
+    printf("%s Per-producer submission order preserved\n", ordered ? "✅" : "❌");
+
+    IngestStats stats;
+    ingest_stats(queue, &stats);
+    printf("%s Counters: %llu submitted, %llu dropped, %.2f us average enqueue\n",
+           stats.submitted == expected && stats.dropped == refused && stats.queued == 0 ? "✅" : "❌",
+           stats.submitted, stats.dropped, stats.average_latency_us);
+
+    ingest_queue_free(queue);
+    mempool_free(&mempool);
+}
+
+void test_block_headers(const unsigned char* key) {
+    printf("\n=== Testing Block Headers ===\n");
+
+    Blockchain* chain = create_blockchain();
+    if (!chain) {
+        printf("❌ Blockchain creation failed\n");
+        return;
+    }
+    chain->difficulty = 8;
+
+    // Blocks of 1, 2 and 3 records
+    for (int b = 1; b <= 3; b++) {
+        for (int i = 0; i < b; i++) {
+            Transaction transaction;
+            memset(&transaction, 0, sizeof(Transaction));
+            char patient_id[DICTIONARY_STRING_SIZE];
+            snprintf(patient_id, sizeof(patient_id), "P%05d", b * 10 + i);
+            transaction.patient_id = intern_string(patient_id);
+            transaction.record_type = intern_string(TEST_RECORD_TYPE);
+            transaction.timestamp = time(NULL);
+            transaction.encrypted_data = encrypt_data(TEST_MEDICAL_DATA, key);
+            if (!submit_transaction(chain, &transaction)) {
+                free_encrypted_data(transaction.encrypted_data);
+            }
+        }
+        Block* block = build_block_template(chain);
+        if (!block || !mine_block(chain, block) || !add_block(chain, block)) {
+            printf("❌ Mining block %d failed\n", b);
+            discard_block_template(chain, block);
+            free_blockchain(chain);
+            return;
+        }
+    }
+
+    const uint64_t offsets[] = {0, 0, 1, 3};
+    int placed = chain->block_count == 4;
+    for (uint32_t i = 0; placed && i < chain->block_count; i++) {
+        const BlockHeader* header = get_block_header(chain, i);
+        placed = header && header->payload_offset == offsets[i] &&
+                 header->transaction_count == (uint32_t)chain->blocks[i]->transaction_count;
+    }
+    printf("%s Headers record each block's transaction offset\n", placed ? "✅" : "❌");
+    printf("%s Transaction count read from the last header: %d\n",
+           get_transaction_count(chain) == 6 ? "✅" : "❌", get_transaction_count(chain));
+    printf("%s Header is %zu bytes\n", sizeof(BlockHeader) == 2 * 64 ? "✅" : "❌", sizeof(BlockHeader));
+    printf("%s Chain verifies from its headers\n", verify_chain(chain) ? "✅" : "❌");
+
+    // A block that no longer matches its header, or a broken header link, fails verification
+    chain->blocks[2]->nonce++;
+    int stale = !verify_chain(chain);
+    chain->blocks[2]->nonce--;
+    chain->headers[3].previous_hash[0] ^= 1;
+    int unlinked = !verify_chain(chain);
+    chain->headers[3].previous_hash[0] ^= 1;
+    printf("%s Tampered block or header detected\n", stale && unlinked && verify_chain(chain) ? "✅" : "❌");
+
+    free_blockchain(chain);
+}
+
+#define DICTIONARY_TEST_THREADS 4
+#define DICTIONARY_TEST_STRINGS 500
+
+// Intern the same strings as every other thread, recording the ids seen
+static void* intern_worker(void* arg) {
+    StringId* ids = (StringId*)arg;
+    for (int i = 0; i < DICTIONARY_TEST_STRINGS; i++) {
+        char str[DICTIONARY_STRING_SIZE];
+        snprintf(str, sizeof(str), "D%05d", i);
+        ids[i] = intern_string(str);
+    }
+    return NULL;
+}
+
+void test_dictionary(void) {
+    printf("\n=== Testing Dictionary ===\n");
+
+    StringId visit = intern_string("visit");
+    printf("%s Equal strings share one id\n",
+           visit != STRING_ID_NONE && intern_string("visit") == visit && find_string("visit") == visit &&
+           intern_string("diagnosis") != visit ? "✅" : "❌");
+    printf("%s Ids resolve to their text\n", strcmp(string_for_id(visit), "visit") == 0 ? "✅" : "❌");
+
+    uint32_t size = dictionary_size();
+    printf("%s Lookups of unknown strings do not grow the table\n",
+           find_string("never-interned") == STRING_ID_NONE && dictionary_size() == size ? "✅" : "❌");
+    printf("%s Empty and unknown ids resolve to \"\"\n",
+           intern_string("") == STRING_ID_NONE && string_for_id(STRING_ID_NONE)[0] == '\0' &&
+           string_for_id(dictionary_size())[0] == '\0' ? "✅" : "❌");
+
+    // Strings longer than the old fixed-size fields are truncated the same way
+    const char* long_id = "PATIENT-0123456789-0123456789-0123456789";
+    StringId truncated = intern_string(long_id);
+    printf("%s Long strings are truncated to %d characters\n",
+           strlen(string_for_id(truncated)) == DICTIONARY_STRING_SIZE - 1 &&
+           strncmp(string_for_id(truncated), long_id, DICTIONARY_STRING_SIZE - 1) == 0 ? "✅" : "❌",
+           DICTIONARY_STRING_SIZE - 1);
+
+    // Concurrent interning hands every thread the same id for a string
+    pthread_t threads[DICTIONARY_TEST_THREADS];
+    static StringId ids[DICTIONARY_TEST_THREADS][DICTIONARY_TEST_STRINGS];
+    for (int t = 0; t < DICTIONARY_TEST_THREADS; t++) {
+        pthread_create(&threads[t], NULL, intern_worker, ids[t]);
+    }
+    for (int t = 0; t < DICTIONARY_TEST_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    int agreed = 1;
+    for (int i = 0; i < DICTIONARY_TEST_STRINGS; i++) {
+        char str[DICTIONARY_STRING_SIZE];
+        snprintf(str, sizeof(str), "D%05d", i);
+        for (int t = 0; t < DICTIONARY_TEST_THREADS; t++) {
+            agreed = agreed && ids[t][i] == ids[0][i] && strcmp(string_for_id(ids[t][i]), str) == 0;
+        }
+    }
+    printf("%s Concurrent interning agrees on ids\n", agreed ? "✅" : "❌");
+}
+
+void test_chain_stats(const unsigned char* key) {
+    printf("\n=== Testing Chain Statistics ===\n");
+
+    Blockchain* chain = create_blockchain();
+    if (!chain) {
+        printf("❌ Blockchain creation failed\n");
+        return;
+    }
+    chain->difficulty = 8;
+
+    // Two blocks: three visits, then a visit and a diagnosis
+    time_t base = time(NULL);
+    const char* types[] = {"visit", "visit", "visit", "visit", "diagnosis"};
+    uint64_t ciphertext_bytes = 0;
+    for (int i = 0; i < 5; i++) {
+        Transaction transaction;
+        memset(&transaction, 0, sizeof(Transaction));
+        transaction.patient_id = intern_string(TEST_PATIENT_ID);
+        transaction.record_type = intern_string(types[i]);
+        transaction.timestamp = base + i;
+        transaction.encrypted_data = encrypt_data(TEST_MEDICAL_DATA, key);
+        ciphertext_bytes += transaction.encrypted_data ? transaction.encrypted_data->data_len : 0;
+        if (!submit_transaction(chain, &transaction)) {
+            free_encrypted_data(transaction.encrypted_data);
+        }
+        if (i == 2 || i == 4) {
+            Block* block = build_block_template(chain);
+            if (!block || !mine_block(chain, block) || !add_block(chain, block)) {
+                printf("❌ Mining failed\n");
+                discard_block_template(chain, block);
+                free_blockchain(chain);
+                return;
+            }
+        }
+    }
+
+    const ChainStats* stats = get_chain_stats(chain);
+    printf("%s %llu transactions, %llu ciphertext bytes\n",
+           stats->transactions == 5 && stats->ciphertext_bytes == ciphertext_bytes ? "✅" : "❌",
+           (unsigned long long)stats->transactions, (unsigned long long)stats->ciphertext_bytes);
+    printf("%s Counts by record type\n",
+           chain_stats_type_count(stats, find_string("visit")) == 4 &&
+           chain_stats_type_count(stats, find_string("diagnosis")) == 1 &&
+           chain_stats_type_count(stats, find_string("emergency")) == 0 ? "✅" : "❌");
+    printf("%s First and last record times\n",
+           stats->first_timestamp == base && stats->last_timestamp == base + 4 ? "✅" : "❌");
+
+    // A block with more new types than the table holds is counted in one go
+    ChainStats many;
+    chain_stats_init(&many);
+    Block* typed_block = create_block(1, NULL);
+    char record_type[16];
+    for (int i = 0; typed_block && i < 20; i++) {
+        Transaction transaction = {0};
+        snprintf(record_type, sizeof(record_type), "type%d", i % 10);
+        transaction.patient_id = intern_string(TEST_PATIENT_ID);
+        transaction.record_type = intern_string(record_type);
+        transaction.timestamp = base + i;
+        transaction.encrypted_data = encrypt_data(TEST_MEDICAL_DATA, key);
+        if (!append_transaction(typed_block, &transaction)) {
+            free_encrypted_data(transaction.encrypted_data);
+        }
+    }
+    printf("%s New record types are reserved before counting\n",
+           typed_block && chain_stats_add_block(&many, typed_block) && many.transactions == 20 &&
+           many.record_type_count == 10 && chain_stats_type_count(&many, find_string("type3")) == 2 ? "✅" : "❌");
+    free_block(typed_block);
+    chain_stats_free(&many);
+
+    // Installing other blocks (as load and restore do) recomputes the totals
+    Block* genesis = create_block(0, NULL);
+    if (genesis && replace_blocks(chain, genesis)) {
+        stats = get_chain_stats(chain);
+        printf("%s Totals follow replaced blocks\n",
+               stats->transactions == 0 && stats->record_type_count == 0 ? "✅" : "❌");
+    } else {
+        free_block(genesis);
+        printf("❌ Replacing blocks failed\n");
+    }
+
+    free_blockchain(chain);
+}
+
+#define POOL_TEST_RECORDS 500
+
+void test_pool_allocator(const unsigned char* key) {
+    printf("\n=== Testing Pool Allocator ===\n");
+
+    PoolStats before;
+    pool_stats(&before);
+
+    // A record's ciphertext lives in the same allocation as its struct
+    EncryptedData* encrypted = encrypt_data(TEST_MEDICAL_DATA, key);
+    char* decrypted = encrypted ? decrypt_data(encrypted, key) : NULL;
+    printf("%s Ciphertext stored inline and still decrypts\n",
+           encrypted && encrypted->data == (unsigned char*)(encrypted + 1) &&
+           decrypted && strcmp(decrypted, TEST_MEDICAL_DATA) == 0 ? "✅" : "❌");
+    free(decrypted);
+    free_encrypted_data(encrypted);
+
+    // Objects of every class, plus one large one, are aligned and keep
+    // their contents when they move to a bigger class
+    size_t sizes[] = {1, 24, 100, 700, 3000, 8192, 20000};
+    void* objects[7];
+    int aligned = 1;
+    for (int i = 0; i < 7; i++) {
+        objects[i] = pool_alloc(sizes[i]);
+        aligned = aligned && objects[i] && ((uintptr_t)objects[i] % 16) == 0;
+        if (objects[i]) {
+            memset(objects[i], 'a' + i, sizes[i]);
+        }
+    }
+    printf("%s Allocations are 16-byte aligned\n", aligned ? "✅" : "❌");
+
+    unsigned char* grown = (unsigned char*)pool_realloc(objects[2], 5000);
+    int kept = grown != NULL;
+    for (size_t i = 0; kept && i < sizes[2]; i++) {
+        kept = grown[i] == 'c';
+    }
+    printf("%s Reallocation keeps the contents\n", kept ? "✅" : "❌");
+    if (grown) {
+        objects[2] = grown;
+    }
+    pool_free_batch(objects, 7);
+
+    // Freeing a block releases its records, transaction array and filter
+    Block* block = create_block(1, NULL);
+    int added = 0;
+    for (int i = 0; block && i < POOL_TEST_RECORDS; i++) {
+        Transaction transaction;
+        memset(&transaction, 0, sizeof(Transaction));
+        char patient_id[DICTIONARY_STRING_SIZE];
+        snprintf(patient_id, sizeof(patient_id), "P%05d", i);
+        transaction.patient_id = intern_string(patient_id);
+        transaction.record_type = intern_string(TEST_RECORD_TYPE);
+        transaction.timestamp = time(NULL);
+        transaction.encrypted_data = encrypt_data(TEST_MEDICAL_DATA, key);
+        if (append_transaction(block, &transaction)) {
+            added++;
+        } else {
+            free_encrypted_data(transaction.encrypted_data);
+        }
+    }
+    PoolStats filled;
+    pool_stats(&filled);
+    printf("%s %d records held in %zu slabs\n",
+           added == POOL_TEST_RECORDS && filled.live_objects >= before.live_objects + POOL_TEST_RECORDS ? "✅" : "❌",
+           added, filled.slabs);
+    free_block(block);
+
+    PoolStats after;
+    pool_trim();
+    pool_stats(&after);
+    printf("%s Every object returned to the pool\n",
+           after.live_objects == before.live_objects && after.slabs <= filled.slabs ? "✅" : "❌");
+}
+
+#define BATCH_TEST_RECORDS 100
+
+// Encrypt `text` with AES-256-CBC the way records were stored before GCM
+static EncryptedData* encrypt_legacy(const char* text, const unsigned char* key) {
+    int text_len = (int)strlen(text);
+    EncryptedData* encrypted = alloc_encrypted_data((size_t)text_len + AES_BLOCK_SIZE);
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    int len = 0, final_len = 0;
+    if (!encrypted || !ctx || RAND_bytes(encrypted->iv, AES_IV_SIZE) != 1 ||
+        EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, encrypted->iv) != 1 ||
+        EVP_EncryptUpdate(ctx, encrypted->data, &len, (const unsigned char*)text, text_len) != 1 ||
+        EVP_EncryptFinal_ex(ctx, encrypted->data + len, &final_len) != 1) {
+        EVP_CIPHER_CTX_free(ctx);
+        free_encrypted_data(encrypted);
+        return NULL;
+    }
+    EVP_CIPHER_CTX_free(ctx);
+    encrypted->cipher = CIPHER_AES_256_CBC;
+    encrypted->data_len = (size_t)(len + final_len);
+    return encrypted;
+}
+
+void test_authenticated_encryption(const unsigned char* key) {
+    printf("\n=== Testing Authenticated Encryption ===\n");
+
+    EncryptedData* encrypted = encrypt_data(TEST_MEDICAL_DATA, key);
+    if (!encrypted) {
+        printf("❌ Encryption failed\n");
+        return;
+    }
+    printf("%s Records use GCM and add no padding\n",
+           encrypted->cipher == CIPHER_AES_256_GCM && encrypted->data_len == strlen(TEST_MEDICAL_DATA) ? "✅" : "❌");
+
+    // Any change to the ciphertext or tag, or the wrong key, is rejected
+    unsigned char other_key[AES_KEY_SIZE];
+    generate_key(other_key);
+    char* wrong_key = decrypt_data(encrypted, other_key);
+    encrypted->data[0] ^= 1;
+    char* tampered_data = decrypt_data(encrypted, key);
+    encrypted->data[0] ^= 1;
+    encrypted->tag[0] ^= 1;
+    char* tampered_tag = decrypt_data(encrypted, key);
+    encrypted->tag[0] ^= 1;
+    char* intact = decrypt_data(encrypted, key);
+    printf("%s Tampered records and wrong keys fail to decrypt\n",
+           !wrong_key && !tampered_data && !tampered_tag ? "✅" : "❌");
+    printf("%s Cached context re-keys between keys\n",
+           intact && strcmp(intact, TEST_MEDICAL_DATA) == 0 ? "✅" : "❌");
+    free(wrong_key);
+    free(tampered_data);
+    free(tampered_tag);
+    free(intact);
+    free_encrypted_data(encrypted);
+
+    // Batch round trip, with a legacy CBC record and a gap in the middle
+    char texts[BATCH_TEST_RECORDS][32];
+    const char* inputs[BATCH_TEST_RECORDS];
+    EncryptedData* records[BATCH_TEST_RECORDS];
+    for (int i = 0; i < BATCH_TEST_RECORDS; i++) {
+        snprintf(texts[i], sizeof(texts[i]), "Record %d", i);
+        inputs[i] = texts[i];
+    }
+    if (!encrypt_batch(inputs, BATCH_TEST_RECORDS, key, records)) {
+        printf("❌ Batch encryption failed\n");
+        return;
+    }
+    int distinct_ivs = memcmp(records[0]->iv, records[1]->iv, AES_GCM_IV_SIZE) != 0 &&
+                       memcmp(records[0]->iv, records[BATCH_TEST_RECORDS - 1]->iv, AES_GCM_IV_SIZE) != 0;
+    printf("%s Batch records get their own IVs\n", distinct_ivs ? "✅" : "❌");
+
+    EncryptedData* legacy = encrypt_legacy(texts[0], key);
+    const EncryptedData* to_decrypt[BATCH_TEST_RECORDS + 2];
+    for (int i = 0; i < BATCH_TEST_RECORDS; i++) {
+        to_decrypt[i] = records[i];
+    }
+    to_decrypt[BATCH_TEST_RECORDS] = NULL;
+    to_decrypt[BATCH_TEST_RECORDS + 1] = legacy;
+
+    char* plaintexts[BATCH_TEST_RECORDS + 2];
+    char* buffer = decrypt_batch(to_decrypt, BATCH_TEST_RECORDS + 2, key, plaintexts);
+    int matches = buffer != NULL;
+    for (int i = 0; matches && i < BATCH_TEST_RECORDS; i++) {
+        matches = plaintexts[i] && strcmp(plaintexts[i], texts[i]) == 0 &&
+                  (i == 0 || plaintexts[i] > plaintexts[i - 1]);
+    }
+    printf("%s Batch decrypts in order into one buffer\n", matches ? "✅" : "❌");
+    printf("%s Legacy CBC records still decrypt\n",
+           buffer && !plaintexts[BATCH_TEST_RECORDS] && plaintexts[BATCH_TEST_RECORDS + 1] &&
+           strcmp(plaintexts[BATCH_TEST_RECORDS + 1], texts[0]) == 0 ? "✅" : "❌");
+
+    free(buffer);
+    free_encrypted_data(legacy);
+    for (int i = 0; i < BATCH_TEST_RECORDS; i++) {
+        free_encrypted_data(records[i]);
+    }
+}
+
+#define PARALLEL_DECRYPT_RECORDS 5000
+
+void test_parallel_decryption(const unsigned char* key) {
+    printf("\n=== Testing Parallel Decryption ===\n");
+
+    char (*texts)[32] = malloc(sizeof(*texts) * PARALLEL_DECRYPT_RECORDS);
+    const char** inputs = malloc(sizeof(char*) * PARALLEL_DECRYPT_RECORDS);
+    EncryptedData** records = malloc(sizeof(EncryptedData*) * PARALLEL_DECRYPT_RECORDS);
+    const unsigned char** keys = malloc(sizeof(unsigned char*) * PARALLEL_DECRYPT_RECORDS);
+    char** plaintexts = malloc(sizeof(char*) * PARALLEL_DECRYPT_RECORDS);
+    if (!texts || !inputs || !records || !keys || !plaintexts) {
+        printf("❌ Allocation failed\n");
+        free(texts);
+        free(inputs);
+        free(records);
+        free(keys);
+        free(plaintexts);
+        return;
+    }
+    for (int i = 0; i < PARALLEL_DECRYPT_RECORDS; i++) {
+        snprintf(texts[i], sizeof(texts[i]), "Lab result %d", i);
+        inputs[i] = texts[i];
+        keys[i] = key;
+    }
+    if (!encrypt_batch(inputs, PARALLEL_DECRYPT_RECORDS, key, records)) {
+        printf("❌ Batch encryption failed\n");
+        free(texts);
+        free(inputs);
+        free(records);
+        free(keys);
+        free(plaintexts);
+        return;
+    }
+
+    // One record is tampered with; only its own result is missing
+    records[PARALLEL_DECRYPT_RECORDS / 2]->tag[0] ^= 1;
+
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    char* buffer = decrypt_batch_parallel((const EncryptedData* const*)records, keys, PARALLEL_DECRYPT_RECORDS,
+                                          4, plaintexts);
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+
+    int in_order = buffer != NULL;
+    for (int i = 0; in_order && i < PARALLEL_DECRYPT_RECORDS; i++) {
+        in_order = i == PARALLEL_DECRYPT_RECORDS / 2 ? plaintexts[i] == NULL
+                                                     : plaintexts[i] && strcmp(plaintexts[i], texts[i]) == 0;
+    }
+    printf("%s %d records decrypted in order on 4 threads in %.2f ms\n", in_order ? "✅" : "❌",
+           PARALLEL_DECRYPT_RECORDS, (double)(finished.tv_sec - started.tv_sec) * 1000 +
+           (double)(finished.tv_nsec - started.tv_nsec) / 1e6);
+    free(buffer);
+
+    // The second batch reuses the pool's threads instead of starting new ones
+    int workers = decrypt_pool_workers();
+    buffer = decrypt_batch_parallel((const EncryptedData* const*)records, keys, PARALLEL_DECRYPT_RECORDS, 4,
+                                    plaintexts);
+    printf("%s Decrypt pool of %d thread(s) is reused across batches\n",
+           buffer && plaintexts[0] && strcmp(plaintexts[0], texts[0]) == 0 && workers >= 3 &&
+           decrypt_pool_workers() == workers ? "✅" : "❌", workers);
+    free(buffer);
+
+    // Tiny batches stay on the calling thread
+    buffer = decrypt_batch_parallel((const EncryptedData* const*)records, keys, 3, 0, plaintexts);
+    printf("%s Small batch decrypts\n",
+           buffer && plaintexts[2] && strcmp(plaintexts[2], texts[2]) == 0 ? "✅" : "❌");
+    free_decrypted(buffer, (const EncryptedData* const*)records, 3);
+
+    EncryptedData* copy = copy_encrypted_data(records[1]);
+    char* copied = decrypt_data(copy, key);
+    printf("%s Copied record decrypts\n", copied && strcmp(copied, texts[1]) == 0 ? "✅" : "❌");
+    free(copied);
+    free_encrypted_data(copy);
+
+    for (int i = 0; i < PARALLEL_DECRYPT_RECORDS; i++) {
+        free_encrypted_data(records[i]);
+    }
+    free(texts);
+    free(inputs);
+    free(records);
+    free(keys);
+    free(plaintexts);
+}
+
+void test_record_cache(const unsigned char* key) {
+    printf("\n=== Testing Record Cache ===\n");
+
+    // Budget for three short entries
+    size_t entry_bytes = sizeof(CachedRecord) + sizeof("Record 0");
+    RecordCache* cache = create_record_cache(entry_bytes * 3, 0);
+    if (!cache) {
+        printf("❌ Cache creation failed\n");
+        return;
+    }
+
+    char text[32];
+    for (int i = 0; i < 3; i++) {
+        snprintf(text, sizeof(text), "Record %d", i);
+        record_cache_put(cache, (TxRef){1, i}, text);
+    }
+    // Touch slot 0 so slot 1 becomes least recently used, then overflow
+    char out[32];
+    int hit = record_cache_get(cache, (TxRef){1, 0}, out, sizeof(out)) && strcmp(out, "Record 0") == 0;
+    record_cache_put(cache, (TxRef){1, 3}, "Record 3");
+    int evicted = !record_cache_get(cache, (TxRef){1, 1}, out, sizeof(out)) &&
+                  record_cache_get(cache, (TxRef){1, 0}, out, sizeof(out)) &&
+                  record_cache_get(cache, (TxRef){1, 3}, out, sizeof(out));
+    RecordCacheStats stats;
+    record_cache_stats(cache, &stats);
+    printf("%s Hits return the cached plaintext\n", hit ? "✅" : "❌");
+    printf("%s Least recently used entry is evicted at the budget\n",
+           evicted && stats.evictions == 1 && stats.entries == 3 && stats.bytes <= stats.max_bytes ? "✅" : "❌");
+    printf("%s Hit and miss counters\n", stats.hits == 3 && stats.misses == 1 ? "✅" : "❌");
+    free_record_cache(cache);
+
+    // Entries stop being served once their TTL runs out
+    printf("%s Cache budgets and TTLs out of range are refused\n",
+           !create_record_cache(0, 1) && !create_record_cache((size_t)RECORD_CACHE_MAX_BYTES + 1, 1) &&
+           !create_record_cache(RECORD_CACHE_DEFAULT_BYTES, RECORD_CACHE_MAX_TTL + 1) ? "✅" : "❌");
+
+    cache = create_record_cache(RECORD_CACHE_DEFAULT_BYTES, 1);
+    record_cache_put(cache, (TxRef){2, 0}, "Short-lived");
+    int fresh = record_cache_get(cache, (TxRef){2, 0}, out, sizeof(out));
+    struct timespec pause = {1, 100000000};
+    nanosleep(&pause, NULL);
+    int expired = !record_cache_get(cache, (TxRef){2, 0}, out, sizeof(out));
+    record_cache_stats(cache, &stats);
+    printf("%s Entries expire after their TTL\n", fresh && expired && stats.expirations == 1 ? "✅" : "❌");
+    free_record_cache(cache);
+
+    // Through the chain: a second history read is served from the cache,
+    // and replacing the blocks empties it
+    Blockchain* chain = create_blockchain();
+    if (!chain || !enable_record_cache(chain, RECORD_CACHE_DEFAULT_BYTES, RECORD_CACHE_DEFAULT_TTL)) {
+        printf("❌ Blockchain creation failed\n");
+        free_blockchain(chain);
+        return;
+    }
+    chain->difficulty = 8;
+    Transaction transaction;
+    memset(&transaction, 0, sizeof(Transaction));
+    transaction.patient_id = intern_string(TEST_PATIENT_ID);
+    transaction.record_type = intern_string("lab");
+    transaction.timestamp = time(NULL);
+    transaction.encrypted_data = encrypt_data(TEST_MEDICAL_DATA, key);
+    if (!submit_transaction(chain, &transaction)) {
+        free_encrypted_data(transaction.encrypted_data);
+    }
+    Block* block = build_block_template(chain);
+    if (!block || !mine_block(chain, block) || !add_block(chain, block)) {
+        printf("❌ Mining failed\n");
+        discard_block_template(chain, block);
+        free_blockchain(chain);
+        return;
+    }
+
+    TxRef ref = {block->id, 0};
+    const EncryptedData* encrypted = block->transactions[0].encrypted_data;
+    char* texts[1];
+    int matches = 1;
+    for (int round = 0; round < 2; round++) {
+        char* buffer = record_cache_decrypt(chain->record_cache, &ref, &encrypted, &key, 1, texts);
+        matches = matches && buffer && texts[0] && strcmp(texts[0], TEST_MEDICAL_DATA) == 0;
+        free(buffer);
+    }
+    record_cache_stats(chain->record_cache, &stats);
+    printf("%s Repeated reads are served from the cache\n",
+           matches && stats.hits == 1 && stats.misses == 1 ? "✅" : "❌");
+
+    Block* genesis = create_block(0, NULL);
+    if (genesis && replace_blocks(chain, genesis)) {
+        record_cache_stats(chain->record_cache, &stats);
+        printf("%s Replacing blocks empties the cache\n", stats.entries == 0 && stats.bytes == 0 ? "✅" : "❌");
+    } else {
+        free_block(genesis);
+        printf("❌ Replacing blocks failed\n");
+    }
+    free_blockchain(chain);
+}
+
+#define KEY_TEST_PATIENTS 1000
+
+void test_patient_keys(void) {
+    printf("\n=== Testing Patient Keys ===\n");
+
+    unsigned char master[AES_KEY_SIZE], other_master[AES_KEY_SIZE];
+    unsigned char shared[AES_KEY_SIZE] = {0};
+    generate_key(master);
+    generate_key(other_master);
+
+    // Keys are deterministic per (master, patient) and differ otherwise
+    unsigned char a1[AES_KEY_SIZE], a2[AES_KEY_SIZE], b[AES_KEY_SIZE], a_other[AES_KEY_SIZE];
+    int derived = derive_patient_key(master, "P001", a1) && derive_patient_key(master, "P001", a2) &&
+                  derive_patient_key(master, "P002", b) && derive_patient_key(other_master, "P001", a_other);
+    printf("%s HKDF keys are per patient and per master key\n",
+           derived && memcmp(a1, a2, AES_KEY_SIZE) == 0 && memcmp(a1, b, AES_KEY_SIZE) != 0 &&
+           memcmp(a1, a_other, AES_KEY_SIZE) != 0 ? "✅" : "❌");
+
+    KeyStore* store = create_key_store(master, shared);
+    if (!store) {
+        printf("❌ Key store creation failed\n");
+        return;
+    }
+
+    // A record opens only under its own patient's key
+    StringId p1 = intern_string("P001");
+    StringId p2 = intern_string("P002");
+    EncryptedData* encrypted = encrypt_record(store, TEST_MEDICAL_DATA, p1);
+    unsigned char key[AES_KEY_SIZE];
+    char* own = encrypted && record_key(store, encrypted->key_scheme, encrypted->key_id, p1, key) ? decrypt_data(encrypted, key) : NULL;
+    char* other = encrypted && record_key(store, encrypted->key_scheme, encrypted->key_id, p2, key) ? decrypt_data(encrypted, key) : NULL;
+    printf("%s Records decrypt only with their patient's key\n",
+           own && strcmp(own, TEST_MEDICAL_DATA) == 0 && !other &&
+           encrypted->key_scheme == KEY_SCHEME_PATIENT ? "✅" : "❌");
+    free(own);
+    free(other);
+    free_encrypted_data(encrypted);
+
+    // Shared-key records use the store's shared key
+    printf("%s Shared scheme returns the shared key\n",
+           record_key(store, KEY_SCHEME_SHARED, 0, p1, key) && memcmp(key, shared, AES_KEY_SIZE) == 0 ? "✅" : "❌");
+
+    // Repeated lookups hit the cache; many patients stay within its bound
+    KeyStoreStats before, after;
+    key_store_stats(store, &before);
+    for (int i = 0; i < 10; i++) {
+        record_key(store, KEY_SCHEME_PATIENT, 1, p1, key);
+    }
+    key_store_stats(store, &after);
+    printf("%s Hot patient keys come from the cache\n",
+           after.derivations == before.derivations && after.hits == before.hits + 10 ? "✅" : "❌");
+
+    char patient_id[16];
+    for (int i = 0; i < KEY_TEST_PATIENTS; i++) {
+        snprintf(patient_id, sizeof(patient_id), "KP%d", i);
+        record_key(store, KEY_SCHEME_PATIENT, 1, intern_string(patient_id), key);
+    }
+    key_store_stats(store, &after);
+    printf("%s Derived key cache is bounded (%zu keys)\n",
+           after.cached_keys <= KEY_CACHE_SLOTS && after.cached_keys > 0 ? "✅" : "❌", after.cached_keys);
+    free_key_store(store);
+
+    // The master key file is created once and reused; a damaged one is refused
+    const char* key_file = "test_master.key";
+    remove(key_file);
+    KeyStore* created = open_key_store(key_file, shared, 1);
+    KeyStore* reopened = open_key_store(key_file, shared, 1);
+    printf("%s Master key is created, stored and reloaded\n",
+           created && reopened && memcmp(created->masters[0], reopened->masters[0], AES_KEY_SIZE) == 0 ? "✅" : "❌");
+    struct stat info;
+    printf("%s Master key file is readable only by its owner and never overwritten\n",
+           stat(key_file, &info) == 0 && (info.st_mode & 0777) == 0600 && !store_key(master, key_file) ? "✅" : "❌");
+    free_key_store(created);
+    free_key_store(reopened);
+
+    // Too short, then one byte too long
+    unsigned char loaded[AES_KEY_SIZE];
+    int refused = 1;
+    for (int extra = 0; extra < 2; extra++) {
+        FILE* file = fopen(key_file, "wb");
+        if (file) {
+            fwrite(master, 1, extra ? AES_KEY_SIZE : 5, file);
+            if (extra) {
+                fputc(0, file);
+            }
+            fclose(file);
+        }
+        KeyStore* damaged = open_key_store(key_file, shared, 1);
+        refused = refused && !damaged && !load_key(loaded, key_file);
+        free_key_store(damaged);
+    }
+    printf("%s Master key file of the wrong size is refused, not replaced\n", refused ? "✅" : "❌");
+    remove(key_file);
+
+    KeyStore* missing = open_key_store(key_file, shared, 0);
+    printf("%s Missing master key is not created when records need it\n",
+           !missing && access(key_file, F_OK) != 0 ? "✅" : "❌");
+    free_key_store(missing);
+}
+
+#define ROTATION_TEST_RECORDS 200
+
+// Decrypt a record with whatever key its id names
+static int record_reads_as(KeyStore* store, const EncryptedData* encrypted, StringId patient_id, const char* text) {
+    unsigned char key[AES_KEY_SIZE];
+    char* plain = record_key(store, encrypted->key_scheme, encrypted->key_id, patient_id, key)
+                      ? decrypt_data(encrypted, key) : NULL;
+    int same = plain && strcmp(plain, text) == 0;
+    free(plain);
+    return same;
+}
+
+void test_key_rotation(void) {
+    printf("\n=== Testing Key Rotation ===\n");
+
+    unsigned char master[AES_KEY_SIZE];
+    unsigned char shared[AES_KEY_SIZE] = {0};
+    KeyStore* store = generate_key(master) ? create_key_store(master, shared) : NULL;
+    Blockchain* chain = create_blockchain();
+    if (!store || !chain) {
+        printf("❌ Key store or blockchain creation failed\n");
+        free_key_store(store);
+        free_blockchain(chain);
+        return;
+    }
+
+    // One block of records under master key 1, plus one shared-key record
+    chain->difficulty = 8;
+    StringId patient = intern_string(TEST_PATIENT_ID);
+    for (int i = 0; i < ROTATION_TEST_RECORDS; i++) {
+        Transaction transaction;
+        memset(&transaction, 0, sizeof(Transaction));
+        transaction.patient_id = patient;
+        transaction.record_type = intern_string("lab");
+        transaction.timestamp = time(NULL);
+        transaction.encrypted_data = i == 0 ? encrypt_data(TEST_MEDICAL_DATA, shared)
+                                            : encrypt_record(store, TEST_MEDICAL_DATA, patient);
+        if (!submit_transaction(chain, &transaction)) {
+            free_encrypted_data(transaction.encrypted_data);
+        }
+    }
+    Block* block = build_block_template(chain);
+    if (!block || !mine_block(chain, block) || !add_block(chain, block)) {
+        printf("❌ Mining failed\n");
+        discard_block_template(chain, block);
+        free_key_store(store);
+        free_blockchain(chain);
+        return;
+    }
+
+    Blockchain* empty = create_blockchain();
+    printf("%s Records needing a master key are detected\n",
+           chain_has_patient_records(chain) && empty && !chain_has_patient_records(empty) ? "✅" : "❌");
+    free_blockchain(empty);
+
+    // New records use the new key; old ones still read under theirs
+    uint32_t key_id = rotate_master_key(store);
+    EncryptedData* fresh = encrypt_record(store, TEST_MEDICAL_DATA, patient);
+    printf("%s Rotation makes the new key current\n",
+           key_id == 2 && current_key_id(store) == 2 && fresh && fresh->key_id == 2 &&
+           record_reads_as(store, fresh, patient, TEST_MEDICAL_DATA) ? "✅" : "❌");
+    printf("%s Records under the old key stay readable\n",
+           block->transactions[1].encrypted_data->key_id == 1 &&
+           record_reads_as(store, block->transactions[1].encrypted_data, patient, TEST_MEDICAL_DATA) ? "✅" : "❌");
+    free_encrypted_data(fresh);
+
+    // Unthrottled migration moves every record to the overlay; blocks are untouched
+    char hash[HASH_SIZE + 1];
+    memcpy(hash, block->hash, sizeof(hash));
+    RekeyJob* job = rekey_job_start(chain->blocks, chain->block_count, store, chain->overlay, key_id, 0);
+    RekeyProgress progress = {0};
+    rekey_job_finish(job, &progress);
+    int migrated = job && progress.migrated == ROTATION_TEST_RECORDS && progress.failed == 0 &&
+                   overlay_count(chain->overlay) == ROTATION_TEST_RECORDS;
+    for (int i = 0; migrated && i < ROTATION_TEST_RECORDS; i++) {
+        EncryptedData* replaced = overlay_copy(chain->overlay, (TxRef){block->id, i});
+        migrated = replaced && record_uses_key(replaced, key_id) &&
+                   record_reads_as(store, replaced, patient, TEST_MEDICAL_DATA);
+        free_encrypted_data(replaced);
+    }
+    printf("%s Background job re-encrypts every record under the new key\n", migrated ? "✅" : "❌");
+    printf("%s Blocks and hashes are unchanged by re-encryption\n",
+           block->transactions[0].encrypted_data->key_scheme == KEY_SCHEME_SHARED &&
+           block->transactions[1].encrypted_data->key_id == 1 && strcmp(block->hash, hash) == 0 &&
+           verify_chain(chain) ? "✅" : "❌");
+
+    // A second run finds nothing left to do
+    job = rekey_job_start(chain->blocks, chain->block_count, store, chain->overlay, key_id, 0);
+    rekey_job_finish(job, &progress);
+    printf("%s Migrated records are skipped\n",
+           job && progress.scanned == progress.total && progress.migrated == 0 ? "✅" : "❌");
+
+    // A throttled job stops after its first batch when cancelled
+    key_id = rotate_master_key(store);
+    job = rekey_job_start(chain->blocks, chain->block_count, store, chain->overlay, key_id, 1);
+    struct timespec pause = {0, 200000000};
+    nanosleep(&pause, NULL);
+    int running = job && !rekey_job_finished(job);
+    rekey_job_cancel(job);
+    rekey_job_finish(job, &progress);
+    printf("%s Throttled job can be cancelled (%llu of %llu records)\n",
+           running && progress.migrated <= REKEY_BATCH && progress.migrated < progress.total ? "✅" : "❌",
+           progress.migrated, progress.total);
+    free_blockchain(chain);
+    free_key_store(store);
+
+    // Rotated keys are stored beside the first and reloaded with it
+    const char* key_file = "test_ring.key";
+    const char* rotated_file = "test_ring.key.2";
+    remove(key_file);
+    remove(rotated_file);
+    KeyStore* ring = open_key_store(key_file, shared, 1);
+    key_id = rotate_master_key(ring);
+    KeyStore* reopened = open_key_store(key_file, shared, 1);
+    printf("%s Key ring is stored and reloaded\n",
+           ring && reopened && key_id == 2 && current_key_id(reopened) == 2 &&
+           memcmp(ring->masters[1], reopened->masters[1], AES_KEY_SIZE) == 0 ? "✅" : "❌");
+    free_key_store(ring);
+    free_key_store(reopened);
+    remove(key_file);
+    remove(rotated_file);
+}
+
+// Digest with exactly `zero_bits` leading zero bits, the rest set
+static void digest_with_zero_bits(unsigned char digest[32], int zero_bits) {
+    memset(digest, 0xff, 32);
+    memset(digest, 0, zero_bits / 8);
+    if (zero_bits % 8) {
+        digest[zero_bits / 8] = (unsigned char)(0xff >> (zero_bits % 8));
+    }
+}
+
+void test_proof_of_work(void) {
+    printf("\n=== Testing Proof-of-Work Check ===\n");
+
+    const int bit_counts[] = {0, 1, 7, 8, 9, 16};
+    int exact = 1;
+    int agrees = 1;
+    for (size_t i = 0; i < sizeof(bit_counts) / sizeof(bit_counts[0]); i++) {
+        int bits = bit_counts[i];
+        unsigned char digest[32];
+        char hex[HASH_SIZE + 1];
+
+        // A digest right at the target passes; one bit short of it fails
+        digest_with_zero_bits(digest, bits);
+        str_to_hex(digest, hex, sizeof(digest));
+        exact &= hash_meets_difficulty(digest, bits) && !hash_meets_difficulty(digest, bits + 1);
+        agrees &= is_valid_hash(hex, bits) == hash_meets_difficulty(digest, bits) &&
+                  is_valid_hash(hex, bits + 1) == hash_meets_difficulty(digest, bits + 1);
+        if (bits > 0) {
+            digest_with_zero_bits(digest, bits - 1);
+            str_to_hex(digest, hex, sizeof(digest));
+            exact &= !hash_meets_difficulty(digest, bits) && hash_meets_difficulty(digest, bits - 1);
+            agrees &= is_valid_hash(hex, bits) == hash_meets_difficulty(digest, bits);
+        }
+    }
+    printf("%s Digests just above and below the target are told apart\n", exact ? "✅" : "❌");
+    printf("%s Hex and raw digest checks agree\n", agrees ? "✅" : "❌");
+
+    unsigned char zero[32] = {0};
+    printf("%s All-zero digest meets any difficulty, malformed hex meets none\n",
+           hash_meets_difficulty(zero, 256) && hash_meets_difficulty(zero, 300) && !is_valid_hash("00", 0) ? "✅" : "❌");
+}
+
+// Retarget the chain from `difficulty` as if its last retarget window
+// took `window_seconds`
+static int retarget_after(Blockchain* chain, int difficulty, int64_t window_seconds) {
+    int64_t base = chain->headers[0].timestamp;
+    uint32_t last = chain->block_count - 1;
+    for (uint32_t i = 0; i <= last; i++) {
+        chain->headers[i].timestamp = base + window_seconds * i / (last ? last : 1);
+    }
+    chain->difficulty = difficulty;
+    retarget_difficulty(chain);
+    return chain->difficulty;
+}
+
+void test_difficulty_retarget(const unsigned char* key) {
+    printf("\n=== Testing Difficulty Retargeting ===\n");
+
+    Blockchain* chain = create_blockchain();
+    if (!chain) {
+        printf("❌ Blockchain creation failed\n");
+        return;
+    }
+    chain->difficulty = MIN_DIFFICULTY;
+    chain->retarget_interval = 0;
+    if (!mine_test_blocks(chain, 4, key)) {
+        printf("❌ Mining failed\n");
+        free_blockchain(chain);
+        return;
+    }
+
+    // Five blocks close a 4-block window whose expected time is 240 s
+    chain->retarget_interval = 4;
+    chain->target_block_time = 60;
+    printf("%s Fast windows raise and slow ones lower difficulty by at most %d bits\n",
+           retarget_after(chain, 20, 0) == 22 && retarget_after(chain, 20, 240 * 100) == 18 &&
+           retarget_after(chain, 20, 120) == 21 && retarget_after(chain, 20, 480) == 19 ? "✅" : "❌",
+           MAX_RETARGET_STEP);
+    printf("%s On-target window leaves difficulty alone\n", retarget_after(chain, 20, 240) == 20 ? "✅" : "❌");
+    printf("%s Difficulty stays within %d-%d bits\n",
+           retarget_after(chain, MAX_DIFFICULTY - 1, 0) == MAX_DIFFICULTY &&
+           retarget_after(chain, MIN_DIFFICULTY, 240 * 100) == MIN_DIFFICULTY ? "✅" : "❌",
+           MIN_DIFFICULTY, MAX_DIFFICULTY);
+
+    // Block 4 is not the end of a 3-block window
+    chain->retarget_interval = 3;
+    printf("%s Difficulty is unchanged between interval boundaries\n",
+           retarget_after(chain, 20, 0) == 20 && retarget_after(chain, 20, 240 * 100) == 20 ? "✅" : "❌");
+
+    free_blockchain(chain);
+}
+
+void test_verified_watermark(const unsigned char* key) {
+    printf("\n=== Testing Incremental Verification ===\n");
+
+    Blockchain* chain = create_blockchain();
+    if (!chain) {
+        printf("❌ Blockchain creation failed\n");
+        return;
+    }
+    chain->difficulty = MIN_DIFFICULTY;
+    chain->retarget_interval = 0;
+    int mined = mine_test_blocks(chain, 3, key);
+    update_verified_watermark(chain);
+    if (!mined || !mine_test_blocks(chain, 3, key)) {
+        printf("❌ Mining failed\n");
+        free_blockchain(chain);
+        return;
+    }
+
+    // Blocks 0-3 are below the watermark; a change there goes unnoticed
+    // until a full pass
+    VerifyStats stats;
+    int valid = verify_chain_incremental(chain, 1, &stats);
+    printf("%s Only the %u block(s) above the watermark are checked\n",
+           valid && stats.start_height == 4 && stats.blocks_checked == 3 ? "✅" : "❌", stats.blocks_checked);
+
+    chain->blocks[2]->transactions[0].timestamp++;
+    int skipped = verify_chain_incremental(chain, 1, NULL);
+    int rechecked = !verify_chain_parallel(chain, 0, 1, &stats) && stats.start_height == 0;
+    chain->blocks[2]->transactions[0].timestamp--;
+    printf("%s Full verification rechecks blocks below the watermark\n", skipped && rechecked ? "✅" : "❌");
+
+    chain->blocks[5]->transactions[0].timestamp++;
+    int caught = !verify_chain_incremental(chain, 1, NULL);
+    chain->blocks[5]->transactions[0].timestamp--;
+    printf("%s Tampered block above the watermark is caught\n", caught ? "✅" : "❌");
+
+    // The block at the watermark no longer has the hash recorded for it
+    chain->verified_hash[0] = chain->verified_hash[0] == '0' ? '1' : '0';
+    valid = verify_chain_incremental(chain, 1, &stats);
+    printf("%s Stale watermark is ignored\n", valid && stats.start_height == 0 ? "✅" : "❌");
+
+    free_blockchain(chain);
+}
+
+#define PARALLEL_VERIFY_THREADS 4
+#define PARALLEL_VERIFY_BLOCKS (MIN_VERIFY_BLOCKS_PER_THREAD * PARALLEL_VERIFY_THREADS)
+
+// Verify on 1, 2 and PARALLEL_VERIFY_THREADS threads; returns 1 if every
+// pass used its thread count and gave the single-threaded result `expected`
+static int verify_on_each_thread_count(const Blockchain* chain, int expected) {
+    const int thread_counts[] = {1, 2, PARALLEL_VERIFY_THREADS};
+    int agree = 1;
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        VerifyStats stats;
+        agree &= verify_chain_parallel(chain, 0, thread_counts[i], &stats) == expected &&
+                 stats.threads == thread_counts[i];
+    }
+    return agree;
+}
+
+void test_parallel_verification(const unsigned char* key) {
+    printf("\n=== Testing Parallel Verification ===\n");
+
+    Blockchain* chain = create_blockchain();
+    if (!chain) {
+        printf("❌ Blockchain creation failed\n");
+        return;
+    }
+    chain->difficulty = MIN_DIFFICULTY;
+    chain->retarget_interval = 0;
+    chain->mining_threads = 1;
+    if (!mine_test_blocks(chain, PARALLEL_VERIFY_BLOCKS, key)) {
+        printf("❌ Mining failed\n");
+        free_blockchain(chain);
+        return;
+    }
+    printf("%s Intact chain of %u blocks verifies on every thread count\n",
+           verify_chain(chain) && verify_on_each_thread_count(chain, 1) ? "✅" : "❌", chain->block_count);
+
+    // A payload change in the middle of a slice
+    Block* middle = chain->blocks[chain->block_count / 2 + 5];
+    middle->transactions[0].timestamp++;
+    int single = verify_chain_parallel(chain, 0, 1, NULL);
+    printf("%s Tampered payload mid-chain is caught on every thread count\n",
+           !single && verify_on_each_thread_count(chain, single) ? "✅" : "❌");
+    middle->transactions[0].timestamp--;
+
+    // A broken link on the first block of the second half, where both the
+    // 2- and 4-thread passes start a new slice
+    BlockHeader* boundary = &chain->headers[chain->block_count / 2];
+    boundary->previous_hash[0] ^= 1;
+    single = verify_chain_parallel(chain, 0, 1, NULL);
+    printf("%s Broken link at a slice boundary is caught on every thread count\n",
+           !single && verify_on_each_thread_count(chain, single) ? "✅" : "❌");
+    boundary->previous_hash[0] ^= 1;
+
+    printf("%s Restored chain verifies again\n", verify_on_each_thread_count(chain, 1) ? "✅" : "❌");
+    free_blockchain(chain);
+}
+
+#define MINING_JOB_TIMEOUT 10.0  // Seconds a test waits for a background job
+
+static double seconds_since(const struct timespec* started) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - started->tv_sec) + (double)(now.tv_nsec - started->tv_nsec) / 1e9;
+}
+
+// Poll the job as the CLI does until it stops or the timeout passes
+static int wait_for_mining_job(const MiningJob* job) {
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    while (!mining_job_finished(job)) {
+        if (seconds_since(&started) > MINING_JOB_TIMEOUT) {
+            return 0;
+        }
+        sched_yield();
+    }
+    return 1;
+}
+
+// Queue `count` records and build a template holding them
+static Block* mining_job_template(Blockchain* chain, int count, const unsigned char* key) {
+    for (int i = 0; i < count; i++) {
+        Transaction transaction;
+        memset(&transaction, 0, sizeof(Transaction));
+        transaction.patient_id = intern_string(TEST_PATIENT_ID);
+        transaction.record_type = intern_string("visit");
+        transaction.timestamp = time(NULL);
+        transaction.encrypted_data = encrypt_data(TEST_MEDICAL_DATA, key);
+        if (!submit_transaction(chain, &transaction)) {
+            free_encrypted_data(transaction.encrypted_data);
+        }
+    }
+    return build_block_template(chain);
+}
+
+void test_mining_jobs(const unsigned char* key) {
+    printf("\n=== Testing Background Mining ===\n");
+
+    Blockchain* chain = create_blockchain();
+    if (!chain) {
+        printf("❌ Blockchain creation failed\n");
+        return;
+    }
+
+    // A cheap job completes and its block joins the chain
+    Block* block = mining_job_template(chain, 1, key);
+    MiningJob* job = block ? mining_job_start(block, 8, 2) : NULL;
+    int finished = job && wait_for_mining_job(job);
+    MiningProgress progress = {0, 0, 0, 0};
+    if (job) {
+        mining_job_progress(job, &progress);
+    }
+    int mined = 0;
+    block = job ? mining_job_finish(job, &mined) : block;
+    int added = finished && mined && add_block(chain, block);
+    if (!added) {
+        discard_block_template(chain, block);
+    }
+    printf("%s Background job mines a block that is added (%llu attempts)\n",
+           added && chain->block_count == 2 && progress.attempts > 0 && verify_chain(chain) ? "✅" : "❌",
+           progress.attempts);
+
+    // A job that would run for ages stops promptly when cancelled
+    block = mining_job_template(chain, 2, key);
+    job = block ? mining_job_start(block, MAX_DIFFICULTY, 2) : NULL;
+    struct timespec cancelled;
+    clock_gettime(CLOCK_MONOTONIC, &cancelled);
+    progress.attempts = 0;  // Cancelled once it is under way
+    while (job && progress.attempts < MINING_CHECK_INTERVAL && seconds_since(&cancelled) < MINING_JOB_TIMEOUT) {
+        sched_yield();
+        mining_job_progress(job, &progress);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &cancelled);
+    mining_job_cancel(job);
+    finished = job && wait_for_mining_job(job);
+    double stop_seconds = seconds_since(&cancelled);
+    mined = 1;
+    block = job ? mining_job_finish(job, &mined) : block;
+    discard_block_template(chain, block);
+    printf("%s Cancelled job stops in %.3f s, adds nothing and returns its records\n",
+           finished && !mined && progress.attempts > 0 && stop_seconds < 1.0 && chain->block_count == 2 &&
+           mempool_count(&chain->mempool) == 2 ? "✅" : "❌", stop_seconds);
+
     free_blockchain(chain);
 }
 
+void test_block_lookup(const unsigned char* key) {
+    printf("\n=== Testing Block Lookup ===\n");
+
+    Blockchain* chain = create_blockchain();
+    if (!chain) {
+        printf("❌ Blockchain creation failed\n");
+        return;
+    }
+    chain->difficulty = MIN_DIFFICULTY;
+    chain->retarget_interval = 0;
+    chain->mining_threads = 1;
+    if (!mine_test_blocks(chain, 3, key)) {
+        printf("❌ Mining failed\n");
+        free_blockchain(chain);
+        return;
+    }
+    uint32_t last = chain->block_count - 1;
+    printf("%s Genesis, last block and one past the end are looked up correctly\n",
+           get_block_by_id(chain, 0) == chain->genesis && get_block_by_id(chain, last) == chain->latest &&
+           !get_block_by_id(chain, last + 1) && !get_block_header(chain, last + 1) &&
+           !get_block_by_id(chain, UINT32_MAX) ? "✅" : "❌");
+
+    // Keep the first blocks' addresses, then grow the index past its initial capacity
+    Block* early[4];
+    for (uint32_t i = 0; i < 4; i++) {
+        early[i] = chain->blocks[i];
+    }
+    if (!mine_test_blocks(chain, INITIAL_BLOCK_CAPACITY * 2, key)) {
+        printf("❌ Mining failed\n");
+        free_blockchain(chain);
+        return;
+    }
+    int resolved = chain->block_capacity > INITIAL_BLOCK_CAPACITY;
+    for (uint32_t i = 0; resolved && i < 4; i++) {
+        resolved = get_block_by_id(chain, i) == early[i] && get_block_header(chain, i)->id == i;
+    }
+    for (uint32_t i = 0; resolved && i < chain->block_count; i++) {
+        Block* block = get_block_by_id(chain, i);
+        resolved = block && block->id == i;
+    }
+    printf("%s Every id resolves after the index grows to %u slots\n", resolved ? "✅" : "❌",
+           chain->block_capacity);
+
+    free_blockchain(chain);
+}
+
+// Persistence tests save and load in a scratch directory, leaving any
+// chain files in the working directory alone
+static int enter_scratch_dir(char* previous, size_t size, char* scratch) {
+    return getcwd(previous, size) && mkdtemp(scratch) && chdir(scratch) == 0;
+}
+
+static void leave_scratch_dir(const char* previous, const char* scratch) {
+    remove(BLOCKCHAIN_FILE);
+    remove(BLOCKCHAIN_META_FILE);
+    remove(MEMPOOL_FILE);
+    if (chdir(previous) == 0) {
+        rmdir(scratch);
+    }
+}
+
+// Save an empty chain, overwrite its stored difficulty and load it back
+static int reload_with_difficulty(int stored) {
+    Blockchain* chain = create_blockchain();
+    int saved = chain && save_blockchain(chain);
+    free_blockchain(chain);
+    FILE* file = saved ? fopen(BLOCKCHAIN_META_FILE, "r+b") : NULL;
+    if (!file) {
+        return -1;
+    }
+    int written = fseek(file, sizeof(uint32_t), SEEK_SET) == 0 && fwrite(&stored, sizeof(int), 1, file) == 1;
+    fclose(file);
+
+    Blockchain* loaded = written ? load_blockchain() : NULL;
+    int difficulty = loaded ? loaded->difficulty : -1;
+    free_blockchain(loaded);
+    return difficulty;
+}
+
+void test_chain_metadata(void) {
+    printf("\n=== Testing Chain Metadata ===\n");
+
+    char previous[1024];
+    char scratch[] = "/tmp/medchain_test_XXXXXX";
+    if (!enter_scratch_dir(previous, sizeof(previous), scratch)) {
+        printf("❌ Scratch directory creation failed\n");
+        return;
+    }
+
+    printf("%s Stored difficulty loads unchanged\n", reload_with_difficulty(20) == 20 ? "✅" : "❌");
+    printf("%s Out-of-range difficulty is clamped on load\n",
+           reload_with_difficulty(200) == MAX_DIFFICULTY && reload_with_difficulty(0) == MIN_DIFFICULTY &&
+           reload_with_difficulty(-5) == MIN_DIFFICULTY ? "✅" : "❌");
+
+    Blockchain* chain = create_blockchain();
+    Blockchain* loaded = NULL;
+    if (chain) {
+        chain->retarget_interval = 7;
+        chain->target_block_time = 33;
+        loaded = save_blockchain(chain) ? load_blockchain() : NULL;
+    }
+    printf("%s Retarget settings survive a save and load\n",
+           loaded && loaded->retarget_interval == 7 && loaded->target_block_time == 33 ? "✅" : "❌");
+    free_blockchain(loaded);
+    free_blockchain(chain);
+
+    leave_scratch_dir(previous, scratch);
+}
+
+void test_input_parsing(void) {
+    printf("\n=== Testing Input Parsing ===\n");
+
+    int threads = -1;
+    int limit = get_online_cpus() * MAX_THREADS_PER_CPU;
+    char too_many[16];
+    snprintf(too_many, sizeof(too_many), "%d", limit + 1);
+    printf("%s Thread counts are validated and bounded\n",
+           parse_thread_count("0", &threads) && threads == 0 && parse_thread_count("2", &threads) && threads == 2 &&
+           !parse_thread_count("abc", &threads) && !parse_thread_count("4x", &threads) &&
+           !parse_thread_count("-1", &threads) && !parse_thread_count("", &threads) &&
+           !parse_thread_count(too_many, &threads) && !parse_thread_count("99999999999", &threads) &&
+           threads == 2 ? "✅" : "❌");
+
+    uint32_t rate = 7;
+    printf("%s Rates must be written as plain numbers\n",
+           parse_rate("0", &rate) && rate == 0 && parse_rate("2000", &rate) && rate == 2000 &&
+           !parse_rate("fast", &rate) && !parse_rate("10/s", &rate) && !parse_rate("-1", &rate) &&
+           !parse_rate(" 5", &rate) && !parse_rate("", &rate) && !parse_rate("4294967296", &rate) &&
+           rate == 2000 ? "✅" : "❌");
+
+    uint32_t number = 7;
+    uint64_t wide = 7;
+    printf("%s Numbers outside their range or with stray text are rejected\n",
+           parse_uint32("1", 1, 10, &number) && number == 1 && parse_uint32("10", 1, 10, &number) && number == 10 &&
+           !parse_uint32("0", 1, 10, &number) && !parse_uint32("11", 1, 10, &number) &&
+           !parse_uint32("abc", 0, 10, &number) && !parse_uint32("-1", 0, UINT32_MAX, &number) &&
+           !parse_uint32("5 ", 0, 10, &number) && parse_uint64("18446744073709551615", 0, UINT64_MAX, &wide) &&
+           wide == UINT64_MAX && !parse_uint64("18446744073709551616", 0, UINT64_MAX, &wide) &&
+           number == 10 ? "✅" : "❌");
+
+    time_t start, end, precise;
+    struct tm expected = {0};
+    expected.tm_year = 2024 - 1900;
+    expected.tm_mon = 1;
+    expected.tm_mday = 29;
+    expected.tm_hour = 10;
+    expected.tm_min = 30;
+    expected.tm_sec = 15;
+    expected.tm_isdst = -1;
+    printf("%s Dates and times parse in every accepted form\n",
+           parse_timestamp("2024-02-29", 0, &start) && parse_timestamp("2024-02-29", 1, &end) &&
+           end - start == 86399 && parse_timestamp("2024-02-29T10:30:15", 0, &precise) &&
+           precise == mktime(&expected) && parse_timestamp("2024-02-29T10:30", 0, &precise) &&
+           precise == mktime(&expected) - 15 && parse_timestamp("1700000000", 0, &precise) &&
+           precise == 1700000000 ? "✅" : "❌");
+
+    const char* invalid[] = {"2024-03-01xyz", "2024-03-01T10:00junk", "2024-03-01T10:00:00Z", "2024-13-45",
+                             "2023-02-29", "2024-04-31", "2024-03-01T24:00", "2024-03-01T10:60",
+                             "2024-03-01T10:00:60", "2024-03-01T10", "2024-03", "yesterday"};
+    int rejected = 1;
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        rejected &= !parse_timestamp(invalid[i], 0, &precise);
+    }
+    printf("%s Trailing text and out-of-range fields are rejected\n", rejected ? "✅" : "❌");
+}
+
 int main(void) {
     printf("=== Medical Blockchain Security Test ===\n");
     
@@ -192,6 +2011,32 @@ int main(void) {
     test_user_management();
     test_access_control();
     test_blockchain_security(key);
+    test_sha256_kernels();
+    test_proof_of_work();
+    test_difficulty_retarget(key);
+    test_verified_watermark(key);
+    test_parallel_verification(key);
+    test_mining_jobs(key);
+    test_block_lookup(key);
+    test_merkle_proofs(key);
+    test_patient_index(key);
+    test_record_type_index();
+    test_block_bloom_filters(key);
+    test_block_limits(key);
+    test_mempool(key);
+    test_ingest_queue(key);
+    test_pool_allocator(key);
+    test_block_headers(key);
+    test_dictionary();
+    test_chain_stats(key);
+    test_authenticated_encryption(key);
+    test_parallel_decryption(key);
+    test_record_cache(key);
+    test_patient_keys();
+    test_key_rotation();
+    test_input_parsing();
+    test_chain_metadata();
+    shutdown_decrypt_pool();
     
     printf("\n=== Security Tests Completed ===\n");
     return 0;
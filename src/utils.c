@@ -1,7 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
 #include <time.h>
+#include <unistd.h>
 #include <openssl/sha.h>
 #include <openssl/evp.h>
 #include "utils.h"
@@ -36,13 +39,38 @@ void sha256(const char* input, char* output) {
     output[SHA256_DIGEST_LENGTH * 2] = '\0';
 }
 
-int is_valid_hash(const char* hash, int difficulty) {
-    for (int i = 0; i < difficulty; i++) {
-        if (hash[i] != '0') {
+int sha256_bytes(const unsigned char* input, size_t length, unsigned char* digest) {
+    unsigned int md_len;
+    return EVP_Digest(input, length, digest, &md_len, EVP_sha256(), NULL) == 1;
+}
+
+// Difficulty is the number of leading zero bits required in the digest
+int hash_meets_difficulty(const unsigned char* digest, int difficulty) {
+    if (difficulty < 0) {
+        difficulty = 0;
+    } else if (difficulty > 256) {
+        difficulty = 256;
+    }
+
+    int full_bytes = difficulty / 8;
+    for (int i = 0; i < full_bytes; i++) {
+        if (digest[i] != 0) {
             return 0;
         }
     }
-    return 1;
+
+    int remaining_bits = difficulty % 8;
+    return remaining_bits == 0 || (digest[full_bytes] >> (8 - remaining_bits)) == 0;
+}
+
+// Same check on a hex-encoded hash, for stored and displayed hashes
+int is_valid_hash(const char* hash, int difficulty) {
+    unsigned char digest[32];
+    if (!hash || strlen(hash) != 64) {
+        return 0;
+    }
+    hex_to_str(hash, digest, sizeof(digest));
+    return hash_meets_difficulty(digest, difficulty);
 }
 
 void increment_nonce(uint32_t* nonce) {
@@ -69,6 +97,120 @@ char* get_timestamp_str(time_t timestamp) {
     return buffer;
 }
 
+// Days in a month (1-12) of a year, for rejecting dates mktime() would roll over
+static int days_in_month(int year, int month) {
+    static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return month == 2 && leap ? 29 : days[month - 1];
+}
+
+// Parse local "YYYY-MM-DD", "YYYY-MM-DDTHH:MM[:SS]" or Unix seconds. A bare
+// date means the start of that day, or its last second with end_of_day.
+// Trailing text and out-of-range fields are rejected.
+int parse_timestamp(const char* input, int end_of_day, time_t* timestamp) {
+    if (!input || !timestamp || !*input) {
+        return 0;
+    }
+
+    if (strspn(input, "0123456789") == strlen(input)) {
+        *timestamp = (time_t)strtoll(input, NULL, 10);
+        return 1;
+    }
+
+    // Each %n records where one accepted form ends; it stays -1 if the
+    // text before it did not match
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    int date_end = -1, minute_end = -1, second_end = -1;
+    sscanf(input, "%4d-%2d-%2d%nT%2d:%2d%n:%2d%n", &year, &month, &day, &date_end, &hour, &minute, &minute_end,
+           &second, &second_end);
+    int length = (int)strlen(input);
+    if (date_end == length) {
+        if (end_of_day) {
+            hour = 23;
+            minute = 59;
+            second = 59;
+        }
+    } else if (minute_end == length) {
+        second = 0;
+    } else if (second_end != length) {
+        return 0;
+    }
+
+    if (year < 1900 || month < 1 || month > 12 || day < 1 || day > days_in_month(year, month) ||
+        hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 59) {
+        return 0;
+    }
+
+    struct tm tm_info;
+    memset(&tm_info, 0, sizeof(tm_info));
+    tm_info.tm_year = year - 1900;
+    tm_info.tm_mon = month - 1;
+    tm_info.tm_mday = day;
+    tm_info.tm_hour = hour;
+    tm_info.tm_min = minute;
+    tm_info.tm_sec = second;
+    tm_info.tm_isdst = -1;
+    time_t parsed = mktime(&tm_info);
+    if (parsed == (time_t)-1) {
+        return 0;
+    }
+    *timestamp = parsed;
+    return 1;
+}
+
+int get_online_cpus(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+// Parse a worker thread count: 0 (one per online CPU) up to
+// MAX_THREADS_PER_CPU per online CPU. Anything else is rejected.
+int parse_thread_count(const char* input, int* count) {
+    if (!input || !count || *input == '\0') {
+        return 0;
+    }
+
+    char* end;
+    long value = strtol(input, &end, 10);
+    if (*end != '\0' || value < 0 || value > (long)get_online_cpus() * MAX_THREADS_PER_CPU) {
+        return 0;
+    }
+    *count = (int)value;
+    return 1;
+}
+
+// Parse a decimal number in min..max. Digits only: signs, spaces, trailing
+// text and overflow are rejected rather than read as 0 or wrapped.
+int parse_uint64(const char* input, uint64_t min, uint64_t max, uint64_t* value) {
+    if (!input || !value || !isdigit((unsigned char)*input)) {
+        return 0;
+    }
+
+    char* end;
+    errno = 0;
+    unsigned long long parsed = strtoull(input, &end, 10);
+    if (*end != '\0' || errno == ERANGE || parsed < min || parsed > max) {
+        return 0;
+    }
+    *value = (uint64_t)parsed;
+    return 1;
+}
+
+int parse_uint32(const char* input, uint32_t min, uint32_t max, uint32_t* value) {
+    uint64_t parsed;
+    if (!value || !parse_uint64(input, min, max, &parsed)) {
+        return 0;
+    }
+    *value = (uint32_t)parsed;
+    return 1;
+}
+
+// Parse a per-second rate. A typo cannot turn into 0 (which callers read
+// as unthrottled); 0 itself must be written out.
+int parse_rate(const char* input, uint32_t* rate) {
+    return parse_uint32(input, 0, UINT32_MAX, rate);
+}
+
 int validate_patient_id(const char* patient_id) {
     if (!patient_id || strlen(patient_id) == 0 || strlen(patient_id) > 31) {
         return 0;
@@ -86,7 +228,7 @@ int validate_record_type(const char* record_type) {
 }
 
 int validate_record_data(const char* data) {
-    if (!data || strlen(data) == 0 || strlen(data) > 255) {
+    if (!data || strlen(data) == 0 || strlen(data) > MAX_RECORD_DATA_BYTES) {
         return 0;
     }
     // Add more validation rules as needed
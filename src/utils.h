@@ -5,10 +5,12 @@
 #include <stddef.h>  // for size_t
 #include <time.h>    // for time_t
 
-// SHA-256 hash function
+// SHA-256 hash functions
 void sha256(const char* input, char* output);
+int sha256_bytes(const unsigned char* input, size_t length, unsigned char* digest);
 
 // Proof of work functions
+int hash_meets_difficulty(const unsigned char* digest, int difficulty);
 int is_valid_hash(const char* hash, int difficulty);
 void increment_nonce(uint32_t* nonce);
 
@@ -18,8 +20,18 @@ void hex_to_str(const char* input, unsigned char* output, size_t length);
 
 // Time utilities
 char* get_timestamp_str(time_t timestamp);
+int parse_timestamp(const char* input, int end_of_day, time_t* timestamp);
+
+// System utilities
+#define MAX_THREADS_PER_CPU 4  // Largest --threads count, per online CPU
+int get_online_cpus(void);
+int parse_thread_count(const char* input, int* count);
+int parse_uint64(const char* input, uint64_t min, uint64_t max, uint64_t* value);
+int parse_uint32(const char* input, uint32_t min, uint32_t max, uint32_t* value);
+int parse_rate(const char* input, uint32_t* rate);
 
 // Input validation
+#define MAX_RECORD_DATA_BYTES 255  // Longest record text accepted
 int validate_patient_id(const char* patient_id);
 int validate_record_type(const char* record_type);
 int validate_record_data(const char* data);